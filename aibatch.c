@@ -0,0 +1,475 @@
+/**
+ * @file aibatch.c
+ * @author Maksim Kovalkov
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "tetris.h"
+#include "opponentai.h"
+
+#include "aibatch.h"
+
+#ifndef ROW_BITS_WORDS
+
+/** Placements the feature kernel works on at once, small enough for their counters to stay in the L1 cache. */
+#define KERNEL_BLOCK 64
+/** Placements held by the shared buffers (a multiple of `KERNEL_BLOCK`); evaluated whenever they are full, and at
+    the end of a batch. */
+#define BATCH_SLOTS 2048
+/** Most placements from one position: every piece, in every rotation, at every column of its grid. */
+#define ROOTS_MAX (7 * 4 * BOARD_COLS)
+/** Score of the best move where none fits, as in the single position search. */
+#define SCORE_NONE (-1e20)
+
+/**
+ * A placement of the next piece: a move the search chooses from.
+ */
+typedef struct Batch_root {
+    /** Index of the position it is a move of, among those being decided. */
+    int position;
+    unsigned char type, rots;
+    int x;
+    /** Whether a piece is left after this one: otherwise there is nothing to look ahead to. */
+    int any_left;
+    /** Heuristic of the board after the placement, and the best one after the next piece (`SCORE_NONE` if none
+        fits). */
+    double score, future;
+} Batch_root;
+
+#endif /* ifndef ROW_BITS_WORDS */
+
+struct Ai_batch {
+    Ai_config config;
+    /** Decides the positions that are not batched. */
+    Opponent_ai *ai;
+#ifndef ROW_BITS_WORDS
+    Piece_bits shapes[7][4];
+    /** Boards of the placements to evaluate, by blocks of `KERNEL_BLOCK` placements, and in a block one row of
+        every placement after the other: row `y` of placement `i` is at
+        `rows[(i / KERNEL_BLOCK * BOARD_ROWS + y) * KERNEL_BLOCK + i % KERNEL_BLOCK]`. */
+    Row_bits *rows;
+    double *scores;
+    /** What each placement is evaluated for: the index of the root it follows, or -1 - the index of the root it is
+        the board of. */
+    int *owner;
+    int n_slots;
+    Batch_root *roots;
+    int n_roots, cap_roots;
+#endif
+};
+
+static void decide_one(Ai_batch *, Ai_position const *, Ai_decision *);
+#ifndef ROW_BITS_WORDS
+static void init_shapes(Ai_batch *);
+static int batched(Ai_batch const *, Ai_position const *);
+static Row_bits shift(unsigned long, int);
+static void clear_rows(Row_bits *, int);
+static void push(Ai_batch *, Row_bits const *, Piece_bits const *, int, int, int);
+static void push_next(Ai_batch *, Row_bits const *, unsigned char const *, int);
+static int expand(Ai_batch *, Ai_position const *, int);
+static int choose(Ai_batch *, int, int, Ai_decision *);
+static Row_bits bit_count(Row_bits);
+static void evaluate(Ai_batch *);
+static void flush(Ai_batch *);
+#endif
+
+
+/* ------ Functions ------ */
+
+Ai_batch *
+ai_batch_create(Ai_config const *config)
+{
+    Ai_batch *const b = malloc_or_die(sizeof *b);
+
+    if (config)
+        b->config = *config;
+    else
+        ai_config_default(&b->config);
+    b->ai = ai_create(&b->config);
+#ifndef ROW_BITS_WORDS
+    init_shapes(b);
+    b->rows = malloc_or_die(sizeof *b->rows * BOARD_ROWS * BATCH_SLOTS);
+    b->scores = malloc_or_die(sizeof *b->scores * BATCH_SLOTS);
+    b->owner = malloc_or_die(sizeof *b->owner * BATCH_SLOTS);
+    b->n_slots = 0;
+    b->roots = NULL;
+    b->n_roots = b->cap_roots = 0;
+#endif
+    return b;
+}
+
+void
+ai_batch_destroy(Ai_batch *b)
+{
+    ai_destroy(b->ai);
+#ifndef ROW_BITS_WORDS
+    free(b->rows);
+    free(b->scores);
+    free(b->owner);
+    free(b->roots);
+#endif
+    free(b);
+}
+
+/**
+ * Decide a position on its own, with the ordinary search.
+ */
+void
+decide_one(Ai_batch *b, Ai_position const *pos, Ai_decision *d)
+{
+    Game game;
+
+    game_init(&game, pos->kind, 0);
+    memcpy(game.board[0], pos->board, sizeof game.board[0]);
+    memcpy(game.pieces_left, pos->pieces_left, sizeof game.pieces_left);
+    ai_next_action(b->ai, &game);
+    *d = *ai_last_decision(b->ai);
+}
+
+#ifdef ROW_BITS_WORDS
+
+void
+ai_batch_decide(Ai_batch *b, Ai_position const *positions, int n, Ai_decision *decisions)
+{
+    int p;
+
+    for (p = 0; p < n; ++p)
+        decide_one(b, &positions[p], &decisions[p]);
+}
+
+#else
+
+void
+ai_batch_decide(Ai_batch *b, Ai_position const *positions, int n, Ai_decision *decisions)
+{
+    int p, i, j;
+
+    /* generate and evaluate everything, then choose */
+    b->n_roots = 0;
+    for (p = 0; p < n; ++p)
+        if (!batched(b, &positions[p]) || !expand(b, &positions[p], p))
+            decide_one(b, &positions[p], &decisions[p]);
+    flush(b);
+
+    for (i = 0; i < b->n_roots; i = j) {
+        p = b->roots[i].position;
+        for (j = i; j < b->n_roots && b->roots[j].position == p; ++j) /* nop */;
+        if (!choose(b, i, j, &decisions[p]))
+            decide_one(b, &positions[p], &decisions[p]);
+    }
+}
+
+void
+init_shapes(Ai_batch *b)
+{
+    Piece piece;
+    int t, rots;
+
+    for (t = 0; t < 7; ++t) {
+        piece.type = (unsigned char) (Tetrimino_type_I + t);
+        init_piece_shape(&piece);
+        for (rots = 0; rots < 4; ++rots) {
+            piece_bits_init(&b->shapes[t][rots], &piece);
+            rotate_shape_cw(piece.shape);
+        }
+    }
+}
+
+/**
+ * @returns whether the search for this position is one `ai_batch_decide` does itself.
+ */
+int
+batched(Ai_batch const *b, Ai_position const *pos)
+{
+    int i, left = 0;
+
+    if (b->config.eval != Ai_eval_Double || b->config.depth > 1)
+        return 0;
+    for (i = 0; i < 7; ++i)
+        left += pos->pieces_left[i];
+    return left > 0 && left > b->config.endgame;
+}
+
+/**
+ * @returns the blocks of a row of a grid as a row of the board, with the grid at column `x`.
+ */
+Row_bits
+shift(unsigned long bits, int x)
+{
+    return (Row_bits) (x >= 0 ? bits << x : bits >> -x);
+}
+
+/**
+ * Remove the full rows among those of a piece placed at row `y`, like the search's `clear_lines` does.
+ */
+void
+clear_rows(Row_bits *board, int y)
+{
+    Row_bits const full = (Row_bits) ((((unsigned long) 1 << (BOARD_COLS - 1)) << 1) - 1);
+    int read, write = BOARD_ROWS - 1;
+
+    for (read = BOARD_ROWS - 1; read >= 0; --read)
+        if (read < y || read >= y + 4 || board[read] != full)
+            board[write--] = board[read];
+    for (; write >= 0; --write)
+        board[write] = 0;
+}
+
+/**
+ * Add a placement to the buffers: a piece placed at row `y` and column `x` of a board, or the board alone if
+ * `s` is NULL. Evaluates what they hold first if they are full.
+ */
+void
+push(Ai_batch *b, Row_bits const *board, Piece_bits const *s, int x, int y, int owner)
+{
+    Row_bits *rows;
+    int i;
+
+    if (b->n_slots == BATCH_SLOTS)
+        flush(b);
+    rows = b->rows + (size_t) (b->n_slots / KERNEL_BLOCK * BOARD_ROWS) * KERNEL_BLOCK + b->n_slots % KERNEL_BLOCK;
+    for (i = 0; i < BOARD_ROWS; ++i)
+        rows[i * KERNEL_BLOCK] = board[i];
+    for (i = 0; s && i < 4; ++i)
+        if (s->rows[i])
+            rows[(y + i) * KERNEL_BLOCK] |= shift(s->rows[i], x);
+    b->owner[b->n_slots++] = owner;
+}
+
+/**
+ * Add every placement of the next piece after root `root`, whose board after its lines are cleared is `board`.
+ */
+void
+push_next(Ai_batch *b, Row_bits const *board, unsigned char const *pieces_left, int root)
+{
+    int top[BOARD_COLS];
+    int t, rots, x;
+
+    row_bits_tops(board, top);
+    for (t = 0; t < 7; ++t) {
+        if (!pieces_left[t])
+            continue;
+        for (rots = 0; rots < 4; ++rots) {
+            Piece_bits const *const s = &b->shapes[t][rots];
+            /* like the single position search, which lifts the piece once per rotation: each column is tried from
+               where the piece landed in the previous one */
+            int from = s->lift;
+            for (x = -2; x + 2 < BOARD_COLS; ++x) {
+                int const y = piece_bits_landing(s, board, top, x, from);
+                if (y == BOARD_ROWS)
+                    continue;
+                push(b, board, s, x, from = y, root);
+            }
+        }
+    }
+}
+
+/**
+ * Generate the moves of a position, in the order of the single position search, and queue them for evaluation
+ * with the placements of the next piece after each.
+ * @returns the number of moves, 0 if no piece fits.
+ */
+int
+expand(Ai_batch *b, Ai_position const *pos, int position)
+{
+    Row_bits board[BOARD_ROWS];
+    unsigned char left[7];
+    int top[BOARD_COLS];
+    int const first = b->n_roots;
+    int i, t, rots, x;
+
+    if (b->cap_roots - b->n_roots < ROOTS_MAX) {
+        Batch_root *const grown = malloc_or_die(sizeof *grown * (b->cap_roots = 2 * b->cap_roots + ROOTS_MAX));
+        if (b->n_roots)
+            memcpy(grown, b->roots, sizeof *grown * b->n_roots);
+        free(b->roots);
+        b->roots = grown;
+    }
+    for (i = 0; i < BOARD_ROWS; ++i)
+        board[i] = row_bits_pack(pos->board[i]);
+    row_bits_tops(board, top);
+    memcpy(left, pos->pieces_left, sizeof left);
+
+    for (t = 0; t < 7; ++t) {
+        if (!left[t])
+            continue;
+        for (rots = 0; rots < 4; ++rots) {
+            Piece_bits const *const s = &b->shapes[t][rots];
+            int from = s->lift;
+            for (x = -2; x + 2 < BOARD_COLS; ++x) {
+                Batch_root *const r = &b->roots[b->n_roots];
+                Row_bits placed[BOARD_ROWS];
+                int const y = piece_bits_landing(s, board, top, x, from);
+
+                if (y == BOARD_ROWS)
+                    continue;
+                from = y;
+                r->position = position;
+                r->type = (unsigned char) (Tetrimino_type_I + t);
+                r->rots = (unsigned char) rots;
+                r->x = x;
+                r->future = SCORE_NONE;
+                memcpy(placed, board, sizeof placed);
+                for (i = 0; i < 4; ++i)
+                    if (s->rows[i])
+                        placed[y + i] |= shift(s->rows[i], x);
+                push(b, placed, NULL, 0, 0, -1 - b->n_roots);
+
+                --left[t];
+                for (r->any_left = 0, i = 0; i < 7; ++i)
+                    r->any_left |= left[i] != 0;
+                if (b->config.depth > 0 && r->any_left) {
+                    clear_rows(placed, y);
+                    push_next(b, placed, left, b->n_roots);
+                }
+                ++left[t];
+                ++b->n_roots;
+            }
+        }
+    }
+    return b->n_roots - first;
+}
+
+/**
+ * Choose among the evaluated moves [first, last) of a position, as the single position search does.
+ * @returns 0 in the unlikely case none scores above `SCORE_NONE`, where the ordinary search is left to decide.
+ */
+int
+choose(Ai_batch *b, int first, int last, Ai_decision *d)
+{
+    double max_score = SCORE_NONE;
+    int i;
+
+    d->endgame = 0;
+    d->book = 0;
+    d->n_candidates = 0;
+    for (i = first; i < last; ++i) {
+        Batch_root const *const r = &b->roots[i];
+        double score = r->score;
+        Piece piece;
+
+        if (b->config.depth > 0)
+            score += b->config.weights.future * (r->any_left ? r->future : 0);
+        piece.type = r->type;
+        piece.x = r->x;
+        ai_record_candidate(d, score, &piece, r->rots);
+        if (score > max_score) {
+            max_score = score;
+            d->type = r->type;
+            d->rots = r->rots;
+            d->x = r->x;
+        }
+    }
+    return max_score != SCORE_NONE;
+}
+
+/**
+ * @returns the number of bits set, with operations that vectorize (unlike a call to a library function).
+ */
+Row_bits
+bit_count(Row_bits x)
+{
+    x = (Row_bits) (x - (x >> 1 & (Row_bits) 0x55555555UL));
+    x = (Row_bits) ((x & (Row_bits) 0x33333333UL) + (x >> 2 & (Row_bits) 0x33333333UL));
+    x = (Row_bits) ((x + (x >> 4)) & (Row_bits) 0x0f0f0f0fUL);
+    x = (Row_bits) (x + (x >> 8));
+    x = (Row_bits) (x + (x >> 8 >> 8));
+    return (Row_bits) (x & 0x3f);
+}
+
+/**
+ * Heuristic of every placement in the buffers: `ai_board_features` and `ai_heuristic`, computed a row at a time
+ * for a block of placements, so that each step is a loop over placements.
+ */
+void
+evaluate(Ai_batch *b)
+{
+    Ai_weights const *const w = &b->config.weights;
+    Row_bits const full = (Row_bits) ((((unsigned long) 1 << (BOARD_COLS - 1)) << 1) - 1);
+    Row_bits const right_wall = (Row_bits) ((unsigned long) 1 << (BOARD_COLS - 1));
+    int base;
+
+    for (base = 0; base < b->n_slots; base += KERNEL_BLOCK) {
+        int const n = b->n_slots - base < KERNEL_BLOCK ? b->n_slots - base : KERNEL_BLOCK;
+        Row_bits const *const block = b->rows + (size_t) base * BOARD_ROWS;
+        /* the counters fit a row: they are below BOARD_ROWS * BOARD_COLS */
+        Row_bits above[KERNEL_BLOCK], below[KERNEL_BLOCK], prev[KERNEL_BLOCK];
+        Row_bits max_height[KERNEL_BLOCK], lines[KERNEL_BLOCK], holes[KERNEL_BLOCK], bumps[KERNEL_BLOCK];
+        Row_bits row_trans[KERNEL_BLOCK], col_trans[KERNEL_BLOCK], wells[KERNEL_BLOCK], covered[KERNEL_BLOCK];
+        int i, k;
+
+        memset(above, 0, sizeof above);
+        memset(below, 0, sizeof below);
+        memset(max_height, 0, sizeof max_height);
+        memset(lines, 0, sizeof lines);
+        memset(holes, 0, sizeof holes);
+        memset(bumps, 0, sizeof bumps);
+        memset(row_trans, 0, sizeof row_trans);
+        memset(col_trans, 0, sizeof col_trans);
+        memset(wells, 0, sizeof wells);
+        memset(covered, 0, sizeof covered);
+        memcpy(prev, block, sizeof *prev * n);
+
+        /* from the top down: everything but the blocks above holes */
+        for (i = 0; i < BOARD_ROWS; ++i) {
+            Row_bits const *const row = block + i * KERNEL_BLOCK;
+            for (k = 0; k < n; ++k) {
+                Row_bits const r = row[k], a = above[k];
+                lines[k] += r == full;
+                holes[k] += bit_count((Row_bits) (~r & a));
+                row_trans[k] += bit_count((Row_bits) ((r ^ r >> 1) & full >> 1)) + !(r & 1) + !(r & right_wall);
+                col_trans[k] += bit_count((Row_bits) (r ^ prev[k]));
+                wells[k] += bit_count((Row_bits) (~(r | a) & (r << 1 | 1) & (r >> 1 | right_wall) & full));
+                above[k] = (Row_bits) (a | r);
+                max_height[k] += above[k] != 0;
+                /* a column is as high as the rows at and below its first block: two neighbouring columns differ in
+                   height by the number of rows where only one of them is at or below its first block */
+                bumps[k] += bit_count((Row_bits) ((above[k] ^ above[k] >> 1) & full >> 1));
+                prev[k] = r;
+            }
+        }
+        /* the floor is occupied */
+        for (k = 0; k < n; ++k)
+            col_trans[k] += bit_count((Row_bits) (~prev[k] & full));
+
+        /* from the bottom up: the blocks above holes */
+        for (i = BOARD_ROWS - 1; i >= 0; --i) {
+            Row_bits const *const row = block + i * KERNEL_BLOCK;
+            for (k = 0; k < n; ++k) {
+                covered[k] += bit_count((Row_bits) (row[k] & below[k]));
+                below[k] |= ~row[k] & full;
+            }
+        }
+
+        /* the same sum, in the same order, as `ai_heuristic`: the scores are identical */
+        for (k = 0; k < n; ++k)
+            b->scores[base + k] = w->height * max_height[k] + w->lines * lines[k] + w->penalty * (lines[k] >= 3)
+                + w->holes * holes[k] + w->bumps * bumps[k]
+                + w->row_trans * row_trans[k] + w->col_trans * col_trans[k] + w->wells * wells[k]
+                + w->covered * covered[k];
+    }
+}
+
+/**
+ * Evaluate the placements in the buffers, hand the scores to their roots, and empty the buffers.
+ */
+void
+flush(Ai_batch *b)
+{
+    int i;
+
+    evaluate(b);
+    for (i = 0; i < b->n_slots; ++i) {
+        int const owner = b->owner[i];
+        if (owner < 0)
+            b->roots[-1 - owner].score = b->scores[i];
+        else if (b->scores[i] > b->roots[owner].future)
+            b->roots[owner].future = b->scores[i];
+    }
+    b->n_slots = 0;
+}
+
+#endif /* ifdef ROW_BITS_WORDS */
@@ -0,0 +1,51 @@
+/**
+ * @file aibatch.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_AIBATCH_H
+#define XTETRIS_AIBATCH_H
+
+#include "tetris.h"
+#include "opponentai.h"
+
+/**
+ * Decisions of the AI for many independent positions at once, for programs that run many games side by side (bulk
+ * self-play, data generation). Each decision is the one `ai_next_action` would make from the same position with the
+ * same configuration, candidates included, but the work is shared: the placements of every position are generated
+ * as row bitboards into one set of buffers, laid out feature by feature across placements, and the heuristic is
+ * evaluated on a whole buffer at a time with loops the compiler can vectorize.
+ *
+ * Only the heuristic search of `Ai_eval_Double` with a depth of 0 or 1 (the default) is batched. Other
+ * configurations, endgame positions (see `Ai_config.endgame`) and positions where no piece fits are decided one by
+ * one by an ordinary AI, as are all positions on boards of more than 32 columns. Opening books are not used.
+ */
+
+/**
+ * A position to decide: the board of the player to move, the pieces left, and the kind of game (which only matters
+ * for the endgame search).
+ */
+typedef struct Ai_position {
+    Board board;
+    unsigned char pieces_left[7];
+    enum Game_kind kind;
+} Ai_position;
+
+typedef struct Ai_batch Ai_batch;
+
+/**
+ * Create the buffers and the AI for batched decisions.
+ * Caller owns the returned object and must call `ai_batch_destroy` to clean up.
+ * @param config how the AI should play, or NULL for the default configuration. It is copied.
+ */
+Ai_batch * ai_batch_create(Ai_config const *);
+/**
+ * Deallocate an Ai_batch created by `ai_batch_create`.
+ */
+void ai_batch_destroy(Ai_batch *);
+/**
+ * Decide `n` positions. Positions are independent: the decision for each is the same whatever the others are.
+ * @param decisions where the `n` decisions are written, in the order of the positions.
+ */
+void ai_batch_decide(Ai_batch *, Ai_position const *positions, int n, Ai_decision *decisions);
+#endif /* ifndef XTETRIS_AIBATCH_H */
@@ -0,0 +1,153 @@
+/**
+ * @file book.c
+ * @author Maksim Kovalkov
+ */
+
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef XTETRIS_HAVE_POSIX
+#include <unistd.h>
+#endif
+
+#include "tetris.h"
+#include "util.h"
+
+#include "book.h"
+
+/* fail to compile if the fields and the padding do not add up */
+typedef char book_header_size_check[sizeof (Book_header) == 64 ? 1 : -1];
+
+static void fill_header(Book_header *, size_t n_entries, int depth, unsigned long config_hash);
+static int compare_entries(void const *, void const *);
+static int compare_keys(Book_entry const *, Book_entry const *);
+
+void
+fill_header(Book_header *h, size_t n_entries, int depth, unsigned long config_hash)
+{
+    memset(h, 0, sizeof *h);
+    memcpy(h->magic, BOOK_MAGIC, sizeof h->magic);
+    h->byte_order = BOOK_BYTE_ORDER;
+    h->entry_size = sizeof (Book_entry);
+    h->board_rows = BOARD_ROWS;
+    h->board_cols = BOARD_COLS;
+    h->n_entries = (unsigned long) n_entries;
+    h->depth = (unsigned long) depth;
+    h->config_hash = config_hash;
+}
+
+/**
+ * Order of the entries of a book: by hash, then by position.
+ */
+int
+compare_keys(Book_entry const *a, Book_entry const *b)
+{
+    if (a->hash != b->hash)
+        return a->hash < b->hash ? -1 : 1;
+    return memcmp(a, b, offsetof(Book_entry, type));
+}
+
+int
+compare_entries(void const *a, void const *b)
+{
+    return compare_keys(a, b);
+}
+
+void
+book_key(Book_entry *e, Board const board, unsigned char const pieces_left[7])
+{
+    unsigned long h = 2166136261UL;
+    unsigned char const *p;
+    int y;
+
+    memset(e, 0, sizeof *e);
+    for (y = 0; y < BOARD_ROWS; ++y)
+        e->rows[y] = row_bits_pack(board[y]);
+    memcpy(e->pieces_left, pieces_left, sizeof e->pieces_left);
+
+    /* FNV-1a over the rows and the pieces left */
+    for (p = (unsigned char const *) e->rows; p < e->pieces_left + sizeof e->pieces_left; ++p)
+        h = ((h ^ *p) * 16777619UL) & 0xffffffffUL;
+    e->hash = h;
+}
+
+int
+book_save(char const *path, Book_entry *entries, size_t n_entries, int depth, unsigned long config_hash)
+{
+    char tmp_path[FILENAME_MAX];
+    Book_header h;
+    int ok;
+    FILE *f;
+
+    if (strlen(path) + 5 > sizeof tmp_path)
+        return -1;
+    sprintf(tmp_path, "%s.tmp", path);
+    qsort(entries, n_entries, sizeof *entries, &compare_entries);
+    if (!(f = fopen(tmp_path, "wb")))
+        return -1;
+    fill_header(&h, n_entries, depth, config_hash);
+    ok = fwrite(&h, sizeof h, 1, f) == 1 && fwrite(entries, sizeof *entries, n_entries, f) == n_entries
+        && fflush(f) == 0;
+#ifdef XTETRIS_HAVE_POSIX
+    /* as for checkpoints: the data must be on disk before the rename is */
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    if (fclose(f) != 0 || !ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int
+book_map(Book *book, char const *path)
+{
+    Book_header h;
+    Book_header const *found;
+
+    if (map_file(&book->file, path) != 0)
+        return -1;
+    found = book->file.data;
+    if (book->file.size >= sizeof h)
+        fill_header(&h, found->n_entries, (int) found->depth, found->config_hash);
+    if (book->file.size < sizeof h || memcmp(found, &h, sizeof h) != 0
+        || book->file.size - sizeof h != h.n_entries * sizeof (Book_entry)) {
+        unmap_file(&book->file);
+        return -1;
+    }
+    book->entries = (Book_entry const *) (found + 1);
+    book->n_entries = h.n_entries;
+    book->config_hash = h.config_hash;
+    return 0;
+}
+
+void
+book_unmap(Book *book)
+{
+    unmap_file(&book->file);
+    book->entries = NULL;
+    book->n_entries = 0;
+    book->config_hash = 0;
+}
+
+Book_entry const *
+book_probe(Book const *book, Board const board, unsigned char const pieces_left[7])
+{
+    Book_entry key;
+    size_t lo = 0, hi = book->n_entries;
+
+    book_key(&key, board, pieces_left);
+    /* first entry not below the key */
+    while (lo < hi) {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (compare_keys(&book->entries[mid], &key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < book->n_entries && compare_keys(&book->entries[lo], &key) == 0)
+        return &book->entries[lo];
+    return NULL;
+}
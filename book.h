@@ -0,0 +1,91 @@
+/**
+ * @file book.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_BOOK_H
+#define XTETRIS_BOOK_H
+
+#include <stddef.h>
+
+#include "tetris.h"
+#include "util.h"
+
+/**
+ * Opening books: the best placement for positions of the first moves of a game, chosen offline with a deeper search
+ * than the AI can afford while playing (see x-tetris-book), and looked up by the AI before searching (see
+ * `ai_set_book`).
+ *
+ * A file is a `Book_header` followed by `Book_entry`s sorted by hash. Like training data (see trainlog.h), it is in
+ * the byte order and formats of the machine that wrote it, and is mapped and used in place: a lookup is a binary
+ * search in the mapping.
+ */
+
+#define BOOK_MAGIC "XTBOOK02"
+/** Written as a native `unsigned short`: readers on a machine with the other byte order see 0x0201. */
+#define BOOK_BYTE_ORDER 0x0102
+
+typedef struct Book_header {
+    char magic[8];
+    unsigned short byte_order, entry_size, board_rows, board_cols;
+    unsigned long n_entries;
+    /** Search depth the moves were chosen with, for information. */
+    unsigned long depth;
+    /** `ai_config_book_hash` of the configuration of the AI the book was built for. */
+    unsigned long config_hash;
+    unsigned char pad[64 - 16 - 3 * sizeof (unsigned long)];
+} Book_header;
+
+/**
+ * A position (the board of the player to move and the pieces left) and its move. Compared as raw bytes, so always
+ * filled by `book_key`.
+ */
+typedef struct Book_entry {
+    /** Hash of the position, the order of the entries in a book. */
+    unsigned long hash;
+    /** Occupied cells, one bitboard per row. */
+    Row_bits rows[BOARD_ROWS];
+    unsigned char pieces_left[7];
+    /** The move: piece type, clockwise rotations from the initial shape, and column, as in `Ai_decision`. */
+    unsigned char type, rots;
+    signed char x;
+} Book_entry;
+
+/**
+ * An opening book mapped in memory.
+ */
+typedef struct Book {
+    Mapped_file file;
+    Book_entry const *entries;
+    size_t n_entries;
+    /** As in `Book_header`. */
+    unsigned long config_hash;
+} Book;
+
+/**
+ * Fill in the position of an entry (its move is left at 0).
+ */
+void book_key(Book_entry *, Board const, unsigned char const pieces_left[7]);
+/**
+ * Sort entries and write them as a book, replacing any file at `path`. The book is written to `path` with `.tmp`
+ * appended, then renamed: if writing fails, a previous book at `path` is left as it was.
+ * @param depth the search depth they were chosen with.
+ * @param config_hash `ai_config_book_hash` of the configuration the book is for.
+ * @returns 0 on success, -1 on failure.
+ */
+int book_save(char const *path, Book_entry *entries, size_t n_entries, int depth, unsigned long config_hash);
+/**
+ * Map a book and check its header.
+ * @returns 0 on success, -1 if it cannot be read or was not written by a compatible build.
+ */
+int book_map(Book *, char const *path);
+/**
+ * Release a mapped book; its entries become invalid.
+ */
+void book_unmap(Book *);
+/**
+ * Look a position up.
+ * @returns its entry, or NULL if the book does not have it.
+ */
+Book_entry const * book_probe(Book const *, Board const, unsigned char const pieces_left[7]);
+#endif /* ifndef XTETRIS_BOOK_H */
@@ -0,0 +1,137 @@
+/**
+ * @file checkpoint.c
+ * @author Maksim Kovalkov
+ */
+
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef XTETRIS_HAVE_POSIX
+#include <unistd.h>
+#endif
+
+#include "opponentai.h"
+#include "packed.h"
+#include "util.h"
+
+#include "checkpoint.h"
+
+/* fail to compile if the fields and the padding do not add up */
+typedef char checkpoint_header_size_check[sizeof (Checkpoint_header) == 64 ? 1 : -1];
+
+static size_t section_size(size_t);
+static int write_section(FILE *, void const *, size_t);
+static void fill_header(Checkpoint_header *, size_t progress_size, size_t n_games);
+
+/**
+ * @returns the room taken in the file by a section of `size` bytes: whole cache lines.
+ */
+size_t
+section_size(size_t size)
+{
+    return (size + 63) / 64 * 64;
+}
+
+/**
+ * Write a section, and the zeros padding it to `section_size`.
+ * @returns 0 on success, -1 on failure.
+ */
+int
+write_section(FILE *f, void const *data, size_t size)
+{
+    static unsigned char const zeros[64];
+    size_t const pad = section_size(size) - size;
+
+    return fwrite(data, 1, size, f) == size && fwrite(zeros, 1, pad, f) == pad ? 0 : -1;
+}
+
+/**
+ * The header written by this build, for a checkpoint with the given contents.
+ */
+void
+fill_header(Checkpoint_header *h, size_t progress_size, size_t n_games)
+{
+    memset(h, 0, sizeof *h);
+    memcpy(h->magic, CHECKPOINT_MAGIC, sizeof h->magic);
+    h->byte_order = CHECKPOINT_BYTE_ORDER;
+    h->game_size = sizeof (Packed_game);
+    h->board_rows = BOARD_ROWS;
+    h->board_cols = BOARD_COLS;
+    h->config_size = sizeof (Ai_config);
+    h->progress_size = (unsigned long) progress_size;
+    h->n_games = (unsigned long) n_games;
+}
+
+int
+checkpoint_save(char const *path, Ai_config const *config, void const *progress, size_t progress_size,
+                Packed_game const *games, size_t n_games)
+{
+    char tmp_path[FILENAME_MAX];
+    Checkpoint_header h;
+    int ok;
+    FILE *f;
+
+    if (strlen(path) + 5 > sizeof tmp_path)
+        return -1;
+    sprintf(tmp_path, "%s.tmp", path);
+    if (!(f = fopen(tmp_path, "wb")))
+        return -1;
+
+    fill_header(&h, progress_size, n_games);
+    ok = fwrite(&h, sizeof h, 1, f) == 1
+        && write_section(f, config, sizeof *config) == 0
+        && write_section(f, progress, progress_size) == 0
+        && fwrite(games, sizeof *games, n_games, f) == n_games
+        && fflush(f) == 0;
+#ifdef XTETRIS_HAVE_POSIX
+    /* the data must be on disk before the rename is, or a system crash could leave an empty checkpoint */
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    if (fclose(f) != 0 || !ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int
+checkpoint_map(Checkpoint_reader *r, char const *path, size_t progress_size)
+{
+    Checkpoint_header h;
+    size_t const config_at = sizeof h;
+    size_t const progress_at = config_at + section_size(sizeof (Ai_config));
+    size_t const games_at = progress_at + section_size(progress_size);
+    unsigned char const *data;
+    FILE *f;
+
+    if (!(f = fopen(path, "rb")))
+        return 0;
+    fclose(f);
+    if (map_file(&r->file, path) != 0)
+        return -1;
+
+    data = r->file.data;
+    if (r->file.size >= games_at)
+        fill_header(&h, progress_size, ((Checkpoint_header const *) data)->n_games);
+    if (r->file.size < games_at || memcmp(data, &h, sizeof h) != 0
+        || r->file.size - games_at != h.n_games * sizeof (Packed_game)) {
+        unmap_file(&r->file);
+        return -1;
+    }
+    r->config = (Ai_config const *) (data + config_at);
+    r->progress = data + progress_at;
+    r->games = (Packed_game const *) (data + games_at);
+    r->n_games = h.n_games;
+    return 1;
+}
+
+void
+checkpoint_unmap(Checkpoint_reader *r)
+{
+    unmap_file(&r->file);
+    r->config = NULL;
+    r->progress = NULL;
+    r->games = NULL;
+    r->n_games = 0;
+}
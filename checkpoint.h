@@ -0,0 +1,69 @@
+/**
+ * @file checkpoint.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_CHECKPOINT_H
+#define XTETRIS_CHECKPOINT_H
+
+#include <stddef.h>
+
+#include "opponentai.h"
+#include "packed.h"
+#include "util.h"
+
+/**
+ * Checkpoints: snapshots of a long run (an AI configuration, the runner's own progress, and every game it has in
+ * flight) from which the run can be resumed if the process dies.
+ *
+ * A file is a `Checkpoint_header`, then the configuration, the progress and the games, each starting on a cache
+ * line. Like training data (see trainlog.h), it is in the byte order and formats of the machine that wrote it and is
+ * used in place: loading a checkpoint maps it, and its games stay `Packed_game`s in the mapping until the run picks
+ * each of them up again, so resuming thousands of games costs no more than resuming one.
+ *
+ * Checkpoints are replaced atomically: a crash at any point leaves either the old or the new one, never a partial
+ * one.
+ */
+
+#define CHECKPOINT_MAGIC "XTCKPT01"
+/** Written as a native `unsigned short`: readers on a machine with the other byte order see 0x0201. */
+#define CHECKPOINT_BYTE_ORDER 0x0102
+
+typedef struct Checkpoint_header {
+    char magic[8];
+    unsigned short byte_order, game_size, board_rows, board_cols;
+    /** Sizes of the sections following the header. */
+    unsigned long config_size, progress_size, n_games;
+    unsigned char pad[64 - 16 - 3 * sizeof (unsigned long)];
+} Checkpoint_header;
+
+/**
+ * A checkpoint mapped in memory: everything it holds can be used directly, until `checkpoint_unmap`.
+ */
+typedef struct Checkpoint_reader {
+    Mapped_file file;
+    Ai_config const *config;
+    /** The runner's progress, of the size it was written with (and checked against when mapping). */
+    void const *progress;
+    Packed_game const *games;
+    size_t n_games;
+} Checkpoint_reader;
+
+/**
+ * Replace the checkpoint at `path` with a new one, written to `path`.tmp first and then renamed over it.
+ * @param progress the runner's own state, `progress_size` bytes written as they are.
+ * @returns 0 on success, -1 on failure (the previous checkpoint, if any, is left as it was).
+ */
+int checkpoint_save(char const *path, Ai_config const *, void const *progress, size_t progress_size,
+                    Packed_game const *games, size_t n_games);
+/**
+ * Map a checkpoint and check its header.
+ * @returns 1 on success, 0 if there is no file at `path`, -1 if it cannot be read, was not written by a compatible
+ * build, or holds progress of another size than `progress_size`.
+ */
+int checkpoint_map(Checkpoint_reader *, char const *path, size_t progress_size);
+/**
+ * Release a mapped checkpoint.
+ */
+void checkpoint_unmap(Checkpoint_reader *);
+#endif /* ifndef XTETRIS_CHECKPOINT_H */
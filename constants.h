@@ -10,9 +10,24 @@
  * Constants that are useful for many of the files.
  */
 
+/**
+ * Board dimensions. The game is played on 15x10; other sizes are chosen when building, e.g.
+ * `make BOARD_ROWS=40 BOARD_COLS=20 RELDIR=build/40x20`, for stress testing the engine and the AI. Boards of up to
+ * 127 rows and 127 columns are supported: piece positions are kept on a `signed char` by `Packed_game` and
+ * `Book_entry`, and on a byte (see `BOTPROTO_X_BIAS`) by the binary bot protocol.
+ */
+#ifndef BOARD_ROWS
 #define BOARD_ROWS 15
+#endif
+#ifndef BOARD_COLS
 #define BOARD_COLS 10
+#endif
+#if BOARD_ROWS > 127 || BOARD_COLS > 127
+#error "boards of more than 127 rows or columns are not supported"
+#endif
 #define STARTING_PIECES 20
+/** Lines to clear at once for the opponent to get garbage (see `add_garbage`). */
+#define GARBAGE_MIN_LINES 3
 
 /**
  * Points that get added to the score for clearing 1, 2, 3 or 4 lines respectively.
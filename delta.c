@@ -0,0 +1,133 @@
+/**
+ * @file delta.c
+ * @author Maksim Kovalkov
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "tetris.h"
+
+#include "delta.h"
+
+static unsigned char * put_score(unsigned char *, int, int);
+
+/**
+ * Append a `Delta_tag_Score` record.
+ * @returns the position right after it.
+ */
+unsigned char *
+put_score(unsigned char *p, int player, int score)
+{
+    unsigned long const u = (unsigned long) score;
+    *p++ = Delta_tag_Score;
+    *p++ = (unsigned char) player;
+    *p++ = (unsigned char) (u >> 24 & 0xff);
+    *p++ = (unsigned char) (u >> 16 & 0xff);
+    *p++ = (unsigned char) (u >> 8 & 0xff);
+    *p++ = (unsigned char) (u & 0xff);
+    return p;
+}
+
+size_t
+delta_encode(Game const *prev, Game const *cur, unsigned char *buf)
+{
+    unsigned char *p = buf;
+    int pl, row;
+
+    *p++ = prev ? 0 : DELTA_KEYFRAME;
+
+    if (!prev || prev->kind != cur->kind || prev->state != cur->state
+        || prev->current_player != cur->current_player || prev->lines_cleared != cur->lines_cleared) {
+        *p++ = Delta_tag_Status;
+        *p++ = (unsigned char) cur->kind;
+        *p++ = (unsigned char) cur->state;
+        *p++ = (unsigned char) cur->current_player;
+        *p++ = (unsigned char) cur->lines_cleared;
+    }
+    for (pl = 0; pl < 2; ++pl)
+        if (!prev || prev->score[pl] != cur->score[pl])
+            p = put_score(p, pl, cur->score[pl]);
+    if (!prev || memcmp(prev->pieces_left, cur->pieces_left, sizeof cur->pieces_left) != 0) {
+        *p++ = Delta_tag_Pieces;
+        memcpy(p, cur->pieces_left, sizeof cur->pieces_left);
+        p += sizeof cur->pieces_left;
+    }
+    for (pl = 0; pl < 2; ++pl) {
+        for (row = 0; row < BOARD_ROWS; ++row) {
+            if (prev && memcmp(prev->board[pl][row], cur->board[pl][row], BOARD_COLS) == 0)
+                continue;
+            *p++ = Delta_tag_Row;
+            *p++ = (unsigned char) pl;
+            *p++ = (unsigned char) row;
+            memcpy(p, cur->board[pl][row], BOARD_COLS);
+            p += BOARD_COLS;
+        }
+    }
+    /* the active piece only means something while it is being placed (or when it could not be) */
+    if ((cur->state == Game_state_Place || cur->state == Game_state_Lose)
+        && (!prev || prev->state != cur->state || memcmp(&prev->active_piece, &cur->active_piece, sizeof (Piece)) != 0)) {
+        *p++ = Delta_tag_Piece;
+        *p++ = cur->active_piece.type;
+        *p++ = (unsigned char) (cur->active_piece.x + 128);
+        *p++ = (unsigned char) (cur->active_piece.y + 128);
+        memcpy(p, cur->active_piece.shape, sizeof (Tetrimino_shape));
+        p += sizeof (Tetrimino_shape);
+    }
+
+    return p - buf;
+}
+
+int
+delta_apply(Game *game, unsigned char const *buf, size_t len)
+{
+    unsigned char const *p = buf, *const end = buf + len;
+
+    if (len < 1)
+        return -1;
+    ++p;
+
+    while (p < end) {
+        switch (*p++) {
+        case Delta_tag_Status:
+            if (end - p < 4) return -1;
+            game->kind = (enum Game_kind) p[0];
+            game->state = (enum Game_state) p[1];
+            game->current_player = p[2];
+            game->lines_cleared = p[3];
+            p += 4;
+            break;
+        case Delta_tag_Score:
+            if (end - p < 5 || p[0] > 1) return -1;
+            {
+                unsigned long const u = (unsigned long) p[1] << 24 | (unsigned long) p[2] << 16
+                    | (unsigned long) p[3] << 8 | p[4];
+                /* undo two's complement without relying on implementation-defined conversions */
+                game->score[p[0]] = u & 0x80000000UL ? -(int) (~u & 0x7fffffffUL) - 1 : (int) u;
+            }
+            p += 5;
+            break;
+        case Delta_tag_Pieces:
+            if (end - p < 7) return -1;
+            memcpy(game->pieces_left, p, 7);
+            p += 7;
+            break;
+        case Delta_tag_Row:
+            if (end - p < 2 + BOARD_COLS || p[0] > 1 || p[1] >= BOARD_ROWS) return -1;
+            memcpy(game->board[p[0]][p[1]], p + 2, BOARD_COLS);
+            p += 2 + BOARD_COLS;
+            break;
+        case Delta_tag_Piece:
+            if (end - p < 3 + (int) sizeof (Tetrimino_shape)) return -1;
+            game->active_piece.type = p[0];
+            game->active_piece.x = p[1] - 128;
+            game->active_piece.y = p[2] - 128;
+            memcpy(game->active_piece.shape, p + 3, sizeof (Tetrimino_shape));
+            p += 3 + sizeof (Tetrimino_shape);
+            break;
+        default:
+            return -1;
+        }
+    }
+    return 0;
+}
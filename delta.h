@@ -0,0 +1,50 @@
+/**
+ * @file delta.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_DELTA_H
+#define XTETRIS_DELTA_H
+
+#include <stddef.h>
+
+#include "tetris.h"
+
+/**
+ * Compact encoding of the visible game state, as the difference from a previously sent state.  
+ * A frame starts with a header byte (`DELTA_KEYFRAME` if it carries the whole state rather than a difference),
+ * followed by records, each a tag byte and a fixed-size payload:
+ * - `Delta_tag_Status`: kind, state, current player, lines cleared (4 bytes);
+ * - `Delta_tag_Score`: player, score as a 32-bit big-endian two's complement integer (5 bytes);
+ * - `Delta_tag_Pieces`: the 7 counts of pieces left (7 bytes);
+ * - `Delta_tag_Row`: player, row index, then `BOARD_COLS` cells (2 + BOARD_COLS bytes);
+ * - `Delta_tag_Piece`: type, x + 128, y + 128, then the 16 cells of the shape (19 bytes).
+ *
+ * The RNG state is never encoded: a decoded game is only fit for display, not for continuing the game.
+ */
+enum Delta_tag {
+    Delta_tag_Status = 1,
+    Delta_tag_Score,
+    Delta_tag_Pieces,
+    Delta_tag_Row,
+    Delta_tag_Piece
+};
+
+/** Header flag of a frame that does not depend on any previous state. */
+#define DELTA_KEYFRAME 0x80
+
+/** Upper bound on the size of an encoded frame. */
+#define DELTA_MAX_LEN (1 + 5 + 2 * 6 + 8 + 2 * BOARD_ROWS * (3 + BOARD_COLS) + 20)
+
+/**
+ * Encode `cur` as a difference from `prev`, or as a keyframe if `prev` is NULL.
+ * `buf` must have room for at least `DELTA_MAX_LEN` bytes.
+ * @returns the length of the frame (just the header byte if nothing changed).
+ */
+size_t delta_encode(Game const *prev, Game const *cur, unsigned char *buf);
+/**
+ * Apply a frame to `game`, which must hold the state the frame was encoded against (anything, for a keyframe).
+ * @returns 0 on success, -1 if the frame is malformed (in which case `game` may be partially updated).
+ */
+int delta_apply(Game *, unsigned char const *buf, size_t len);
+#endif /* ifndef XTETRIS_DELTA_H */
@@ -0,0 +1,51 @@
+/**
+ * @file gamectx.c
+ * @author Maksim Kovalkov
+ */
+
+#include <stddef.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "iohandler.h"
+#include "util.h"
+
+#include "gamectx.h"
+
+void
+ctxpool_init(Game_ctx_pool *cp, size_t capacity, int with_render, size_t ai_bytes)
+{
+    /* slot layout: | Game_ctx | Game | Opponent_ai | Io_handler (optional) |, each starting on a cache line */
+    cp->game_offset = CACHE_ALIGN(sizeof (Game_ctx));
+    cp->ai_offset = cp->game_offset + CACHE_ALIGN(sizeof (Game));
+    cp->io_offset = cp->ai_offset + CACHE_ALIGN(ai_bytes);
+    cp->with_render = with_render;
+
+    pool_init(&cp->pool, cp->io_offset + (with_render ? iohandler_size() : 0), capacity);
+}
+
+void
+ctxpool_deinit(Game_ctx_pool *cp)
+{
+    pool_deinit(&cp->pool);
+}
+
+Game_ctx *
+ctxpool_acquire(Game_ctx_pool *cp)
+{
+    unsigned char *slot = pool_get(&cp->pool);
+    Game_ctx *ctx = (Game_ctx *) slot;
+
+    if (!slot)
+        return NULL;
+    ctx->game = (Game *) (slot + cp->game_offset);
+    ctx->ai = (Opponent_ai *) (slot + cp->ai_offset);
+    ctx->io = cp->with_render ? (Io_handler *) (slot + cp->io_offset) : NULL;
+    return ctx;
+}
+
+void
+ctxpool_release(Game_ctx_pool *cp, Game_ctx *ctx)
+{
+    pool_put(&cp->pool, ctx);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file gamectx.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_GAMECTX_H
+#define XTETRIS_GAMECTX_H
+
+#include <stddef.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "iohandler.h"
+#include "util.h"
+
+/**
+ * Everything needed to host one game, carved from a single cache-aligned pool slot: the game state, the AI state
+ * with its search scratch space, and optionally a render buffer.  
+ * The objects are *not* initialized by `ctxpool_acquire`: use `game_init`, `ai_init` and `iohandler_init`.
+ */
+typedef struct Game_ctx {
+    Game *game;
+    Opponent_ai *ai;
+    /** NULL if the pool was created without render buffers. */
+    Io_handler *io;
+} Game_ctx;
+
+/**
+ * Pool of game contexts, allocated once up front; acquiring and releasing contexts never touches the heap.
+ * Not thread-safe: with several threads, use one pool per thread or acquire every context beforehand.
+ */
+typedef struct Game_ctx_pool {
+    Pool pool;
+    /** Offsets of each object from the start of a slot, each a multiple of `CACHE_LINE`. */
+    size_t game_offset, ai_offset, io_offset;
+    int with_render;
+} Game_ctx_pool;
+
+/**
+ * Allocate room for `capacity` contexts, with render buffers if `with_render` is nonzero. Exits on failure.
+ * @param ai_bytes room for the AI of each context: at least `ai_size` of every configuration it is initialized with.
+ */
+void ctxpool_init(Game_ctx_pool *, size_t capacity, int with_render, size_t ai_bytes);
+/**
+ * Free the memory of every context, acquired or not.
+ */
+void ctxpool_deinit(Game_ctx_pool *);
+/**
+ * @returns an unused context, or NULL if all of them are in use.
+ */
+Game_ctx * ctxpool_acquire(Game_ctx_pool *);
+/**
+ * Give back a context obtained from `ctxpool_acquire` on the same pool.
+ */
+void ctxpool_release(Game_ctx_pool *, Game_ctx *);
+#endif /* ifndef XTETRIS_GAMECTX_H */
@@ -6,16 +6,25 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "util.h"
 
 #include "iohandler.h"
 
-#define SCREEN_LINES 17
-#define SCREEN_COLUMNS_1P 54
-#define SCREEN_COLUMNS_2P 78
+/** The panel between the two boards, with the scores, messages and pieces left. */
+#define PANEL_LINES 15
+#define PANEL_WIDTH 33
+/** A board with its borders, and where the panel starts after it. */
+#define FIELD_WIDTH (2 * BOARD_COLS + 2)
+#define PANEL_COL FIELD_WIDTH
+#define SCREEN_LINES ((BOARD_ROWS > PANEL_LINES ? BOARD_ROWS : PANEL_LINES) + 2)
+/* without the right border of the panel in single player; both include the terminator */
+#define SCREEN_COLUMNS_1P (FIELD_WIDTH + PANEL_WIDTH - 1)
+#define SCREEN_COLUMNS_2P (2 * FIELD_WIDTH + PANEL_WIDTH + 1)
 #define MSG_LENGTH 25
 #define INPUT_BUF_LEN 32
+#define BATCH_CHUNK_LEN 16384
 
 #define KEY_LEFT   'h'
 #define KEY_RIGHT  'l'
@@ -30,36 +39,50 @@
 #define KEY_Z  'z'
 #define KEY_O  'o'
 
+/** Decoder table entry for characters that separate actions; no action has this value. */
+#define DECODE_SKIP 1
+
 #define CHARUPPER(c) ((c) - 'a' + 'A')
 #define STR_EXPAND(a) #a
 #define STRINGIFY(a) STR_EXPAND(a)
 
 struct Io_handler {
-    char **screen;
+    /** Screen contents, one NUL-terminated line per row (narrower than the array in single player). */
+    char screen[SCREEN_LINES][SCREEN_COLUMNS_2P];
     char input_buf[INPUT_BUF_LEN];
     unsigned input_i;
+    /** Set once standard input has reached end of file (or failed). */
+    int input_ended;
+    /** Action for each input character in each game state: an action, `DECODE_SKIP`, or `Game_action_Queue_empty`
+        for characters that mean nothing in that state. */
+    unsigned char decode[Game_state_Cleared + 1][UCHAR_MAX + 1];
+    /** Batch mode input, read from standard input in chunks; the unread part is `chunk[chunk_pos..chunk_len)`. */
+    unsigned char chunk[BATCH_CHUNK_LEN];
+    size_t chunk_len, chunk_pos;
 };
 
-static void update_screen_1p(char **, Game const *);
-
-static const char screen_init_state[SCREEN_LINES][SCREEN_COLUMNS_2P] = {
-    "+--------------------+                                 +--------------------+",
-    "|                    |     =*= X - T E T R I S =*=     |                    |",
-    "|                    |                                 |                    |",
-    "|                    |          score:   000           |                    |",
-    "|                    |     P1: 000         P2: 000     |                    |",
-    "|                    |   ...........................   |                    |",
-    "|                    |  ' x x x x x x x x x x x x x '  |                    |",
-    "|                    |  '  x x x x x x x x x x x x  '  |                    |",
-    "|                    |  '...........................'  |                    |",
-    "|                    |                             \\   |                    |",
-    "|                    |                                 |                    |",
-    "|                    |  I x00   T x00   J x00   L x00  |                    |",
-    "|                    |    < >     < >     < >     < >  |                    |",
-    "|                    |                                 |                    |",
-    "|                    |       S x00   Z x00   O x00     |                    |",
-    "|                    |         < >     < >     < >     |                    |",
-    "+--------------------+                                 +--------------------+",
+static void update_screen_1p(char (*)[SCREEN_COLUMNS_2P], Game const *);
+static void update_screen_2p(char (*)[SCREEN_COLUMNS_2P], Game const *);
+static void init_decoder(unsigned char (*)[UCHAR_MAX + 1]);
+static void decode_key(unsigned char *, int, enum Game_action);
+static void init_field(char *, int);
+
+static const char panel_init_state[PANEL_LINES][PANEL_WIDTH + 1] = {
+    "     =*= X - T E T R I S =*=     ",
+    "                                 ",
+    "          score:   000           ",
+    "     P1: 000         P2: 000     ",
+    "   ...........................   ",
+    "  ' x x x x x x x x x x x x x '  ",
+    "  '  x x x x x x x x x x x x  '  ",
+    "  '...........................'  ",
+    "                             \\   ",
+    "                                 ",
+    "  I x00   T x00   J x00   L x00  ",
+    "    < >     < >     < >     < >  ",
+    "                                 ",
+    "       S x00   Z x00   O x00     ",
+    "         < >     < >     < >     ",
 };
 
 static char const block_types[][2] = {
@@ -114,42 +137,62 @@ enum Updatable_field {
     fld_key_o
 };
 
+/** Line and column of each field: the boards at the top left of their borders, the rest within the panel. */
 static int const field_coords[][2] = {
-    /* fld_playing_field1 -> */ { 1,  1},
-    /* fld_playing_field2 -> */ { 1, 56},
-    /* fld_mid_score      -> */ { 3, 41},
-    /* fld_p1_score       -> */ { 4, 31},
-    /* fld_p2_score       -> */ { 4, 47},
-    /* fld_message_bubble -> */ { 6, 26},
-    /* fld_count_i        -> */ {11, 27},
-    /* fld_count_t        -> */ {11, 35},
-    /* fld_count_j        -> */ {11, 43},
-    /* fld_count_l        -> */ {11, 51},
-    /* fld_count_s        -> */ {14, 32},
-    /* fld_count_z        -> */ {14, 40},
-    /* fld_count_o        -> */ {14, 48},
-    /* fld_key_i          -> */ {12, 26},
-    /* fld_key_t          -> */ {12, 34},
-    /* fld_key_j          -> */ {12, 42},
-    /* fld_key_l          -> */ {12, 50},
-    /* fld_key_s          -> */ {15, 31},
-    /* fld_key_z          -> */ {15, 39},
-    /* fld_key_o          -> */ {15, 47}
+    /* fld_playing_field1 -> */ { 1, 1},
+    /* fld_playing_field2 -> */ { 1, PANEL_COL + PANEL_WIDTH + 1},
+    /* fld_mid_score      -> */ { 3, PANEL_COL + 19},
+    /* fld_p1_score       -> */ { 4, PANEL_COL +  9},
+    /* fld_p2_score       -> */ { 4, PANEL_COL + 25},
+    /* fld_message_bubble -> */ { 6, PANEL_COL +  4},
+    /* fld_count_i        -> */ {11, PANEL_COL +  5},
+    /* fld_count_t        -> */ {11, PANEL_COL + 13},
+    /* fld_count_j        -> */ {11, PANEL_COL + 21},
+    /* fld_count_l        -> */ {11, PANEL_COL + 29},
+    /* fld_count_s        -> */ {14, PANEL_COL + 10},
+    /* fld_count_z        -> */ {14, PANEL_COL + 18},
+    /* fld_count_o        -> */ {14, PANEL_COL + 26},
+    /* fld_key_i          -> */ {12, PANEL_COL +  4},
+    /* fld_key_t          -> */ {12, PANEL_COL + 12},
+    /* fld_key_j          -> */ {12, PANEL_COL + 20},
+    /* fld_key_l          -> */ {12, PANEL_COL + 28},
+    /* fld_key_s          -> */ {15, PANEL_COL +  9},
+    /* fld_key_z          -> */ {15, PANEL_COL + 17},
+    /* fld_key_o          -> */ {15, PANEL_COL + 25}
 };
 
 static char const key_hints[7] = { KEY_I, KEY_T, KEY_J, KEY_L, KEY_S, KEY_Z, KEY_O };
 
 Io_handler *
 iohandler_create(int multiplayer)
+{
+    Io_handler *ioh = iohandler_init(malloc_or_die(iohandler_size()), multiplayer);
+
+    setvbuf(stdout, NULL, _IOFBF, 4096);
+    return ioh;
+}
+
+size_t
+iohandler_size(void)
+{
+    return sizeof (Io_handler);
+}
+
+Io_handler *
+iohandler_init(void *mem, int multiplayer)
 {
     int i, scr_cols;
 
-    Io_handler *ioh = malloc_or_die(sizeof(Io_handler));
+    Io_handler *ioh = mem;
 
     scr_cols = multiplayer ? SCREEN_COLUMNS_2P : SCREEN_COLUMNS_1P;
-    ioh->screen = alloc_many_or_die(SCREEN_LINES, scr_cols);
     for (i = 0; i < SCREEN_LINES; ++i) {
-        memcpy(ioh->screen[i], screen_init_state[i], scr_cols);
+        init_field(ioh->screen[i], i);
+        if (i >= 1 && i <= PANEL_LINES)
+            memcpy(&ioh->screen[i][PANEL_COL], panel_init_state[i-1], PANEL_WIDTH);
+        else
+            memset(&ioh->screen[i][PANEL_COL], ' ', PANEL_WIDTH);
+        init_field(&ioh->screen[i][PANEL_COL + PANEL_WIDTH], i);
         ioh->screen[i][scr_cols-1] = 0;
     }
 
@@ -161,19 +204,74 @@ iohandler_create(int multiplayer)
 
     ioh->input_i = 0;
     ioh->input_buf[0] = 0;
+    ioh->input_ended = 0;
+    ioh->chunk_len = ioh->chunk_pos = 0;
+    init_decoder(ioh->decode);
 
-    setvbuf(stdout, NULL, _IOFBF, 4096);
     return ioh;
 }
 
+/**
+ * Draw one screen line of an empty board and its borders, `FIELD_WIDTH` characters; below the board (when the panel
+ * is taller), the line is blank.
+ */
+void
+init_field(char *s, int line)
+{
+    if (line == 0 || line == BOARD_ROWS + 1) {
+        s[0] = s[FIELD_WIDTH - 1] = '+';
+        memset(s + 1, '-', FIELD_WIDTH - 2);
+    } else if (line <= BOARD_ROWS) {
+        s[0] = s[FIELD_WIDTH - 1] = '|';
+        memset(s + 1, ' ', FIELD_WIDTH - 2);
+    } else {
+        memset(s, ' ', FIELD_WIDTH);
+    }
+}
+
+/**
+ * Map a key to an action, in both lower and upper case.
+ */
+void
+decode_key(unsigned char *row, int key, enum Game_action act)
+{
+    row[key] = row[CHARUPPER(key)] = (unsigned char) act;
+}
+
+/**
+ * Fill in the table used by both the interactive and the batch mode to turn input characters into actions.
+ */
+void
+init_decoder(unsigned char (*decode)[UCHAR_MAX + 1])
+{
+    int state;
+
+    memset(decode, Game_action_Queue_empty, (Game_state_Cleared + 1) * sizeof *decode);
+    for (state = Game_state_Choose; state <= Game_state_Cleared; ++state) {
+        decode[state][' '] = decode[state]['\t'] = decode[state]['\r'] = decode[state]['\n'] = DECODE_SKIP;
+    }
+
+    decode_key(decode[Game_state_Choose], KEY_I, Game_action_Choose_I);
+    decode_key(decode[Game_state_Choose], KEY_T, Game_action_Choose_T);
+    decode_key(decode[Game_state_Choose], KEY_J, Game_action_Choose_J);
+    decode_key(decode[Game_state_Choose], KEY_L, Game_action_Choose_L);
+    decode_key(decode[Game_state_Choose], KEY_S, Game_action_Choose_S);
+    decode_key(decode[Game_state_Choose], KEY_Z, Game_action_Choose_Z);
+    decode_key(decode[Game_state_Choose], KEY_O, Game_action_Choose_O);
+
+    decode_key(decode[Game_state_Place], KEY_LEFT, Game_action_Left);
+    decode_key(decode[Game_state_Place], KEY_RIGHT, Game_action_Right);
+    decode_key(decode[Game_state_Place], KEY_ROTATE, Game_action_Rotate);
+    decode_key(decode[Game_state_Place], KEY_DROP, Game_action_Drop);
+
+    /* any key, or just <enter>, continues after clearing lines (only spaces are skipped) */
+    memset(decode[Game_state_Cleared], Game_action_Finish_clearing, sizeof decode[Game_state_Cleared]);
+    decode[Game_state_Cleared][' '] = decode[Game_state_Cleared]['\t'] = DECODE_SKIP;
+}
+
 void
 iohandler_destroy(Io_handler *ioh)
 {
-    int i;
-    for (i = 0; i < SCREEN_LINES; ++i)
-        free(ioh->screen[i]);
-    free(ioh->screen);
-    
     free(ioh);
 }
 
@@ -181,7 +279,7 @@ iohandler_destroy(Io_handler *ioh)
  * Update every field on the screen to reflect the game state. 
  */
 void
-update_screen_1p(char **scr, Game const *game)
+update_screen_1p(char (*scr)[SCREEN_COLUMNS_2P], Game const *game)
 {
     int line, col, i;
     char buf[32];
@@ -243,7 +341,7 @@ update_screen_1p(char **scr, Game const *game)
     }
 
     { /* update piece counts */
-        for (i = 0; i <= 7; ++i) {
+        for (i = 0; i < 7; ++i) {
             line = field_coords[fld_count_i + i][0];
             col = field_coords[fld_count_i + i][1];
             sprintf(buf, "%-2hu", (unsigned short)game->pieces_left[i]);
@@ -266,7 +364,8 @@ update_screen_1p(char **scr, Game const *game)
 }
 
 void
-update_screen_2p(char **scr, Game const *game) {
+update_screen_2p(char (*scr)[SCREEN_COLUMNS_2P], Game const *game)
+{
     int line, col, i;
     char buf[32];
     { /* update both boards */
@@ -347,7 +446,7 @@ update_screen_2p(char **scr, Game const *game) {
     }
 
     { /* update piece counts */
-        for (i = 0; i <= 7; ++i) {
+        for (i = 0; i < 7; ++i) {
             line = field_coords[fld_count_i + i][0];
             col = field_coords[fld_count_i + i][1];
             sprintf(buf, "%-2hu", (unsigned short)game->pieces_left[i]);
@@ -369,11 +468,8 @@ update_screen_2p(char **scr, Game const *game) {
 }
 
 void
-iohandler_draw_and_read(Io_handler *ioh, Game const *game)
+iohandler_draw(Io_handler *ioh, Game const *game)
 {
-    /* Update the screen, display it, and print the prompt.  
-       Due to the "asyncronous" nature of this style of interaction, we can immediately read and store the input
-       to be processed later by the other function. */
     int i;
 
     if (game->kind == Game_kind_Singleplayer)
@@ -385,76 +481,91 @@ iohandler_draw_and_read(Io_handler *ioh, Game const *game)
     for (i = 0; i < SCREEN_LINES; ++i) {
         puts(ioh->screen[i]);
     }
+}
 
+void
+iohandler_prompt(Io_handler *ioh, Game const *game)
+{
+    (void) ioh;
     if (game->kind == Game_kind_Vs_player)
         fputs(game->current_player == 0 ? "## PLAYER 1 ## " : "## PLAYER 2 ## ", stdout);
-
     fputs(prompts[game->state-1], stdout);
+}
+
+void
+iohandler_draw_and_read(Io_handler *ioh, Game const *game)
+{
+    /* Update the screen, display it, and print the prompt.  
+       Due to the "asyncronous" nature of this style of interaction, we can immediately read and store the input
+       to be processed later by the other function. */
+    int i, c = 0;
+
+    iohandler_draw(ioh, game);
+    iohandler_prompt(ioh, game);
     fflush(stdout);
     ioh->input_i = 0;
 
-    /*  scanf("%31[^\n]", ioh->input_buf);
-        if (strlen(ioh->input_buf) != INPUT_BUF_LEN-1)
-           scanf("%*[^\n]");
-    */
     /* keep reading until newline but at most INPUT_BUF_LEN chars; throw out whatever is left */
     for (i = 0; i < INPUT_BUF_LEN-1; ++i) {
-        if ((ioh->input_buf[i] = getchar()) == '\n')
+        if ((c = getchar()) == '\n' || c == EOF)
             break;
+        ioh->input_buf[i] = (char) c;
     } 
     if (i == INPUT_BUF_LEN-1) {
-        while (getchar() != '\n') /* discard */;
+        while ((c = getchar()) != '\n' && c != EOF) /* discard */;
     } 
     ioh->input_buf[i] = 0;
+    if (c == EOF)
+        ioh->input_ended = 1;
 }
 
 enum Game_action
 iohandler_next_action_1p(Io_handler *ioh, Game const *game)
 {
-    char c;
-    
+    unsigned char c, act;
+
+    /* never step past the terminator, which is decoded like <enter> */
     do {
-        c = ioh->input_buf[ioh->input_i++];
-    } while (c == ' '); /* no buf overflow: will reach '\0' eventually */ 
-
-    switch (game->state) {
-    case Game_state_Choose:
-        switch (c) {
-        case KEY_I: case CHARUPPER(KEY_I):
-            return Game_action_Choose_I;
-        case KEY_T: case CHARUPPER(KEY_T):
-            return Game_action_Choose_T;
-        case KEY_J: case CHARUPPER(KEY_J):
-            return Game_action_Choose_J;
-        case KEY_L: case CHARUPPER(KEY_L):
-            return Game_action_Choose_L;
-        case KEY_S: case CHARUPPER(KEY_S):
-            return Game_action_Choose_S;
-        case KEY_Z: case CHARUPPER(KEY_Z):
-            return Game_action_Choose_Z;
-        case KEY_O: case CHARUPPER(KEY_O):
-            return Game_action_Choose_O;
-        }
-        break;
-    case Game_state_Place:
-        switch (c) {
-        case   KEY_LEFT: case   CHARUPPER(KEY_LEFT):
-            return Game_action_Left;
-        case  KEY_RIGHT: case  CHARUPPER(KEY_RIGHT):
-            return Game_action_Right;
-        case KEY_ROTATE: case CHARUPPER(KEY_ROTATE):
-            return Game_action_Rotate;
-        case   KEY_DROP: case   CHARUPPER(KEY_DROP):
-            return Game_action_Drop;
+        c = (unsigned char) ioh->input_buf[ioh->input_i];
+        if (c)
+            ++ioh->input_i;
+        act = ioh->decode[game->state][c];
+    } while (act == DECODE_SKIP);
+
+    return (enum Game_action) act;
+}
+
+enum Game_action
+iohandler_decode(Io_handler const *ioh, Game const *game, unsigned char key)
+{
+    unsigned char const act = ioh->decode[game->state][key];
+    return act == DECODE_SKIP ? Game_action_Queue_empty : (enum Game_action) act;
+}
+
+enum Game_action
+iohandler_next_action_batch(Io_handler *ioh, Game const *game)
+{
+    unsigned char const *row = ioh->decode[game->state];
+    unsigned char act;
+
+    for (;;) {
+        while (ioh->chunk_pos < ioh->chunk_len) {
+            act = row[ioh->chunk[ioh->chunk_pos++]];
+            /* characters that mean nothing in this state are skipped, like separators */
+            if (act != DECODE_SKIP && act != Game_action_Queue_empty)
+                return (enum Game_action) act;
         }
-        break;
-    case Game_state_Cleared:
-        return Game_action_Finish_clearing;
-    case Game_state_Lose:
-    case Game_state_Win:
-        break;
-    /* exhaustive */
+        if (ioh->input_ended)
+            return Game_action_Queue_empty;
+        ioh->chunk_pos = 0;
+        ioh->chunk_len = fread(ioh->chunk, 1, sizeof ioh->chunk, stdin);
+        if (ioh->chunk_len < sizeof ioh->chunk)
+            ioh->input_ended = 1;
     }
+}
 
-    return Game_action_Queue_empty;
+int
+iohandler_input_ended(Io_handler const *ioh)
+{
+    return ioh->input_ended;
 }
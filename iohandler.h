@@ -6,6 +6,8 @@
 #ifndef XTETRIS_IOHANDLER_H
 #define XTETRIS_IOHANDLER_H
 
+#include <stddef.h>
+
 #include "tetris.h"
 
 typedef struct Io_handler Io_handler;
@@ -16,6 +18,16 @@ typedef struct Io_handler Io_handler;
  * @returns a pointer to a valid instance of Io_handler.
  */
 Io_handler * iohandler_create(int);
+/**
+ * @returns the size of the memory needed by `iohandler_init`.
+ */
+size_t iohandler_size(void);
+/**
+ * Initialize an Io_handler in caller-provided memory of at least `iohandler_size()` bytes, without allocating
+ * anything and without touching the standard streams; there is nothing to clean up when done with it.
+ * @returns `mem`, as an initialized Io_handler.
+ */
+Io_handler * iohandler_init(void *mem, int);
 /**
  * Deinitialize and deallocate an Io_handler, which must have been initialized by `iohandler_create`.  
  */
@@ -30,7 +42,36 @@ void iohandler_destroy(Io_handler *);
 enum Game_action iohandler_next_action_1p(Io_handler *, Game const *);
 
 /**
- * Given a game state prepared for drawing, update the visual representation of the board; 
+ * Batch mode counterpart of `iohandler_next_action_1p`, for input coming from a file or a pipe: standard input is
+ * read in large chunks and decoded with no line structure, skipping anything that is not an action in the current
+ * state, so that the caller can apply actions back to back and only draw once in a while.
+ * @returns the next action, or `Game_action_Queue_empty` once the input is over.
+ */
+enum Game_action iohandler_next_action_batch(Io_handler *, Game const *);
+
+/**
+ * Real-time counterpart of `iohandler_next_action_1p`, for keys read by the caller: decode a single key.
+ * @returns the action for `key` in the current state, or `Game_action_Queue_empty` if it means nothing there.
+ */
+enum Game_action iohandler_decode(Io_handler const *, Game const *, unsigned char key);
+
+/**
+ * @returns whether standard input has reached its end, i.e. no more actions will ever come.
+ */
+int iohandler_input_ended(Io_handler const *);
+
+/**
+ * Given a game state prepared for drawing, update the visual representation of the board and print it.
+ */
+void iohandler_draw(Io_handler *, Game const *);
+
+/**
+ * Print the prompt for the current state (and, with two players, whose turn it is), without reading anything.
+ */
+void iohandler_prompt(Io_handler *, Game const *);
+
+/**
+ * Like `iohandler_draw`, then prompt for and read one line of input;
  * reset the input handler state, since inputs cannot be carried over from a previous game loop iteration.
  */
 void iohandler_draw_and_read(Io_handler *, Game const *);
@@ -0,0 +1,412 @@
+/**
+ * @file main.c
+ * @author Maksim Kovalkov
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "constants.h"
+#include "tetris.h"
+#include "xtetris.h"
+#include "iohandler.h"
+#include "opponentai.h"
+#include "gamectx.h"
+#include "realtime.h"
+#include "terminal.h"
+#include "spectate.h"
+#include "book.h"
+
+/** Keys read between two ticks at most; more wait for the next tick. */
+#define RT_KEYS_LEN 64
+/** Ticks for which cleared lines stay on screen in real-time mode, unless a key is pressed. */
+#define RT_CLEAR_TICKS 30
+
+/* ------ Function prototypes ------ */
+
+static void draw(Game *, Io_handler *, int);
+static void atexit_fn(void);
+static int run_menu(char const * const *, int);
+static void game_loop(Game *, Io_handler *, Opponent_ai *);
+static void batch_loop(Game *, Io_handler *, Opponent_ai *, unsigned long);
+static void keystroke_loop(Game *, Io_handler *, Opponent_ai *);
+static void refall(Game *, int);
+static void realtime_loop(Game *, Io_handler *, Opponent_ai *, double);
+
+/* ------ Static data ------ */
+
+/** The game being played, with its AI and render buffer, in a pool of just one context. */
+Game_ctx_pool g_ctx_pool;
+Game_ctx *g_ctx = NULL;
+/** Broadcast to spectators, if `ring` is set (option `-S`). */
+Spectate_writer g_spectate;
+/** Opening book of the AI, if `entries` is set (option `-B`). */
+Book g_book;
+
+
+/* ------ Functions ------ */
+
+/**
+ * Prepare the game state for drawing (possibly breaking invariants assumed elsewhere in the game logic!),
+ * send the state to the I/O function for display (reading a line of input too if `read_input`), then restore
+ * everything to its original value. Whatever is drawn is also broadcast to spectators, before any of that.
+ */
+void
+draw(Game *game, Io_handler *io_handler, int read_input)
+{
+    Piece ghost;
+
+    if (g_spectate.ring)
+        spectate_publish(&g_spectate, game);
+
+    /* prepare board state */
+    if (game->state == Game_state_Place) {
+        memcpy(&ghost, &game->active_piece, sizeof ghost);
+        drop_piece(&ghost, game->board[game->current_player]);
+        if (ghost.y - game->active_piece.y >= 3)
+            place_piece(&game->active_piece, game->board[game->current_player], game->active_piece.type);
+        place_piece(&ghost, game->board[game->current_player], Block_type_Ghost);
+    } else if (game->state == Game_state_Lose) {
+        place_piece(&game->active_piece, game->board[game->current_player], Block_type_Badbk);
+    }
+
+    if (read_input)
+        iohandler_draw_and_read(io_handler, game);
+    else
+        iohandler_draw(io_handler, game);
+
+    /* done drawing */
+    fflush(stdout);
+
+    /* clean up board state */
+    if (game->state == Game_state_Place) {
+        place_piece(&game->active_piece, game->board[game->current_player], Block_type_Empty);
+        place_piece(&ghost, game->board[game->current_player], Block_type_Empty);
+    }
+}
+
+/**
+ * Run the game: keep executing the game loop until the game ends.
+ */
+void
+game_loop(Game *game, Io_handler *io_handler, Opponent_ai *opp_ai)
+{
+    /* draw, then handle as many actions as we can */
+    for (;;) {
+        draw(game, io_handler, 1);
+
+        if (game->state == Game_state_Win || game->state == Game_state_Lose)
+            break;
+
+        while (xtetris_step(game, iohandler_next_action_1p(io_handler, game))) /* nop */;
+
+        if (game->kind == Game_kind_Vs_ai && game->current_player == 1)
+            while (xtetris_step(game, xtetris_ai_decide(opp_ai, game))) /* nop */;
+
+        if (iohandler_input_ended(io_handler)) {
+            putchar('\n');
+            break;
+        }
+    }
+}
+
+/**
+ * Run the game from a script: apply the actions read from the input back to back, until the game or the input ends.
+ * The screen is drawn every `render_every` pieces placed (never, if 0), and once at the end.
+ */
+void
+batch_loop(Game *game, Io_handler *io_handler, Opponent_ai *opp_ai, unsigned long render_every)
+{
+    enum Game_action act;
+    unsigned long moves = 0;
+
+    while (game->state != Game_state_Win && game->state != Game_state_Lose) {
+        act = iohandler_next_action_batch(io_handler, game);
+        if (act == Game_action_Queue_empty)
+            break;
+        if (xtetris_step(game, act))
+            continue;
+
+        /* end of the player's turn, same as the end of an input line in the interactive loop */
+        if (game->kind == Game_kind_Vs_ai && game->current_player == 1)
+            while (xtetris_step(game, xtetris_ai_decide(opp_ai, game))) /* nop */;
+
+        /* spectators see every turn, drawn or not */
+        if (g_spectate.ring)
+            spectate_publish(&g_spectate, game);
+        if (act == Game_action_Drop && render_every && ++moves % render_every == 0)
+            draw(game, io_handler, 0);
+    }
+    draw(game, io_handler, 0);
+}
+
+/**
+ * Run the game one key at a time (normally with the terminal in raw mode, see terminal.h): every key that means
+ * something in the current state is applied as soon as it is read, and the screen is drawn again right away.
+ */
+void
+keystroke_loop(Game *game, Io_handler *io_handler, Opponent_ai *opp_ai)
+{
+    for (;;) {
+        enum Game_action act = Game_action_Queue_empty;
+        int c;
+
+        draw(game, io_handler, 0);
+        iohandler_prompt(io_handler, game);
+        fflush(stdout);
+        if (game->state == Game_state_Win || game->state == Game_state_Lose)
+            break;
+
+        /* skip keys that mean nothing in this state, without redrawing */
+        do {
+            if ((c = getchar()) == EOF)
+                break;
+            act = iohandler_decode(io_handler, game, (unsigned char) c);
+        } while (act == Game_action_Queue_empty);
+        if (c == EOF)
+            break;
+        xtetris_step(game, act);
+
+        if (game->kind == Game_kind_Vs_ai && game->current_player == 1 && game->state == Game_state_Choose)
+            while (xtetris_step(game, xtetris_ai_decide(opp_ai, game))) /* nop */;
+    }
+    putchar('\n');
+}
+
+/**
+ * Move the active piece back down by up to `rows` rows: rotating lifts it to the top, which in real-time mode would
+ * undo the fall so far.
+ */
+void
+refall(Game *game, int rows)
+{
+    for (; rows > 0; --rows) {
+        ++game->active_piece.y;
+        if (collides(&game->active_piece, game->board[game->current_player])) {
+            --game->active_piece.y;
+            return;
+        }
+    }
+}
+
+/**
+ * Run the game in real time: the piece being placed falls on its own, faster as the gravity level rises over time,
+ * and the keys typed between two ticks are applied at the start of the next one. Cleared lines stay on screen for
+ * `RT_CLEAR_TICKS` ticks, or until a key is pressed. The screen is drawn whenever something changed, and the
+ * scheduler's instrumentation is printed to `stderr` at the end, including the ticks that went over `budget_ms`.
+ */
+void
+realtime_loop(Game *game, Io_handler *io_handler, Opponent_ai *opp_ai, double budget_ms)
+{
+    Rt_scheduler rt;
+    unsigned char keys[RT_KEYS_LEN];
+    int level = -1, fall = 0, fallen = 0, cleared_ticks = 0, dirty = 1;
+    unsigned long ai_overruns = 0;
+
+    rt_init(&rt, RT_TICK_MS, budget_ms);
+    while (game->state != Game_state_Win && game->state != Game_state_Lose && !rt.input_ended) {
+        size_t const n = rt_wait(&rt, keys, sizeof keys);
+        int const new_level = rt_level(rt_elapsed_ms(&rt));
+        int ai_moved = 0;
+        size_t i;
+
+        for (i = 0; i < n; ++i) {
+            enum Game_action const act = iohandler_decode(io_handler, game, keys[i]);
+            int const y = game->active_piece.y;
+            int more;
+            if (act == Game_action_Queue_empty)
+                continue;
+            more = xtetris_step(game, act);
+            dirty = 1;
+            if (act == Game_action_Rotate && game->active_piece.y != y)
+                refall(game, fallen);
+            /* as at the end of an input line: the rest was meant for the turn that just ended */
+            if (!more)
+                break;
+        }
+
+        if (game->state == Game_state_Place && ++fall >= rt_ticks_per_row(new_level)) {
+            fall = 0;
+            fallen += game_gravity(game);
+            dirty = 1;
+        }
+        if (game->state == Game_state_Cleared && ++cleared_ticks >= RT_CLEAR_TICKS) {
+            xtetris_step(game, Game_action_Finish_clearing);
+            dirty = 1;
+        }
+        if (game->state != Game_state_Place)
+            fall = fallen = 0;
+        if (game->state != Game_state_Cleared)
+            cleared_ticks = 0;
+
+        if (game->kind == Game_kind_Vs_ai && game->current_player == 1 && game->state == Game_state_Choose) {
+            while (xtetris_step(game, xtetris_ai_decide(opp_ai, game))) /* nop */;
+            ai_moved = dirty = 1;
+        }
+
+        if (new_level != level) {
+            level = new_level;
+            dirty = 1;
+        }
+        if (dirty) {
+            draw(game, io_handler, 0);
+            printf("[level %2d] ", level + 1);
+            iohandler_prompt(io_handler, game);
+            fflush(stdout);
+            dirty = 0;
+        }
+        if (rt_end_tick(&rt) && ai_moved)
+            ++ai_overruns;
+    }
+    draw(game, io_handler, 0);
+    putchar('\n');
+    fflush(stdout);
+    rt_report(&rt, stderr);
+    fprintf(stderr, "real-time: %lu of the ticks over budget made an AI move\n", ai_overruns);
+}
+
+void
+atexit_fn()
+{
+    terminal_restore();
+    if (g_spectate.ring)
+        spectate_close(&g_spectate);
+    if (g_book.entries)
+        book_unmap(&g_book);
+    if (g_ctx) {
+        ctxpool_release(&g_ctx_pool, g_ctx);
+        ctxpool_deinit(&g_ctx_pool);
+    }
+}
+
+int
+run_menu(char const * const *entries, int entries_n)
+{
+    int i, ans, n;
+
+    for (;;) {
+        for (i = 0; i < entries_n; ++i) {
+            printf("%d.  %s\n", i+1, entries[i]);
+        }
+        if (1 == (n = scanf("%d%*1[\n]", &ans))
+            && (--ans, 0 <= ans && ans < entries_n))
+            break;
+        if (n == EOF)
+            return -1;
+
+        scanf("%*[^\n]%*1[\n]"); /* discard until end of line */       
+    }
+
+    return ans;
+}
+
+/**
+ * Main function.
+ * Usage: `x-tetris [-s SEED] [-w AI_CONFIG] [-B BOOK] [-k] [-S SPECTATE_PATH] [-b RENDER_EVERY | -r BUDGET_MS]`.  
+ * Without an explicit seed, the current time is used; `AI_CONFIG` is a file in the format of `ai_config_load`.  
+ * `-B` has the AI play its opening moves from an opening book made by x-tetris-book (see book.h).  
+ * `-b` selects batch mode, for scripted input from a file or a pipe: the menu choice is read as usual, then the rest
+ * of the input is played without prompts, drawing the screen every `RENDER_EVERY` pieces (0: only at the end).  
+ * `-r` selects the real-time mode, where pieces fall on their own; ticks whose work takes longer than `BUDGET_MS`
+ * milliseconds are reported at the end.  
+ * `-k` acts on every key as soon as it is pressed, instead of once per line, with the terminal in raw mode where
+ * the platform allows it; it also applies to the real-time mode.  
+ * `-S` broadcasts the game to spectators through the file `SPECTATE_PATH` (see spectate.h and x-tetris-spectator).
+ */
+int
+main(int argc, char **argv)
+{
+    char const * const menu_items[] = {
+        "Single player",
+        "Multiplayer -- two players",
+        "Multiplayer -- vs. AI"
+    };
+    int choice, i, batch = 0, realtime = 0, keystroke = 0;
+    unsigned long seed = (unsigned long) time(NULL), render_every = 0;
+    double budget_ms = 0;
+    char const *spectate_path = NULL;
+    Book const *book = NULL;
+    Xtetris_config game_config;
+    Ai_config ai_config;
+
+    ai_config_default(&ai_config);
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            if (ai_config_load(&ai_config, argv[++i]) != 0) {
+                fprintf(stderr, "cannot load AI configuration from %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+            if (book_map(&g_book, argv[++i]) != 0) {
+                fprintf(stderr, "cannot load an opening book from %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            book = &g_book;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batch = 1;
+            render_every = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            keystroke = 1;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            realtime = 1;
+            budget_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            spectate_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-s SEED] [-w AI_CONFIG] [-B BOOK] [-k] [-S SPECTATE_PATH]"
+                    " [-b RENDER_EVERY | -r BUDGET_MS]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (realtime && !rt_supported()) {
+        fputs("the real-time mode is not available on this platform\n", stderr);
+        return EXIT_FAILURE;
+    }
+    if (spectate_path && (!spectate_supported() || spectate_open(&g_spectate, spectate_path) != 0)) {
+        fprintf(stderr, "cannot broadcast to %s\n", spectate_path);
+        return EXIT_FAILURE;
+    }
+
+    puts(
+        " _       _____  ____ _____  ___   _   __ \n"
+        "\\ \\_/ __  | |  | |_   | |  | |_) | | ( (`\n"
+        "/_/ \\     |_|  |_|__  |_|  |_| \\ |_| _)_)\n"
+    );
+    puts("Welcome! Choose a game mode:");
+    /* the real-time loop reads the keys from the descriptor: stdio must not buffer any past the menu line */
+    if (realtime)
+        setvbuf(stdin, NULL, _IONBF, 0);
+    if ((choice = run_menu(menu_items, 3)) < 0)
+        return EXIT_FAILURE;
+
+    ctxpool_init(&g_ctx_pool, 1, 1, ai_size(&ai_config));
+    g_ctx = ctxpool_acquire(&g_ctx_pool);
+    game_config.kind = (enum Game_kind) choice;
+    game_config.seed = seed;
+    xtetris_init(g_ctx->game, &game_config);
+    iohandler_init(g_ctx->io, choice != 0);
+    ai_init(g_ctx->ai, &ai_config);
+    if (ai_set_book(g_ctx->ai, book) != 0) {
+        fputs("the opening book was built for another AI configuration\n", stderr);
+        return EXIT_FAILURE;
+    }
+    setvbuf(stdout, NULL, _IOFBF, 4096);
+    atexit(&atexit_fn);
+    /* not a terminal (or no termios): keys still get handled one by one, just as they arrive */
+    if (keystroke && !batch)
+        terminal_raw();
+
+    if (realtime)
+        realtime_loop(g_ctx->game, g_ctx->io, g_ctx->ai, budget_ms);
+    else if (batch)
+        batch_loop(g_ctx->game, g_ctx->io, g_ctx->ai, render_every);
+    else if (keystroke)
+        keystroke_loop(g_ctx->game, g_ctx->io, g_ctx->ai);
+    else
+        game_loop(g_ctx->game, g_ctx->io, g_ctx->ai);
+
+    return EXIT_SUCCESS;
+}
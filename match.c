@@ -0,0 +1,172 @@
+/**
+ * @file match.c
+ * @author Maksim Kovalkov
+ */
+
+#include <string.h>
+
+#include "tetris.h"
+#include "rng.h"
+
+#include "match.h"
+
+static int pool_empty(Match const *);
+static void send_garbage(Match *, int, int);
+
+/**
+ * @returns whether every piece of the pool has been used.
+ */
+int
+pool_empty(Match const *m)
+{
+    int i;
+    for (i = 0; i < 7; ++i)
+        if (m->pool[i])
+            return 0;
+    return 1;
+}
+
+/**
+ * Choose the seat receiving the garbage of `lines` lines cleared by seat `from`, by the rule of the match.
+ */
+void
+send_garbage(Match *m, int from, int lines)
+{
+    int target = -1, i, k;
+
+    if (m->n_playing < 2)
+        return;
+    switch (m->garbage) {
+    case Match_garbage_Next:
+        for (i = 1; target < 0; ++i)
+            if (m->playing[(from + i) % m->n_seats])
+                target = (from + i) % m->n_seats;
+        break;
+    case Match_garbage_Random:
+        k = (int) rng_below(&m->rng, (unsigned long) m->n_playing - 1);
+        for (i = 1; target < 0; ++i)
+            if (m->playing[(from + i) % m->n_seats] && k-- == 0)
+                target = (from + i) % m->n_seats;
+        break;
+    case Match_garbage_Leader:
+        for (i = 1; i < m->n_seats; ++i) {
+            int const s = (from + i) % m->n_seats;
+            if (m->playing[s] && (target < 0 || m->seat[s].score[0] > m->seat[target].score[0]))
+                target = s;
+        }
+        break;
+    }
+    m->garbage_due[target] += lines;
+}
+
+void
+match_init(Match *m, int n_seats, enum Match_garbage garbage, unsigned long seed)
+{
+    int i;
+
+    m->n_seats = n_seats;
+    m->garbage = garbage;
+    memset(m->pool, STARTING_PIECES * n_seats, sizeof m->pool);
+    for (i = 0; i < n_seats; ++i) {
+        game_init(&m->seat[i], Game_kind_Singleplayer, seed + i);
+        memcpy(m->seat[i].pieces_left, m->pool, sizeof m->pool);
+        m->playing[i] = 1;
+        m->moved[i] = 0;
+        m->garbage_due[i] = 0;
+    }
+    m->n_playing = n_seats;
+    m->over = 0;
+    m->rounds = 0;
+    rng_seed(&m->rng, seed);
+}
+
+Game const *
+match_seat(Match const *m, int seat)
+{
+    return &m->seat[seat];
+}
+
+int
+match_to_play(Match const *m, int seat)
+{
+    return !m->over && m->playing[seat] && !m->moved[seat] && !pool_empty(m);
+}
+
+int
+match_play(Match *m, int seat, Match_move const *move)
+{
+    Game *const g = &m->seat[seat];
+    int i, last_x;
+
+    if (!match_to_play(m, seat))
+        return 0;
+    memcpy(g->pieces_left, m->pool, sizeof m->pool);
+    if (move->type < Tetrimino_type_I || move->type > Tetrimino_type_O || !m->pool[move->type - 1])
+        return -1;
+
+    m->moved[seat] = 1;
+    do_game_step(g, (enum Game_action) (Game_action_Choose_I + move->type - Tetrimino_type_I));
+    if (g->state == Game_state_Lose) {
+        /* no room for the piece: the seat is out, and the piece stays in the pool */
+        m->playing[seat] = 0;
+        --m->n_playing;
+        return 0;
+    }
+
+    for (i = 0; i < move->rots; ++i)
+        do_game_step(g, Game_action_Rotate);
+    do {
+        last_x = g->active_piece.x;
+        if (last_x < move->x)
+            do_game_step(g, Game_action_Right);
+        else if (last_x > move->x)
+            do_game_step(g, Game_action_Left);
+    } while (g->active_piece.x != last_x);
+    do_game_step(g, Game_action_Drop);
+
+    if (g->state == Game_state_Cleared) {
+        int const lines = g->lines_cleared;
+        do_game_step(g, Game_action_Finish_clearing);
+        if (lines >= GARBAGE_MIN_LINES)
+            send_garbage(m, seat, lines);
+    }
+    memcpy(m->pool, g->pieces_left, sizeof m->pool);
+    return 0;
+}
+
+int
+match_end_round(Match *m)
+{
+    int i;
+
+    for (i = 0; i < m->n_seats; ++i) {
+        if (m->playing[i] && m->garbage_due[i])
+            add_garbage(m->seat[i].board[0], m->garbage_due[i], &m->rng);
+        m->garbage_due[i] = 0;
+        m->moved[i] = 0;
+    }
+    ++m->rounds;
+    m->over = m->n_playing <= 1 || pool_empty(m);
+    for (i = 0; i < m->n_seats; ++i)
+        if (m->playing[i])
+            memcpy(m->seat[i].pieces_left, m->pool, sizeof m->pool);
+    return !m->over;
+}
+
+int
+match_winner(Match const *m)
+{
+    int best = -1, tie = 0, i;
+
+    for (i = 0; i < m->n_seats; ++i) {
+        if (!m->playing[i])
+            continue;
+        if (best < 0 || m->seat[i].score[0] > m->seat[best].score[0]) {
+            best = i;
+            tie = 0;
+        } else if (m->seat[i].score[0] == m->seat[best].score[0]) {
+            tie = 1;
+        }
+    }
+    return tie ? -1 : best;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file match.h
+ * @author Maksim Kovalkov
+ *
+ * Matches between 2 to `MATCH_SEATS_MAX` players, on one board each, drawing from a shared pool of pieces.
+ *
+ * The match goes in rounds, in which every seat still playing places one piece. All the seats decide from the
+ * position at the start of the round (their own board, and the pool), so the decisions of a round do not depend on
+ * each other and can be computed at the same time. They are then applied in seat order: a seat whose piece was used
+ * up by an earlier seat of the same round decides again, from the pool as it is then. Clearing
+ * `GARBAGE_MIN_LINES` or more lines sends garbage (see `add_garbage`) to another seat chosen by the
+ * `Match_garbage` rule, delivered at the end of the round.
+ *
+ * A seat that cannot place its piece is out of the match. The match ends when the pool is empty, the winner being
+ * the seat with the highest score among those still playing, or when only one seat is left, which wins.
+ *
+ * Each seat is a single player `Game`, which only the match modifies: its board and score are the seat's, its
+ * `pieces_left` the pool at the start of the round. A turn only touches the board of the seat playing it (and that
+ * of the seat receiving garbage), so its cost does not grow with the number of seats.
+ */
+
+#ifndef XTETRIS_MATCH_H
+#define XTETRIS_MATCH_H
+
+#include "tetris.h"
+#include "rng.h"
+
+#define MATCH_SEATS_MAX 8
+
+/** Where garbage goes. */
+enum Match_garbage {
+    /** The next seat still playing, in seat order. */
+    Match_garbage_Next,
+    /** Any other seat still playing, at random. */
+    Match_garbage_Random,
+    /** The other seat still playing with the highest score (the earliest after the sender on ties). */
+    Match_garbage_Leader
+};
+
+/** A decision: the piece, its clockwise rotations, and the column of its 4x4 grid (see `Ai_decision`). */
+typedef struct Match_move {
+    unsigned char type, rots;
+    int x;
+} Match_move;
+
+typedef struct Match {
+    int n_seats;
+    enum Match_garbage garbage;
+    Game seat[MATCH_SEATS_MAX];
+    /** The shared pool, as it is now (the seats see it as it was at the start of the round). */
+    unsigned char pool[7];
+    /** Whether each seat is still playing, and how many are. */
+    unsigned char playing[MATCH_SEATS_MAX];
+    int n_playing;
+    /** Whether each seat has played in the current round. */
+    unsigned char moved[MATCH_SEATS_MAX];
+    /** Rows of garbage each seat receives at the end of the round. */
+    int garbage_due[MATCH_SEATS_MAX];
+    /** Set once the match has ended. */
+    int over;
+    unsigned long rounds;
+    /** Source of the match's own random decisions (garbage targets and blocks). */
+    Rng rng;
+} Match;
+
+/**
+ * Start a match between `n_seats` seats, from 2 to `MATCH_SEATS_MAX`, with `STARTING_PIECES` of each piece per seat
+ * in the pool. Like a `Game`, the whole match is determined by `seed` and the moves it receives.
+ */
+void match_init(Match *, int n_seats, enum Match_garbage, unsigned long seed);
+/**
+ * @returns the game of a seat, to decide its move from (in `Game_state_Choose` while the seat is to play).
+ */
+Game const * match_seat(Match const *, int seat);
+/**
+ * @returns whether a seat still has to play in the current round.
+ */
+int match_to_play(Match const *, int seat);
+/**
+ * Play the move of a seat in the current round, seats being taken in order. Any move of a piece that is in the pool
+ * is played, as far as it can be (like `Ai_decision`, the piece is moved towards the column until it is reached or
+ * blocked).
+ * @returns 0 if played, -1 if the piece is no longer in the pool: the seat's game then shows the pool as it is now,
+ * and the seat must decide again.
+ */
+int match_play(Match *, int seat, Match_move const *);
+/**
+ * End the round: deliver the garbage, check whether the match is over, and show every seat the pool for the next
+ * round.
+ * @returns whether the match goes on.
+ */
+int match_end_round(Match *);
+/**
+ * @returns the winning seat of a finished match, or -1 for a tie.
+ */
+int match_winner(Match const *);
+#endif /* ifndef XTETRIS_MATCH_H */
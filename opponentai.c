@@ -3,6 +3,8 @@
  * @author Maksim Kovalkov
  */
 
+#include <limits.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -13,35 +15,313 @@
 
 #include "opponentai.h"
 
-/** 
- * Coefficients for the heuristic used to evaluate a particular move.
- * Metrics loosely inspired by open source AI projects for classic Tetris.
- * Values determined by guessing and common sense :)
+#define CONFIG_LINE_LEN 128
+
+/** Fixed point score of a position where no piece fits; lower than any real score, and never discounted. */
+#define FIXED_NONE (-LONG_MAX)
+
+/**
+ * `Ai_weights` converted for `Ai_eval_Fixed`: heuristic weights times `AI_FIXED_ONE`, and the magnitude of the
+ * `future` discount times `AI_DISCOUNT_ONE`.
+ */
+typedef struct Fixed_weights {
+    long height, lines, holes, bumps, penalty;
+    long row_trans, col_trans, wells, covered;
+    unsigned long future;
+    int future_negative;
+} Fixed_weights;
+
+/** Number of entries of the endgame transposition table. */
+#define ENDGAME_MEMO_SIZE 1024
+/** Endgame value of lines where every piece is placed; those where the AI gets stuck are worth the pieces placed. */
+#define ENDGAME_ALIVE 10000
+/** How many endgame nodes to search between two looks at the clock. */
+#define ENDGAME_CLOCK_EVERY 256
+
+/**
+ * Endgame transposition table entry: the position (occupied cells, pieces left, placements still to make) and its
+ * exact value. Values only depend on the position, so entries stay valid from one decision to the next.
  */
-#define HEIGHT_COEFF  (-55.0)
-#define LINES_COEFF   (+70.0)
-#define HOLES_COEFF   (-35.0)
-#define BUMPS_COEFF   (-40.0)
-#define FUTURE_COEFF  (+0.90)
-#define PENALTY_COEFF (+80.0)
-#define RECURSE_DEPTH 1
+typedef struct Endgame_entry {
+    Row_bits rows[BOARD_ROWS];
+    unsigned char pieces_left[7];
+    /** 0 for an empty entry. */
+    unsigned char turns;
+    int value;
+} Endgame_entry;
 
 struct Opponent_ai {
+    Ai_config config;
+    Fixed_weights fixed;
     int x, rots;
     int last_x;
     enum Tetrimino_type type;
     Board sim_board;
+    /** No row of `sim_board` above this one is occupied. */
+    int sim_top;
+    /** Pieces left in the simulated game, updated along with `sim_board`. */
+    unsigned char sim_pieces_left[7];
+    Ai_decision last;
+    Book const *book;
+    /** State of the current endgame search. */
+    unsigned long endgame_nodes;
+    clock_t endgame_deadline;
+    int endgame_aborted;
+    /** `ENDGAME_MEMO_SIZE` entries following the structure, or NULL if the endgame search is disabled. */
+    Endgame_entry *endgame_memo;
+#ifndef ROW_BITS_WORDS
+    /** Every piece type in every rotation, for dropping pieces on `Sim_bits`. */
+    Piece_bits shapes[7][4];
+#endif
+};
+
+/**
+ * The simulated board as bitboards, made once per node of a search so that dropping each piece does not look at
+ * the board cell by cell: its rows, and the first occupied row of every column. Not used on boards wider than 32
+ * columns, where pieces are dropped on `sim_board` with `collides` and `drop_piece`.
+ */
+typedef struct Sim_bits {
+    Row_bits rows[BOARD_ROWS];
+    int top[BOARD_COLS];
+} Sim_bits;
+
+/**
+ * Undo information for the line clears done by `clear_lines` on the simulated board.
+ */
+typedef struct Clear_journal {
+    /** `sim_top` before the clear. */
+    int top;
+    int n_cleared;
+    /** Indices of the cleared rows, from top to bottom, and their contents. */
+    int rows[4];
+    unsigned char saved[4][BOARD_COLS];
+} Clear_journal;
+
+static double choose_best_move(Opponent_ai *, int);
+static long choose_best_move_fixed(Opponent_ai *, int);
+static long heuristic_fixed(Fixed_weights const *, Board const);
+static long to_fixed(double, double);
+static long discount_fixed(Fixed_weights const *, long);
+static int solve_endgame(Opponent_ai *, int, int);
+static Endgame_entry * endgame_probe(Opponent_ai *, int, Endgame_entry *);
+static void clear_lines(Opponent_ai *, Piece const *, Clear_journal *);
+static void unclear_lines(Opponent_ai *, Clear_journal const *);
+static int book_move(Opponent_ai *);
+static void sim_bits(Opponent_ai const *, Sim_bits *);
+static int sim_drop(Opponent_ai const *, Sim_bits const *, Piece *, int);
+#ifndef ROW_BITS_WORDS
+static int popcount(unsigned long);
+#endif
+
+/**
+ * Names of the configuration keys, mapped to the fields they set.
+ */
+static struct {
+    char const *name;
+    size_t offset;
+} const weight_keys[] = {
+    { "height",  offsetof(Ai_weights, height) },
+    { "lines",   offsetof(Ai_weights, lines) },
+    { "holes",   offsetof(Ai_weights, holes) },
+    { "bumps",   offsetof(Ai_weights, bumps) },
+    { "future",  offsetof(Ai_weights, future) },
+    { "penalty", offsetof(Ai_weights, penalty) },
+    { "row_trans", offsetof(Ai_weights, row_trans) },
+    { "col_trans", offsetof(Ai_weights, col_trans) },
+    { "wells",   offsetof(Ai_weights, wells) },
+    { "covered", offsetof(Ai_weights, covered) }
 };
 
-static double choose_best_move(Opponent_ai *, unsigned char const [7], int);
-static double heuristic(Board const);
+#define WEIGHT_FIELD(w, i) (*(double *)((char *)(w) + weight_keys[i].offset))
+
+double *
+ai_weight(Ai_weights *w, int i)
+{
+    return &WEIGHT_FIELD(w, i);
+}
+
+char const *
+ai_weight_name(int i)
+{
+    return weight_keys[i].name;
+}
+
+void
+ai_config_default(Ai_config *config)
+{
+    /* values determined by guessing and common sense :) */
+    config->weights.height  = -55.0;
+    config->weights.lines   = +70.0;
+    config->weights.holes   = -35.0;
+    config->weights.bumps   = -40.0;
+    config->weights.future  = +0.90;
+    config->weights.penalty = +80.0;
+    config->weights.row_trans = 0.0;
+    config->weights.col_trans = 0.0;
+    config->weights.wells   = 0.0;
+    config->weights.covered = 0.0;
+    config->depth = 1;
+    config->eval = Ai_eval_Double;
+    config->endgame = 0;
+    config->endgame_ms = 100;
+}
+
+int
+ai_config_set(Ai_config *config, char const *name, char const *value)
+{
+    double v;
+    char *end;
+    int i;
+
+    if (strcmp(name, "eval") == 0) {
+        if (strcmp(value, "double") == 0)
+            config->eval = Ai_eval_Double;
+        else if (strcmp(value, "fixed") == 0)
+            config->eval = Ai_eval_Fixed;
+        else
+            return -1;
+        return 0;
+    }
+
+    v = strtod(value, &end);
+    if (end == value || *end)
+        return -1;
+
+    if (strcmp(name, "depth") == 0) {
+        config->depth = (int) v;
+        return 0;
+    }
+    if (strcmp(name, "endgame") == 0) {
+        config->endgame = (int) v;
+        return 0;
+    }
+    if (strcmp(name, "endgame_ms") == 0) {
+        config->endgame_ms = v;
+        return 0;
+    }
+    for (i = 0; i < AI_WEIGHTS_N; ++i) {
+        if (strcmp(name, weight_keys[i].name) == 0) {
+            WEIGHT_FIELD(&config->weights, i) = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int
+ai_config_load(Ai_config *config, char const *path)
+{
+    char line[CONFIG_LINE_LEN], name[CONFIG_LINE_LEN], value[CONFIG_LINE_LEN];
+    int ok = 1;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return -1;
+
+    while (ok && fgets(line, sizeof line, f)) {
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+        switch (sscanf(line, "%127s %127s", name, value)) {
+        case EOF:
+        case 0:
+            continue; /* blank line */
+        case 2:
+            ok = ai_config_set(config, name, value) == 0;
+            break;
+        default:
+            ok = 0;
+        }
+    }
+
+    if (ferror(f))
+        ok = 0;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+int
+ai_config_save(Ai_config const *config, char const *path)
+{
+    int i;
+    int ok;
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+        return -1;
+
+    for (i = 0; i < AI_WEIGHTS_N; ++i)
+        fprintf(f, "%-8s %.17g\n", weight_keys[i].name, WEIGHT_FIELD(&config->weights, i));
+    fprintf(f, "%-8s %d\n", "depth", config->depth);
+    fprintf(f, "%-8s %s\n", "eval", config->eval == Ai_eval_Fixed ? "fixed" : "double");
+    fprintf(f, "%-8s %d\n", "endgame", config->endgame);
+    fprintf(f, "%-8s %.17g\n", "endgame_ms", config->endgame_ms);
+
+    ok = !ferror(f);
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+Opponent_ai *
+ai_create(Ai_config const *config)
+{
+    return ai_init(malloc_or_die(ai_size(config)), config);
+}
+
+size_t
+ai_size(Ai_config const *config)
+{
+    /* the size of the structure is a multiple of its alignment, which is at least that of the entries */
+    if (config && config->endgame)
+        return sizeof (Opponent_ai) + ENDGAME_MEMO_SIZE * sizeof (Endgame_entry);
+    return sizeof (Opponent_ai);
+}
 
 Opponent_ai *
-ai_create()
+ai_init(void *mem, Ai_config const *config)
 {
-    Opponent_ai *ai = malloc_or_die(sizeof (Opponent_ai));
+    Opponent_ai *ai = mem;
+
+    if (config)
+        ai->config = *config;
+    else
+        ai_config_default(&ai->config);
 
-    srand((unsigned) time(NULL));
+    ai->fixed.height = to_fixed(ai->config.weights.height, AI_FIXED_ONE);
+    ai->fixed.lines = to_fixed(ai->config.weights.lines, AI_FIXED_ONE);
+    ai->fixed.holes = to_fixed(ai->config.weights.holes, AI_FIXED_ONE);
+    ai->fixed.bumps = to_fixed(ai->config.weights.bumps, AI_FIXED_ONE);
+    ai->fixed.penalty = to_fixed(ai->config.weights.penalty, AI_FIXED_ONE);
+    ai->fixed.row_trans = to_fixed(ai->config.weights.row_trans, AI_FIXED_ONE);
+    ai->fixed.col_trans = to_fixed(ai->config.weights.col_trans, AI_FIXED_ONE);
+    ai->fixed.wells = to_fixed(ai->config.weights.wells, AI_FIXED_ONE);
+    ai->fixed.covered = to_fixed(ai->config.weights.covered, AI_FIXED_ONE);
+    ai->fixed.future_negative = ai->config.weights.future < 0;
+    ai->fixed.future = (unsigned long) labs(to_fixed(ai->config.weights.future, AI_DISCOUNT_ONE));
+
+#ifndef ROW_BITS_WORDS
+    {
+        Piece piece;
+        int t, rots;
+        for (t = 0; t < 7; ++t) {
+            piece.type = (unsigned char) (Tetrimino_type_I + t);
+            init_piece_shape(&piece);
+            for (rots = 0; rots < 4; ++rots) {
+                piece_bits_init(&ai->shapes[t][rots], &piece);
+                rotate_shape_cw(piece.shape);
+            }
+        }
+    }
+#endif
+
+    ai->x = ai->rots = ai->last_x = 0;
+    ai->type = Tetrimino_type_I;
+    ai->endgame_memo = NULL;
+    if (ai->config.endgame) {
+        ai->endgame_memo = (Endgame_entry *) (ai + 1);
+        memset(ai->endgame_memo, 0, ENDGAME_MEMO_SIZE * sizeof *ai->endgame_memo);
+    }
+    memset(&ai->last, 0, sizeof ai->last);
+    ai->book = NULL;
     return ai;
 }
 
@@ -59,9 +339,53 @@ ai_next_action(Opponent_ai *ai, Game const *game)
         /* ai->x = (rand() % 10) - 4;
         ai->rots = rand() % 3;
         ai->type = Tetrimino_type_I + (rand() % 7); */
-        memcpy(ai->sim_board, game->board[1], sizeof ai->sim_board);
-        ai->last_x = ai->x;
-        choose_best_move(ai, game->pieces_left, RECURSE_DEPTH);
+        memcpy(ai->sim_board, game->board[game->current_player], sizeof ai->sim_board);
+        memcpy(ai->sim_pieces_left, game->pieces_left, sizeof ai->sim_pieces_left);
+        for (ai->sim_top = 0; ai->sim_top < BOARD_ROWS; ++ai->sim_top) {
+            int j;
+            for (j = 0; j < BOARD_COLS && !ai->sim_board[ai->sim_top][j]; ++j) /* nop */;
+            if (j < BOARD_COLS)
+                break;
+        }
+        /* not a column: whatever the new piece spawns at, it is then moved towards the target */
+        ai->last_x = INT_MIN;
+        /* in case no placement fits anywhere: still pick a piece that is left, and lose gracefully */
+        for (ai->type = Tetrimino_type_I; !game->pieces_left[ai->type-1]; ++ai->type) /* nop */;
+        ai->rots = 0;
+        ai->last.n_candidates = 0;
+        ai->last.endgame = 0;
+        ai->last.book = book_move(ai);
+        if (!ai->last.book) {
+            int i, left = 0;
+            if (ai->config.eval == Ai_eval_Fixed)
+                choose_best_move_fixed(ai, ai->config.depth);
+            else
+                choose_best_move(ai, ai->config.depth);
+            for (i = 0; i < 7; ++i)
+                left += game->pieces_left[i];
+            if (left <= ai->config.endgame) {
+                /* our own turns only: in two player games, every other piece goes to the opponent */
+                int const turns = game->kind == Game_kind_Singleplayer ? left : (left + 1) / 2;
+                int const x = ai->x, rots = ai->rots;
+                enum Tetrimino_type const type = ai->type;
+
+                ai->endgame_nodes = 0;
+                ai->endgame_aborted = 0;
+                ai->endgame_deadline = clock() + (clock_t) (ai->config.endgame_ms / 1e3 * CLOCKS_PER_SEC);
+                solve_endgame(ai, turns, 1);
+                if (ai->endgame_aborted) {
+                    /* out of time: keep the heuristic move */
+                    ai->x = x;
+                    ai->rots = rots;
+                    ai->type = type;
+                } else {
+                    ai->last.endgame = 1;
+                }
+            }
+        }
+        ai->last.type = (unsigned char) ai->type;
+        ai->last.rots = (unsigned char) ai->rots;
+        ai->last.x = ai->x;
         return ai->type - Tetrimino_type_I + Game_action_Choose_I;
     case Game_state_Place:
         if (ai->rots) {
@@ -84,12 +408,15 @@ ai_next_action(Opponent_ai *ai, Game const *game)
     }
 }
 
-double
-heuristic(Board const board)
+#ifdef ROW_BITS_WORDS
+
+void
+ai_board_features(Board const board, Ai_features *f)
 {
-    double heu;
     int heights[BOARD_COLS];
-    int i, j, max_height = 0, lines = 0, holes = 0, bumps = 0;
+    int i, j;
+
+    memset(f, 0, sizeof *f);
 
     /* compute heights per column */
     for (j = 0; j < BOARD_COLS; ++j) {
@@ -99,75 +426,595 @@ heuristic(Board const board)
 
     /* find max height */
     for (i = 0; i < BOARD_COLS; ++i)
-        if (heights[i] > max_height)
-            max_height = heights[i];
+        if (heights[i] > f->max_height)
+            f->max_height = heights[i];
 
-    /* count full lines */
+    /* count full lines and row transitions */
     for (i = 0; i < BOARD_ROWS; ++i) {
-        int full = 1;
-        for (j = 0; full && j < BOARD_COLS; ++j) {
-            if (!board[i][j])
-                full = 0;
+        int full = 1, prev = 1;
+        for (j = 0; j < BOARD_COLS; ++j) {
+            int const cur = board[i][j] != 0;
+            full &= cur;
+            f->row_trans += cur != prev;
+            prev = cur;
         }
-        lines += full;
+        f->lines += full;
+        f->row_trans += !prev;
     }
 
-    /* count holes */
+    /* count holes, the blocks above them, column transitions and wells */
     for (j = 0; j < BOARD_COLS; ++j) {
-        for (i = BOARD_ROWS - heights[j] + 1; i < BOARD_ROWS; ++i) {
-            if (!board[i][j])
-                ++holes;
+        int const top = BOARD_ROWS - heights[j];
+        int below = 0, prev = 1;
+        for (i = BOARD_ROWS - 1; i >= 0; --i) {
+            int const cur = board[i][j] != 0;
+            f->col_trans += cur != prev;
+            prev = cur;
+            if (!cur && i > top)
+                ++f->holes;
+            if (cur && below)
+                ++f->covered;
+            below |= !cur;
+            if (i < top && (j == 0 || board[i][j-1]) && (j == BOARD_COLS - 1 || board[i][j+1]))
+                ++f->wells;
         }
     }
 
     /* count "bumps" (height difference between adjacent columns) */
     for (i = 1; i < BOARD_COLS; ++i)
-        bumps += abs(heights[i] - heights[i-1]);
+        f->bumps += abs(heights[i] - heights[i-1]);
+}
+
+#else
+
+/**
+ * @returns the number of bits set.
+ */
+int
+popcount(unsigned long x)
+{
+#ifdef __GNUC__
+    return __builtin_popcountl(x);
+#else
+    int n;
+    for (n = 0; x; x &= x - 1)
+        ++n;
+    return n;
+#endif
+}
+
+void
+ai_board_features(Board const board, Ai_features *f)
+{
+    /* rows as bitboards: bit j is column j */
+    unsigned long const full = (((unsigned long) 1 << (BOARD_COLS - 1)) << 1) - 1;
+    unsigned long const right_wall = (unsigned long) 1 << (BOARD_COLS - 1);
+    unsigned long rows[BOARD_ROWS];
+    /* columns occupied in some row above the current one, and with an empty cell in some row below */
+    unsigned long above = 0, below = 0;
+    int heights[BOARD_COLS];
+    int i, j;
+
+    memset(f, 0, sizeof *f);
+    memset(heights, 0, sizeof heights);
+
+    /* from the top down: everything but the blocks above holes */
+    for (i = 0; i < BOARD_ROWS; ++i) {
+        unsigned long const r = row_bits_pack(board[i]);
+        unsigned long fresh = r & ~above;
+
+        rows[i] = r;
+        if (r && !above)
+            f->max_height = BOARD_ROWS - i;
+        for (j = 0; fresh; ++j, fresh >>= 1)
+            if (fresh & 1)
+                heights[j] = BOARD_ROWS - i;
+
+        f->lines += r == full;
+        f->holes += popcount(~r & above);
+        /* neighbouring columns that differ, and the walls next to empty cells */
+        f->row_trans += popcount((r ^ r >> 1) & full >> 1) + !(r & 1) + !(r & right_wall);
+        if (i > 0)
+            f->col_trans += popcount(r ^ rows[i-1]);
+        /* open cells with both neighbours occupied */
+        f->wells += popcount(~(r | above) & (r << 1 | 1) & (r >> 1 | right_wall) & full);
+        above |= r;
+    }
+    /* the floor is occupied */
+    f->col_trans += popcount(~rows[BOARD_ROWS-1] & full);
+
+    /* from the bottom up: the blocks above holes */
+    for (i = BOARD_ROWS - 1; i >= 0; --i) {
+        f->covered += popcount(rows[i] & below);
+        below |= ~rows[i] & full;
+    }
+
+    /* count "bumps" (height difference between adjacent columns) */
+    for (i = 1; i < BOARD_COLS; ++i)
+        f->bumps += abs(heights[i] - heights[i-1]);
+}
+
+#endif /* ifdef ROW_BITS_WORDS */
+
+double
+ai_heuristic(Ai_weights const *w, Board const board)
+{
+    Ai_features f;
+
+    ai_board_features(board, &f);
+    /* fprintf(stderr, "h=%d l=%d o=%d b=%d\n", f.max_height, f.lines, f.holes, f.bumps); */
+    return w->height * f.max_height + w->lines * f.lines + w->penalty * (f.lines >= 3)
+            + w->holes * f.holes + w->bumps * f.bumps
+            + w->row_trans * f.row_trans + w->col_trans * f.col_trans + w->wells * f.wells + w->covered * f.covered;
+}
+
+/**
+ * Same as `ai_heuristic`, in fixed point: the result is scaled by `AI_FIXED_ONE`.
+ */
+long
+heuristic_fixed(Fixed_weights const *w, Board const board)
+{
+    Ai_features f;
+
+    ai_board_features(board, &f);
+    return w->height * f.max_height + w->lines * f.lines + w->penalty * (f.lines >= 3)
+            + w->holes * f.holes + w->bumps * f.bumps
+            + w->row_trans * f.row_trans + w->col_trans * f.col_trans + w->wells * f.wells + w->covered * f.covered;
+}
+
+/**
+ * @returns `x * one`, rounded to the nearest integer (halves away from zero).
+ */
+long
+to_fixed(double x, double one)
+{
+    /* conversion truncates, which is floor for these non-negative values */
+    return x < 0 ? -(long) (-x * one + 0.5) : (long) (x * one + 0.5);
+}
+
+/**
+ * Multiply a fixed point score by the `future` discount, rounding to nearest (halves away from zero).
+ * Only unsigned arithmetic on the magnitudes is used, split in 16-bit halves so that no intermediate product
+ * overflows 32 bits: the result is the same everywhere, whatever the width of `long`.
+ */
+long
+discount_fixed(Fixed_weights const *w, long score)
+{
+    unsigned long mag, ah, al, bh, bl, r;
+    int negative;
+
+    if (score == FIXED_NONE)
+        return FIXED_NONE;
+    negative = (score < 0) != w->future_negative;
+    mag = score < 0 ? 0UL - (unsigned long) score : (unsigned long) score;
+
+    ah = mag >> 16;
+    al = mag & 0xffffUL;
+    bh = w->future >> 16;
+    bl = w->future & 0xffffUL;
+    /* (ah*2^16 + al) * (bh*2^16 + bl) / 2^16, with AI_DISCOUNT_ONE == 2^16 */
+    r = ((ah * bh) << 16) + ah * bl + al * bh + ((al * bl + 0x8000UL) >> 16);
+    return negative ? -(long) r : (long) r;
+}
+
+Ai_decision const *
+ai_last_decision(Opponent_ai const *ai)
+{
+    return &ai->last;
+}
+
+unsigned long
+ai_config_book_hash(Ai_config const *config)
+{
+    unsigned long h = 2166136261UL;
+    unsigned char const *p;
+    int i;
+
+    /* FNV-1a over the eval, the depth and the values of the weights (the endgame search plays no opening) */
+    h = ((h ^ (unsigned long) config->eval) * 16777619UL) & 0xffffffffUL;
+    h = ((h ^ (unsigned long) config->depth) * 16777619UL) & 0xffffffffUL;
+    for (i = 0; i < AI_WEIGHTS_N; ++i) {
+        double const w = WEIGHT_FIELD(&config->weights, i);
+        for (p = (unsigned char const *) &w; p < (unsigned char const *) (&w + 1); ++p)
+            h = ((h ^ *p) * 16777619UL) & 0xffffffffUL;
+    }
+    return h;
+}
+
+int
+ai_set_book(Opponent_ai *ai, Book const *book)
+{
+    ai->book = NULL;
+    if (book && book->config_hash != ai_config_book_hash(&ai->config))
+        return -1;
+    ai->book = book;
+    return 0;
+}
+
+/**
+ * Look the simulated position up in the opening book, and take its move if it is one the search could make: a piece
+ * that is left, at a column where it fits at the top of the board.
+ * @returns whether the book's move was taken.
+ */
+int
+book_move(Opponent_ai *ai)
+{
+    Book_entry const *e;
+    Piece piece;
+    int i;
+
+    if (!ai->book || !(e = book_probe(ai->book, ai->sim_board, ai->sim_pieces_left)))
+        return 0;
+    if (e->type < Tetrimino_type_I || e->type > Tetrimino_type_O || !ai->sim_pieces_left[e->type-1] || e->rots > 3)
+        return 0;
+
+    piece.type = e->type;
+    init_piece_shape(&piece);
+    for (i = 0; i < e->rots; ++i)
+        rotate_shape_cw(piece.shape);
+    lift_piece(&piece, ai->sim_board);
+    piece.x = e->x;
+    if (piece.x < -2 || piece.x + 2 >= BOARD_COLS || collides(&piece, ai->sim_board))
+        return 0;
+
+    ai->type = (enum Tetrimino_type) e->type;
+    ai->rots = e->rots;
+    ai->x = e->x;
+    return 1;
+}
+
+void
+ai_record_candidate(Ai_decision *d, double score, Piece const *piece, int rots)
+{
+    int i;
+
+    if (d->n_candidates == AI_CANDIDATES_MAX) {
+        if (score <= d->candidates[AI_CANDIDATES_MAX - 1].score)
+            return;
+        i = AI_CANDIDATES_MAX - 1;
+    } else {
+        i = d->n_candidates++;
+    }
+    for (; i > 0 && d->candidates[i-1].score < score; --i)
+        d->candidates[i] = d->candidates[i-1];
+    d->candidates[i].score = score;
+    d->candidates[i].type = piece->type;
+    d->candidates[i].rots = (unsigned char) rots;
+    d->candidates[i].x = piece->x;
+}
+
+/**
+ * Find the transposition table slot of the simulated position with `turns` placements to go: the entry for it if
+ * there is one, otherwise the slot to overwrite. `key` is filled in with the position.
+ */
+Endgame_entry *
+endgame_probe(Opponent_ai *ai, int turns, Endgame_entry *key)
+{
+    unsigned long h = 2166136261UL;
+    unsigned char const *p;
+    int y;
+
+    memset(key, 0, sizeof *key);
+    for (y = ai->sim_top; y < BOARD_ROWS; ++y)
+        key->rows[y] = row_bits_pack(ai->sim_board[y]);
+    memcpy(key->pieces_left, ai->sim_pieces_left, sizeof key->pieces_left);
+    key->turns = (unsigned char) turns;
+
+    /* FNV-1a over the key fields, which are all bytes or arrays of words without padding */
+    for (p = (unsigned char const *) key->rows; p < (unsigned char const *) (key->rows + BOARD_ROWS); ++p)
+        h = ((h ^ *p) * 16777619UL) & 0xffffffffUL;
+    for (p = key->pieces_left; p <= &key->turns; ++p)
+        h = ((h ^ *p) * 16777619UL) & 0xffffffffUL;
+    return &ai->endgame_memo[h % ENDGAME_MEMO_SIZE];
+}
+
+/**
+ * Exhaustive search of the AI's next `turns` placements, trying every piece that is left; pieces are assumed to
+ * stay available, which in two player games ignores what the opponent takes in between.
+ * At the root (`root` set), the best move is stored in `ai` like `choose_best_move` does.
+ * Gives up, setting `endgame_aborted`, when the deadline passes; the results are meaningless from then on.
+ * @returns `ENDGAME_ALIVE` plus the points scored if every placement can be made, otherwise the most placements
+ * that can be made before getting stuck.
+ */
+int
+solve_endgame(Opponent_ai *ai, int turns, int root)
+{
+    Piece piece;
+    Clear_journal journal;
+    Endgame_entry key, *slot;
+    Sim_bits bits;
+    int value, best = 0;
+
+    if (turns == 0)
+        return ENDGAME_ALIVE;
+    if (++ai->endgame_nodes % ENDGAME_CLOCK_EVERY == 0 && clock() > ai->endgame_deadline)
+        ai->endgame_aborted = 1;
+    if (ai->endgame_aborted)
+        return 0;
+
+    slot = endgame_probe(ai, turns, &key);
+    if (!root && slot->turns && memcmp(slot, &key, offsetof(Endgame_entry, turns) + 1) == 0)
+        return slot->value;
+
+    sim_bits(ai, &bits);
+    for (piece.type = Tetrimino_type_I; piece.type <= Tetrimino_type_O; ++piece.type) {
+        int rots;
+        if (ai->sim_pieces_left[piece.type-1] == 0)
+            continue;
+
+        init_piece_shape(&piece);
+        for (rots = 0; rots < 4; ++rots) {
+            lift_piece(&piece, ai->sim_board);
+            for (piece.x = -2; piece.x + 2 < BOARD_COLS; ++piece.x) {
+                if (!sim_drop(ai, &bits, &piece, rots))
+                    continue;
+                place_piece(&piece, ai->sim_board, piece.type);
+                clear_lines(ai, &piece, &journal);
+                --ai->sim_pieces_left[piece.type-1];
+
+                value = solve_endgame(ai, turns - 1, 0);
+                if (value >= ENDGAME_ALIVE)
+                    value += journal.n_cleared ? score_per_lines[journal.n_cleared - 1] : 0;
+                else
+                    value += 1;
+
+                ++ai->sim_pieces_left[piece.type-1];
+                unclear_lines(ai, &journal);
+                place_piece(&piece, ai->sim_board, Block_type_Empty);
+
+                if (value > best) {
+                    best = value;
+                    if (root) {
+                        ai->x = piece.x;
+                        ai->rots = rots;
+                        ai->type = piece.type;
+                    }
+                }
+            }
+            rotate_shape_cw(piece.shape);
+        }
+    }
 
-    /* return final heuristic */
-    heu = HEIGHT_COEFF * max_height + LINES_COEFF * lines + PENALTY_COEFF * (lines >= 3)
-            + HOLES_COEFF * holes + BUMPS_COEFF * bumps;
-    /* fprintf(stderr, "h=%d l=%d o=%d b=%d\theu=%.3lf\n", max_height, lines, holes, bumps, heu); */
-    return heu;
+    if (!ai->endgame_aborted) {
+        key.value = best;
+        *slot = key;
+    }
+    return best;
 }
 
+/**
+ * Make the bitboards of the simulated board, for `sim_drop`.
+ */
+void
+sim_bits(Opponent_ai const *ai, Sim_bits *bits)
+{
+#ifndef ROW_BITS_WORDS
+    int y;
+
+    for (y = 0; y < ai->sim_top; ++y)
+        bits->rows[y] = 0;
+    for (; y < BOARD_ROWS; ++y)
+        bits->rows[y] = row_bits_pack(ai->sim_board[y]);
+    row_bits_tops(bits->rows, bits->top);
+#else
+    (void) ai;
+    (void) bits;
+#endif
+}
+
+/**
+ * Drop a piece from where it is on the simulated board, whose bitboards are `bits`, as `collides` then `drop_piece`
+ * would; pieces of the search are placed and removed again, so the bitboards stay those of the board.
+ * @param rots clockwise rotations of the piece from its initial shape.
+ * @returns 0, leaving the piece where it is, if it does not fit there.
+ */
+int
+sim_drop(Opponent_ai const *ai, Sim_bits const *bits, Piece *piece, int rots)
+{
+#ifndef ROW_BITS_WORDS
+    int const y = piece_bits_landing(&ai->shapes[piece->type - 1][rots], bits->rows, bits->top, piece->x, piece->y);
+    if (y == BOARD_ROWS)
+        return 0;
+    piece->y = y;
+    return 1;
+#else
+    (void) bits;
+    (void) rots;
+    if (collides(piece, ai->sim_board))
+        return 0;
+    drop_piece(piece, ai->sim_board);
+    return 1;
+#endif
+}
+
+/**
+ * Remove the full rows left by `piece`, which has just been placed on the simulated board, shifting the rows above
+ * them down like `remove_cleared_lines` does, and record what is needed to undo it.
+ * Only the rows between the top of the stack and the lowest cleared row are touched.
+ */
+void
+clear_lines(Opponent_ai *ai, Piece const *piece, Clear_journal *journal)
+{
+    int i, j, read, write;
+
+    journal->top = ai->sim_top;
+    journal->n_cleared = 0;
+    if (piece->y < ai->sim_top)
+        ai->sim_top = piece->y < 0 ? 0 : piece->y;
+
+    /* only the rows covered by the piece can have become full */
+    for (i = piece->y < 0 ? 0 : piece->y; i < piece->y + 4 && i < BOARD_ROWS; ++i) {
+        for (j = 0; j < BOARD_COLS && ai->sim_board[i][j]; ++j) /* nop */;
+        if (j == BOARD_COLS) {
+            journal->rows[journal->n_cleared] = i;
+            memcpy(journal->saved[journal->n_cleared], ai->sim_board[i], BOARD_COLS);
+            ++journal->n_cleared;
+        }
+    }
+    if (!journal->n_cleared)
+        return;
+
+    /* single pass from the lowest cleared row up, skipping the cleared ones */
+    j = journal->n_cleared - 1;
+    write = journal->rows[j];
+    for (read = write; read >= ai->sim_top; --read) {
+        if (j >= 0 && read == journal->rows[j]) {
+            --j;
+            continue;
+        }
+        if (write != read)
+            memcpy(ai->sim_board[write], ai->sim_board[read], BOARD_COLS);
+        --write;
+    }
+    for (; write >= ai->sim_top; --write)
+        memset(ai->sim_board[write], Block_type_Empty, BOARD_COLS);
+    ai->sim_top += journal->n_cleared;
+}
+
+/**
+ * Undo `clear_lines`: move the shifted rows back up, from the top, and put the cleared rows back.
+ */
+void
+unclear_lines(Opponent_ai *ai, Clear_journal const *journal)
+{
+    int i, j = 0, shift = journal->n_cleared;
+
+    if (shift) {
+        for (i = ai->sim_top - shift; i <= journal->rows[journal->n_cleared - 1]; ++i) {
+            if (j < journal->n_cleared && i == journal->rows[j]) {
+                memcpy(ai->sim_board[i], journal->saved[j], BOARD_COLS);
+                ++j;
+                --shift;
+            } else if (shift) {
+                memcpy(ai->sim_board[i], ai->sim_board[i + shift], BOARD_COLS);
+            }
+        }
+    }
+    ai->sim_top = journal->top;
+}
+
+/**
+ * Search the best move on the simulated board, looking `depth` pieces further ahead, and store it in `ai`.
+ * @returns the score of the best move (0 if there are no pieces left, so nothing to choose).
+ */
 double
-choose_best_move(Opponent_ai *ai, unsigned char const pieces_left[7], int depth) {
+choose_best_move(Opponent_ai *ai, int depth) {
     Piece piece;
+    Clear_journal journal;
+    Sim_bits bits;
     double score, max_score = -1e20;
+    int best_x = ai->x, best_rots = ai->rots, any_left = 0;
+    enum Tetrimino_type best_type = ai->type;
 
+    sim_bits(ai, &bits);
     /* try every piece type, in every rotation, at every available column */    
     for (piece.type = Tetrimino_type_I; piece.type <= Tetrimino_type_O; ++piece.type) {
         int rots;
-        if (pieces_left[piece.type-1] == 0)
+        if (ai->sim_pieces_left[piece.type-1] == 0)
             continue;
+        any_left = 1;
 
         init_piece_shape(&piece);
         for (rots = 0; rots < 4; ++rots) {
             lift_piece(&piece, ai->sim_board);
             for (piece.x = -2; piece.x + 2 < BOARD_COLS; ++piece.x) {
-                if (collides(&piece, ai->sim_board))
+                if (!sim_drop(ai, &bits, &piece, rots))
                     continue;
-                drop_piece(&piece, ai->sim_board);
                 place_piece(&piece, ai->sim_board, piece.type);
 
                 /* fprintf(stderr, "(%d, %d, %d) -> \t\t", piece.type, rots, piece.x); */
-                score = heuristic(ai->sim_board);
-                /* recursive call with board state that includes the current piece:
+                score = ai_heuristic(&ai->config.weights, ai->sim_board);
+                /* recursive call with the board as the game would leave it, lines cleared and all:
                    take into account the next step's best move in our calculations */
-                if (depth > 0)
-                    score += FUTURE_COEFF * choose_best_move(ai, pieces_left, depth-1);
+                if (depth > 0) {
+                    clear_lines(ai, &piece, &journal);
+                    --ai->sim_pieces_left[piece.type-1];
+                    score += ai->config.weights.future * choose_best_move(ai, depth-1);
+                    ++ai->sim_pieces_left[piece.type-1];
+                    unclear_lines(ai, &journal);
+                }
                 /* reset board state to previous condition */
                 place_piece(&piece, ai->sim_board, Block_type_Empty);
+                if (depth == ai->config.depth)
+                    ai_record_candidate(&ai->last, score, &piece, rots);
                 if (score > max_score) {
                     max_score = score;
-                    ai->x = piece.x;
-                    ai->rots = rots;
-                    ai->type = piece.type; 
+                    best_x = piece.x;
+                    best_rots = rots;
+                    best_type = piece.type; 
+                }
+            }
+            rotate_shape_cw(piece.shape);
+        }
+    }
+    /* written only now, since the recursive calls above clobber these fields with their own choices */
+    ai->x = best_x;
+    ai->rots = best_rots;
+    ai->type = best_type;
+    return any_left ? max_score : 0;
+}
+
+/**
+ * `choose_best_move` for `Ai_eval_Fixed`: the same search, on integer scores.
+ * @returns the fixed point score of the best move, `FIXED_NONE` if no piece fits.
+ */
+long
+choose_best_move_fixed(Opponent_ai *ai, int depth)
+{
+    Piece piece;
+    Clear_journal journal;
+    Sim_bits bits;
+    long score, max_score = FIXED_NONE;
+    int best_x = ai->x, best_rots = ai->rots, any_left = 0, found = 0;
+    enum Tetrimino_type best_type = ai->type;
+
+    sim_bits(ai, &bits);
+    /* try every piece type, in every rotation, at every available column */    
+    for (piece.type = Tetrimino_type_I; piece.type <= Tetrimino_type_O; ++piece.type) {
+        int rots;
+        if (ai->sim_pieces_left[piece.type-1] == 0)
+            continue;
+        any_left = 1;
+
+        init_piece_shape(&piece);
+        for (rots = 0; rots < 4; ++rots) {
+            lift_piece(&piece, ai->sim_board);
+            for (piece.x = -2; piece.x + 2 < BOARD_COLS; ++piece.x) {
+                if (!sim_drop(ai, &bits, &piece, rots))
+                    continue;
+                place_piece(&piece, ai->sim_board, piece.type);
+
+                score = heuristic_fixed(&ai->fixed, ai->sim_board);
+                if (depth > 0) {
+                    long future;
+                    clear_lines(ai, &piece, &journal);
+                    --ai->sim_pieces_left[piece.type-1];
+                    /* like the double path, where the huge negative score of a dead end swamps everything else */
+                    future = discount_fixed(&ai->fixed, choose_best_move_fixed(ai, depth-1));
+                    score = future == FIXED_NONE ? FIXED_NONE : score + future;
+                    ++ai->sim_pieces_left[piece.type-1];
+                    unclear_lines(ai, &journal);
+                }
+                /* reset board state to previous condition */
+                place_piece(&piece, ai->sim_board, Block_type_Empty);
+                if (depth == ai->config.depth)
+                    ai_record_candidate(&ai->last, score == FIXED_NONE ? -1e20 : (double) score / AI_FIXED_ONE,
+                                        &piece, rots);
+                /* the first move is taken even if it is a dead end, as the double path does */
+                if (!found || score > max_score) {
+                    found = 1;
+                    max_score = score;
+                    best_x = piece.x;
+                    best_rots = rots;
+                    best_type = piece.type; 
                 }
             }
             rotate_shape_cw(piece.shape);
         }
     }
-    return max_score;
+    /* written only now, since the recursive calls above clobber these fields with their own choices */
+    ai->x = best_x;
+    ai->rots = best_rots;
+    ai->type = best_type;
+    return any_left ? max_score : 0;
 }
@@ -5,21 +5,219 @@
 #ifndef XTETRIS_OPPONENTAI_H
 #define XTETRIS_OPPONENTAI_H
 
+#include <stddef.h>
+
 #include "tetris.h"
+#include "book.h"
 
 typedef struct Opponent_ai Opponent_ai;
 
+/**
+ * Coefficients for the heuristic used to evaluate a particular move.
+ * Metrics loosely inspired by open source AI projects for classic Tetris.
+ */
+typedef struct Ai_weights {
+    /** Weight of the height of the tallest column. */
+    double height;
+    /** Weight of the number of full lines. */
+    double lines;
+    /** Weight of the number of empty cells covered by a block. */
+    double holes;
+    /** Weight of the sum of height differences between adjacent columns. */
+    double bumps;
+    /** Discount applied to the score of the best follow-up move. */
+    double future;
+    /** Extra reward for a board with 3 or more full lines, which sends garbage to the opponent. */
+    double penalty;
+    /*
+     * The following features are optional: their weights are 0 by default, which leaves the heuristic as it was.
+     */
+    /** Weight of the number of changes between empty and occupied cells along the rows, walls being occupied. */
+    double row_trans;
+    /** Weight of the number of changes between empty and occupied cells down the columns, the floor being
+        occupied. */
+    double col_trans;
+    /** Weight of the total depth of the wells: empty cells open from above, with occupied cells (or walls) on
+        either side. */
+    double wells;
+    /** Weight of the number of blocks with a hole somewhere below them. */
+    double covered;
+} Ai_weights;
+
+/** Number of fields in `Ai_weights`. */
+#define AI_WEIGHTS_N 10
+
+/**
+ * Access the fields of `Ai_weights` by index, for code that treats them as a vector (e.g. for tuning).
+ * @returns a pointer to the i-th field, 0 <= i < AI_WEIGHTS_N.
+ */
+double * ai_weight(Ai_weights *, int i);
+/**
+ * @returns the name of the i-th field of `Ai_weights`, as used in configuration files.
+ */
+char const * ai_weight_name(int i);
+
+/** The metrics of a board that the heuristic combines, one per weight of `Ai_weights`. */
+typedef struct Ai_features {
+    int max_height, lines, holes, bumps;
+    int row_trans, col_trans, wells, covered;
+} Ai_features;
+
+/**
+ * Measure the metrics of a board that the heuristic is made of. Rows are handled whole, as bitboards, so that the
+ * optional features cost little more than the others (on boards wider than 32 columns, cell by cell).
+ */
+void ai_board_features(Board const, Ai_features *);
+/**
+ * @returns the score the heuristic gives a board (higher is better), as in the search with `Ai_eval_Double`.
+ */
+double ai_heuristic(Ai_weights const *, Board const);
+
+/**
+ * Arithmetic used to evaluate moves.
+ */
+enum Ai_eval {
+    /** Floating point, straight from `Ai_weights`. */
+    Ai_eval_Double,
+    /**
+     * Integer fixed point: heuristic weights rounded to multiples of 1/`AI_FIXED_ONE`, the `future` discount to
+     * multiples of 1/`AI_DISCOUNT_ONE`, and only integer operations with explicit rounding in the search, so that
+     * the choices do not depend on the compiler, the optimization level or the floating point unit.
+     * Moves can only differ from `Ai_eval_Double` when weights are not multiples of 1/`AI_FIXED_ONE` or when two
+     * moves are within rounding of each other (the default `future` 0.9 becomes 58982/65536); x-tetris-evalcheck
+     * counts how often that happens.
+     */
+    Ai_eval_Fixed
+};
+
+/** Scale of the heuristic weights in fixed point mode. */
+#define AI_FIXED_ONE 256
+/** Scale of the `future` discount in fixed point mode. */
+#define AI_DISCOUNT_ONE 65536UL
+
+/**
+ * Everything that determines how an Opponent_ai plays.
+ */
+typedef struct Ai_config {
+    Ai_weights weights;
+    /** How many moves to look ahead after the one being chosen. */
+    int depth;
+    enum Ai_eval eval;
+    /**
+     * With this many pieces left or fewer (0: never), the heuristic search is replaced by an exhaustive endgame
+     * search, which plays for survival first and then for the highest score.
+     */
+    int endgame;
+    /** CPU time allowed to the endgame search for one decision, in milliseconds; the heuristic move is played
+        if it runs out. */
+    double endgame_ms;
+} Ai_config;
+
+/**
+ * Fill in the built-in configuration.
+ */
+void ai_config_default(Ai_config *);
+/**
+ * Set a single configuration field by name: one of the fields of `Ai_weights`, `depth`, `endgame`, `endgame_ms`,
+ * or `eval` (`double` or `fixed`).
+ * @returns 0 on success, -1 if the name is unknown or the value is invalid for it.
+ */
+int ai_config_set(Ai_config *, char const *name, char const *value);
+/**
+ * Read a configuration from a text file with one `name value` pair per line (`#` starts a comment).  
+ * Names are those accepted by `ai_config_set`; fields that are not mentioned keep their value.
+ * @returns 0 on success, -1 if the file cannot be read or contains an invalid line (`errno` is not meaningful).
+ */
+int ai_config_load(Ai_config *, char const *path);
+/**
+ * Write a configuration in the format read by `ai_config_load`.
+ * @returns 0 on success, -1 on failure.
+ */
+int ai_config_save(Ai_config const *, char const *path);
+
 /**
  * Allocate and initialize an Opponent_ai. Exits on failure.  
  * Caller owns the returned object and must call `ai_destroy` to correctly clean up.  
+ * @param config how the AI should play, or NULL for the default configuration. It is copied.
  * @returns a pointer to a valid instance of Opponent_ai.
  */
-Opponent_ai * ai_create(void);
+Opponent_ai * ai_create(Ai_config const *);
+/**
+ * @returns the size of the memory needed by `ai_init` for the configuration `config` (the AI's state and search
+ * scratch space), or for the default configuration if NULL. Only the endgame search (`Ai_config.endgame`) needs
+ * more than the base size, for its transposition table.
+ */
+size_t ai_size(Ai_config const *config);
+/**
+ * Initialize an Opponent_ai in caller-provided memory of at least `ai_size(config)` bytes, without allocating
+ * anything; there is nothing to clean up when done with it. Can also be used to reset an AI with a new
+ * configuration, as long as the memory is large enough for it.
+ * @returns `mem`, as an initialized Opponent_ai.
+ */
+Opponent_ai * ai_init(void *mem, Ai_config const *);
 /**
  * Deinitialize and deallocate an Opponent_ai, which must have been initialized by `ai_create`.  
  */
 void ai_destroy(Opponent_ai *);
 
+/** Number of candidate moves kept by `Ai_decision`. */
+#define AI_CANDIDATES_MAX 24
+
+/**
+ * A move considered by the AI for the next piece, and the score the search gave it.
+ */
+typedef struct Ai_candidate {
+    double score;
+    unsigned char type, rots;
+    int x;
+} Ai_candidate;
+
+/**
+ * The last choice of piece and placement made by an AI, with the best scoring alternatives it looked at.
+ */
+typedef struct Ai_decision {
+    /** Chosen piece type, clockwise rotations, and column of the piece's 4x4 grid. */
+    unsigned char type, rots;
+    int x;
+    /** Whether the move comes from the endgame search rather than from the heuristic one. */
+    int endgame;
+    /** Whether the move comes from the opening book (then nothing was searched, and there are no candidates). */
+    int book;
+    /** Top candidates of the heuristic search, best first (scores of `Ai_eval_Fixed` are divided by
+        `AI_FIXED_ONE`). */
+    int n_candidates;
+    Ai_candidate candidates[AI_CANDIDATES_MAX];
+} Ai_decision;
+
+/**
+ * Keep track of the best moves at the root of a search: insert this one in `d` if it is among the top
+ * `AI_CANDIDATES_MAX` so far. Ties keep the search order, like the choice of the best move does.
+ * @param rots clockwise rotations of `piece` from its initial shape.
+ */
+void ai_record_candidate(Ai_decision *d, double score, Piece const *piece, int rots);
+
+/**
+ * @returns a hash of what the moves of an opening book depend on in a configuration: the evaluation, the weights
+ * and the search depth. Books record it for the configuration they were built for (see `book_save`).
+ */
+unsigned long ai_config_book_hash(Ai_config const *);
+/**
+ * Have the AI look its positions up in an opening book before searching, and play the book's move when there is
+ * one that fits. The book must stay mapped while the AI uses it; NULL for none, as after `ai_init`.
+ * @returns 0 on success, -1 if the book was built for another configuration (the AI is then left without a book:
+ * the moves of the book would override its own choices).
+ */
+int ai_set_book(Opponent_ai *, Book const *);
+
+/**
+ * @returns the decision made by the last call to `ai_next_action` in `Game_state_Choose`.
+ */
+Ai_decision const * ai_last_decision(Opponent_ai const *);
+
+/**
+ * Given the current game state, return the next action the AI wants to perform as the current player.
+ * Works like `iohandler_next_action_1p`: call repeatedly until it stops yielding chainable actions.
+ */
 enum Game_action ai_next_action(Opponent_ai *, Game const *);
 
 
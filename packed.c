@@ -0,0 +1,97 @@
+/**
+ * @file packed.c
+ * @author Maksim Kovalkov
+ */
+
+#include <string.h>
+
+#include "tetris.h"
+
+#include "packed.h"
+
+/* fails to compile if the fields and the padding do not add up */
+typedef char packed_game_size_check[sizeof (Packed_game) == PACKED_GAME_SIZE ? 1 : -1];
+
+static int has_piece(enum Game_state);
+
+/**
+ * @returns whether the active piece is part of the state, in the given state.
+ */
+int
+has_piece(enum Game_state state)
+{
+    return state == Game_state_Place || state == Game_state_Lose;
+}
+
+void
+packed_from_game(Packed_game *pg, Game const *game)
+{
+    int pl, y, i;
+
+    memset(pg, 0, sizeof *pg);
+    for (pl = 0; pl < 2; ++pl) {
+        for (y = 0; y < BOARD_ROWS; ++y)
+            pg->rows[pl][y] = row_bits_pack(game->board[pl][y]);
+        pg->score[pl] = (unsigned short) game->score[pl];
+    }
+    for (i = 0; i < 4; ++i) {
+        pg->rng[4*i]     = (unsigned char) (game->rng.s[i] >> 24 & 0xff);
+        pg->rng[4*i + 1] = (unsigned char) (game->rng.s[i] >> 16 & 0xff);
+        pg->rng[4*i + 2] = (unsigned char) (game->rng.s[i] >> 8 & 0xff);
+        pg->rng[4*i + 3] = (unsigned char) (game->rng.s[i] & 0xff);
+    }
+    memcpy(pg->pieces_left, game->pieces_left, sizeof pg->pieces_left);
+    pg->kind = (unsigned char) game->kind;
+    pg->state = (unsigned char) game->state;
+    pg->current_player = (unsigned char) game->current_player;
+    pg->lines_cleared = (unsigned char) game->lines_cleared;
+
+    if (has_piece(game->state)) {
+        Piece p;
+        p.type = game->active_piece.type;
+        init_piece_shape(&p);
+        /* the shape is always the initial one rotated some number of times, and some rotation must match */
+        for (i = 0; i < 3 && memcmp(p.shape, game->active_piece.shape, sizeof p.shape) != 0; ++i)
+            rotate_shape_cw(p.shape);
+        pg->piece_type = game->active_piece.type;
+        pg->piece_rot = (unsigned char) i;
+        pg->piece_x = (signed char) game->active_piece.x;
+        pg->piece_y = (signed char) game->active_piece.y;
+    }
+}
+
+void
+packed_to_game(Game *game, Packed_game const *pg)
+{
+    int pl, y, x, i;
+
+    for (pl = 0; pl < 2; ++pl) {
+        for (y = 0; y < BOARD_ROWS; ++y) {
+            Row_bits const *const row = &pg->rows[pl][y];
+            unsigned char const block =
+                pg->state == Game_state_Cleared && row_bits_full(row) ? Block_type_Clear : PACKED_BLOCK;
+            for (x = 0; x < BOARD_COLS; ++x)
+                game->board[pl][y][x] = row_bits_test(row, x) ? block : Block_type_Empty;
+        }
+        game->score[pl] = pg->score[pl];
+    }
+    for (i = 0; i < 4; ++i) {
+        game->rng.s[i] = (unsigned long) pg->rng[4*i] << 24 | (unsigned long) pg->rng[4*i + 1] << 16
+                       | (unsigned long) pg->rng[4*i + 2] << 8 | pg->rng[4*i + 3];
+    }
+    memcpy(game->pieces_left, pg->pieces_left, sizeof game->pieces_left);
+    game->kind = (enum Game_kind) pg->kind;
+    game->state = (enum Game_state) pg->state;
+    game->current_player = pg->current_player;
+    game->lines_cleared = pg->lines_cleared;
+
+    memset(&game->active_piece, 0, sizeof game->active_piece);
+    if (pg->piece_type) {
+        game->active_piece.type = pg->piece_type;
+        init_piece_shape(&game->active_piece);
+        for (i = 0; i < pg->piece_rot; ++i)
+            rotate_shape_cw(game->active_piece.shape);
+        game->active_piece.x = pg->piece_x;
+        game->active_piece.y = pg->piece_y;
+    }
+}
@@ -0,0 +1,52 @@
+/**
+ * @file packed.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_PACKED_H
+#define XTETRIS_PACKED_H
+
+#include "tetris.h"
+
+/** Bytes of a `Packed_game` actually used by its fields; the rest is padding. */
+#define PACKED_GAME_USED (2 * sizeof (Row_bits) * BOARD_ROWS + 2 * 2 + 16 + 7 + 4 + 4)
+
+/**
+ * Size of a `Packed_game`: whole cache lines (two on the 15x10 board), so that arrays of them allocated from an
+ * arena stay aligned.
+ */
+#define PACKED_GAME_SIZE ((PACKED_GAME_USED / 64 + 1) * 64)
+
+/**
+ * The whole game state in `PACKED_GAME_SIZE` bytes, for search and simulation code that copies states around a lot.
+ * Converting from and to a `Game` is exact, except for:
+ * - block colours: every block of an unpacked board has type `PACKED_BLOCK` (full rows are unpacked as
+ *   `Block_type_Clear` in `Game_state_Cleared`, which is the only state where the board has any);
+ * - the active piece, which only means something in `Game_state_Place` and `Game_state_Lose` and is only kept there.
+ */
+typedef struct Packed_game {
+    /** One bitboard per board row. */
+    Row_bits rows[2][BOARD_ROWS];
+    unsigned short score[2];
+    /** RNG state, each word big-endian. */
+    unsigned char rng[16];
+    unsigned char pieces_left[7];
+    unsigned char kind, state, current_player, lines_cleared;
+    /** Active piece: type (0 if none), number of clockwise rotations from the initial shape, position. */
+    unsigned char piece_type, piece_rot;
+    signed char piece_x, piece_y;
+    unsigned char pad[PACKED_GAME_SIZE - PACKED_GAME_USED];
+} Packed_game;
+
+/** Block type given to every block of an unpacked board. */
+#define PACKED_BLOCK Tetrimino_type_O
+
+/**
+ * Pack the state of `game`.
+ */
+void packed_from_game(Packed_game *, Game const *);
+/**
+ * Unpack a state into `game`, which can then be played on or drawn (with the caveats of `Packed_game`).
+ */
+void packed_to_game(Game *, Packed_game const *);
+#endif /* ifndef XTETRIS_PACKED_H */
@@ -0,0 +1,23 @@
+/**
+ * @file platform.h
+ * @author Maksim Kovalkov
+ *
+ * Optional use of operating system facilities by the core. The game itself only needs the C standard library; where
+ * POSIX is available, a few modules use it for speed (e.g. memory mapping files instead of reading them), and fall
+ * back to standard C elsewhere, or when built with `-DXTETRIS_NO_POSIX`.
+ *
+ * Must be included before any system header, since it may select the POSIX feature level.
+ */
+
+#ifndef XTETRIS_PLATFORM_H
+#define XTETRIS_PLATFORM_H
+
+#if !defined(XTETRIS_NO_POSIX) && (defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__)))
+/** Defined if POSIX interfaces can be used. */
+#define XTETRIS_HAVE_POSIX 1
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
+#endif /* ifndef XTETRIS_PLATFORM_H */
@@ -0,0 +1,175 @@
+/**
+ * @file realtime.c
+ * @author Maksim Kovalkov
+ */
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef XTETRIS_HAVE_POSIX
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "realtime.h"
+
+/**
+ * Sleeping in `poll` only has a resolution of a millisecond, and the system may oversleep on top of that: the
+ * scheduler sleeps until `spin_ms` before the deadline, then spins on the clock for the rest. `spin_ms` follows
+ * twice the average oversleep seen so far, within these bounds.
+ */
+#define SPIN_MIN_MS 0.5
+#define SPIN_MAX_MS 4.0
+
+/** Ticks per row at each gravity level (at 60 ticks per second, from 0.8 s per row down to one row per tick). */
+static int const ticks_per_row[RT_LEVELS] = { 48, 43, 38, 33, 28, 23, 18, 13, 8, 6, 5, 4, 3, 2, 1 };
+
+static double now_ms(void);
+
+/**
+ * Monotonic time in milliseconds, from an arbitrary origin. Without POSIX, processor time is the best standard C
+ * offers, which does not advance while waiting: the real-time mode is unavailable then.
+ */
+double
+now_ms(void)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+#else
+    return (double) clock() * 1e3 / CLOCKS_PER_SEC;
+#endif
+}
+
+int
+rt_supported(void)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void
+rt_init(Rt_scheduler *rt, double tick_ms, double budget_ms)
+{
+    rt->tick_ms = tick_ms;
+    rt->budget_ms = budget_ms;
+    rt->start = rt->tick_start = now_ms();
+    rt->next = rt->start + tick_ms;
+    rt->spin_ms = SPIN_MAX_MS / 2;
+    rt->oversleep_ms = 0;
+    rt->input_ended = 0;
+    rt->ticks = rt->missed = rt->overruns = 0;
+    rt->total_lateness_ms = rt->max_lateness_ms = rt->max_work_ms = 0;
+}
+
+size_t
+rt_wait(Rt_scheduler *rt, unsigned char *keys, size_t cap)
+{
+    size_t n = 0;
+
+    for (;;) {
+        double const now = now_ms();
+        double late;
+
+        if (now < rt->next) {
+#ifdef XTETRIS_HAVE_POSIX
+            int const sleep_ms = (int) (rt->next - now - rt->spin_ms);
+            struct pollfd pfd;
+            int ready;
+
+            if (sleep_ms < 1)
+                continue;
+            pfd.fd = STDIN_FILENO;
+            pfd.events = POLLIN;
+            /* once input is over or the buffer is full, the poll is only a sleep */
+            ready = poll(&pfd, n < cap && !rt->input_ended, sleep_ms);
+            if (ready == 0) {
+                /* slept the whole time: learn how much longer than asked */
+                double const over = now_ms() - now - sleep_ms;
+                rt->oversleep_ms += (over - rt->oversleep_ms) / 8;
+                rt->spin_ms = 2 * rt->oversleep_ms;
+                if (rt->spin_ms < SPIN_MIN_MS)
+                    rt->spin_ms = SPIN_MIN_MS;
+                else if (rt->spin_ms > SPIN_MAX_MS)
+                    rt->spin_ms = SPIN_MAX_MS;
+            } else if (ready > 0) {
+                ssize_t const r = read(STDIN_FILENO, keys + n, cap - n);
+                if (r > 0)
+                    n += (size_t) r;
+                else if (r == 0 || errno != EINTR)
+                    rt->input_ended = 1;
+            }
+#else
+            (void) keys;
+            (void) cap;
+#endif
+            continue;
+        }
+
+        /* the tick is due: if whole ticks went by meanwhile, skip them rather than running late forever */
+        late = now - rt->next;
+        if (late >= rt->tick_ms) {
+            unsigned long const skipped = (unsigned long) (late / rt->tick_ms);
+            rt->missed += skipped;
+            rt->next += skipped * rt->tick_ms;
+            late -= skipped * rt->tick_ms;
+        }
+        rt->total_lateness_ms += late;
+        if (late > rt->max_lateness_ms)
+            rt->max_lateness_ms = late;
+        rt->next += rt->tick_ms;
+        rt->tick_start = now;
+        ++rt->ticks;
+        return n;
+    }
+}
+
+int
+rt_end_tick(Rt_scheduler *rt)
+{
+    double const work = now_ms() - rt->tick_start;
+
+    if (work > rt->max_work_ms)
+        rt->max_work_ms = work;
+    if (work > rt->budget_ms) {
+        ++rt->overruns;
+        return 1;
+    }
+    return 0;
+}
+
+double
+rt_elapsed_ms(Rt_scheduler const *rt)
+{
+    return now_ms() - rt->start;
+}
+
+int
+rt_level(double elapsed_ms)
+{
+    double const level = elapsed_ms / (RT_LEVEL_SECONDS * 1e3);
+    return level >= RT_LEVELS - 1 ? RT_LEVELS - 1 : (int) level;
+}
+
+int
+rt_ticks_per_row(int level)
+{
+    return ticks_per_row[level < 0 ? 0 : level >= RT_LEVELS ? RT_LEVELS - 1 : level];
+}
+
+void
+rt_report(Rt_scheduler const *rt, FILE *f)
+{
+    fprintf(f, "real-time: %lu ticks of %.1f ms, %lu missed; lateness mean %.3f ms, max %.3f ms\n", rt->ticks,
+            rt->tick_ms, rt->missed, rt->ticks ? rt->total_lateness_ms / rt->ticks : 0, rt->max_lateness_ms);
+    fprintf(f, "real-time: %lu ticks over the %.1f ms budget, longest %.3f ms\n", rt->overruns, rt->budget_ms,
+            rt->max_work_ms);
+}
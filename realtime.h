@@ -0,0 +1,83 @@
+/**
+ * @file realtime.h
+ * @author Maksim Kovalkov
+ *
+ * Fixed timestep scheduler for the real-time mode, where pieces fall on their own.
+ *
+ * The game advances in ticks of constant length, due at fixed points of a monotonic clock (not one tick length after
+ * the previous one ended, so that small delays do not accumulate). Between ticks the scheduler waits on standard
+ * input without blocking past the next deadline, collecting whatever is typed meanwhile; the caller applies it at
+ * the start of the tick, so all the work of a tick (input, gravity, the AI, drawing) happens in one place and can be
+ * measured against a latency budget. Ticks that could not start in time at all are skipped and counted as missed.
+ *
+ * Needs POSIX (`poll` and a monotonic clock): see `rt_supported`.
+ */
+
+#ifndef XTETRIS_REALTIME_H
+#define XTETRIS_REALTIME_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/** 60 ticks per second. */
+#define RT_TICK_MS (1000.0 / 60)
+/** Seconds between gravity levels. */
+#define RT_LEVEL_SECONDS 30
+/** Number of gravity levels; the last one lasts until the end of the game. */
+#define RT_LEVELS 15
+
+typedef struct Rt_scheduler {
+    double tick_ms, budget_ms;
+    /** Start of the first tick and deadline of the next one, in milliseconds of the monotonic clock. */
+    double start, next;
+    /** When the current tick actually started. */
+    double tick_start;
+    /** Frame pacing: how long before a deadline to stop sleeping and spin, from the average oversleep. */
+    double spin_ms, oversleep_ms;
+    /** Set once standard input has reached end of file (or failed). */
+    int input_ended;
+
+    /* instrumentation */
+    unsigned long ticks, missed, overruns;
+    /** How late ticks started after their deadline (the jitter of the pacing). */
+    double total_lateness_ms, max_lateness_ms;
+    /** Longest tick, from its start to `rt_end_tick`. */
+    double max_work_ms;
+} Rt_scheduler;
+
+/**
+ * @returns whether the real-time mode is available on this platform.
+ */
+int rt_supported(void);
+/**
+ * Start the clock: the first tick is due one tick from now.
+ */
+void rt_init(Rt_scheduler *, double tick_ms, double budget_ms);
+/**
+ * Wait until the next tick is due, reading from standard input whatever arrives meanwhile into `keys` (up to `cap`
+ * bytes; anything more is left for the next tick).
+ * @returns the number of bytes read.
+ */
+size_t rt_wait(Rt_scheduler *, unsigned char *keys, size_t cap);
+/**
+ * Mark the end of the work of the current tick, and check it against the budget.
+ * @returns 1 if the tick went over budget, 0 otherwise.
+ */
+int rt_end_tick(Rt_scheduler *);
+/**
+ * @returns the time since `rt_init`, in milliseconds.
+ */
+double rt_elapsed_ms(Rt_scheduler const *);
+/**
+ * @returns the gravity level after `elapsed_ms` of play, from 0 to `RT_LEVELS - 1`.
+ */
+int rt_level(double elapsed_ms);
+/**
+ * @returns the number of ticks the falling piece stays on a row at a gravity level.
+ */
+int rt_ticks_per_row(int level);
+/**
+ * Print the instrumentation: ticks, missed deadlines, jitter and ticks over budget.
+ */
+void rt_report(Rt_scheduler const *, FILE *);
+#endif /* ifndef XTETRIS_REALTIME_H */
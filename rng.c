@@ -0,0 +1,96 @@
+/**
+ * @file rng.c
+ * @author Maksim Kovalkov
+ */
+
+#include "rng.h"
+
+#define MASK32 0xffffffffUL
+#define ROTL32(x, k) ((((x) << (k)) | ((x) >> (32 - (k)))) & MASK32)
+
+static unsigned long mix32(unsigned long);
+
+/**
+ * Integer hash used to expand a single seed into the full generator state ("lowbias32", by C. Wellons).
+ */
+unsigned long
+mix32(unsigned long x)
+{
+    x &= MASK32;
+    x ^= x >> 16;
+    x = (x * 0x7feb352dUL) & MASK32;
+    x ^= x >> 15;
+    x = (x * 0x846ca68bUL) & MASK32;
+    x ^= x >> 16;
+    return x;
+}
+
+void
+rng_seed(Rng *rng, unsigned long seed)
+{
+    int i;
+    for (i = 0; i < 4; ++i) {
+        seed = (seed + 0x9e3779b9UL) & MASK32;
+        rng->s[i] = mix32(seed);
+    }
+    /* the all-zero state is the only one the generator cannot escape from */
+    if (!(rng->s[0] | rng->s[1] | rng->s[2] | rng->s[3]))
+        rng->s[0] = 1;
+}
+
+unsigned long
+rng_next(Rng *rng)
+{
+    unsigned long *const s = rng->s;
+    unsigned long const result = (ROTL32((s[1] * 5) & MASK32, 7) * 9) & MASK32;
+    unsigned long const t = (s[1] << 9) & MASK32;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = ROTL32(s[3], 11);
+
+    return result;
+}
+
+unsigned long
+rng_below(Rng *rng, unsigned long n)
+{
+    /* reject the incomplete last "bucket" of outputs, so that every residue is equally likely */
+    unsigned long const limit = MASK32 - (MASK32 % n + 1) % n;
+    unsigned long r;
+
+    do {
+        r = rng_next(rng);
+    } while (r > limit);
+    return r % n;
+}
+
+void
+rng_split(Rng *parent, Rng *child)
+{
+    /* jump polynomial for 2^64 steps, from the reference implementation */
+    static unsigned long const jump[] = { 0x8764000bUL, 0xf542d2d3UL, 0x6fa035c3UL, 0x77f2db5bUL };
+    unsigned long s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i, b;
+
+    *child = *parent;
+
+    for (i = 0; i < 4; ++i) {
+        for (b = 0; b < 32; ++b) {
+            if (jump[i] & (1UL << b)) {
+                s0 ^= parent->s[0];
+                s1 ^= parent->s[1];
+                s2 ^= parent->s[2];
+                s3 ^= parent->s[3];
+            }
+            rng_next(parent);
+        }
+    }
+    parent->s[0] = s0;
+    parent->s[1] = s1;
+    parent->s[2] = s2;
+    parent->s[3] = s3;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file rng.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_RNG_H
+#define XTETRIS_RNG_H
+
+/**
+ * State of a xoshiro128** pseudo-random generator.
+ * Each word only ever holds 32 significant bits (`unsigned long` is the only type that C89 guarantees to be wide
+ * enough), so the output sequence is the same on every platform.
+ * The state is a plain value: copying it forks the sequence, and it can be stored inside a `Game` so that each game
+ * is reproducible on its own, independently of every other game running in the same process.
+ */
+typedef struct Rng {
+    unsigned long s[4];
+} Rng;
+
+/**
+ * Initialize the generator from a seed. Equal seeds always produce equal sequences.
+ */
+void rng_seed(Rng *, unsigned long seed);
+/**
+ * Advance the generator.
+ * @returns the next 32-bit output, in the range [0, 2^32).
+ */
+unsigned long rng_next(Rng *);
+/**
+ * @returns an unbiased value in the range [0, n). `n` must be nonzero.
+ */
+unsigned long rng_below(Rng *, unsigned long n);
+/**
+ * Split off an independent stream for a parallel worker: `child` takes over the current sequence of `parent`,
+ * and `parent` jumps 2^64 steps ahead so that the two never overlap.
+ * Calling this repeatedly on the same parent hands out consecutive non-overlapping streams.
+ */
+void rng_split(Rng *parent, Rng *child);
+#endif /* ifndef XTETRIS_RNG_H */
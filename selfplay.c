@@ -0,0 +1,104 @@
+/**
+ * @file selfplay.c
+ * @author Maksim Kovalkov
+ */
+
+#include <string.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+
+#include "selfplay.h"
+
+static int game_over(Game const *);
+
+/**
+ * @returns whether the game has reached one of its final states.
+ */
+int
+game_over(Game const *game)
+{
+    return game->state == Game_state_Win || game->state == Game_state_Lose;
+}
+
+void
+selfplay_random_opening(Game *game, int moves)
+{
+    while (moves > 0 && !game_over(game)) {
+        int i, available = 0, shift;
+
+        switch (game->state) {
+        case Game_state_Choose:
+            for (i = 0; i < 7; ++i)
+                available += game->pieces_left[i] != 0;
+            available = (int) rng_below(&game->rng, available);
+            for (i = 0; !game->pieces_left[i] || available--; ++i) /* nop */;
+            do_game_step(game, (enum Game_action) (Game_action_Choose_I + i));
+            break;
+        case Game_state_Place:
+            for (i = (int) rng_below(&game->rng, 4); i > 0; --i)
+                do_game_step(game, Game_action_Rotate);
+            shift = (int) rng_below(&game->rng, BOARD_COLS) - BOARD_COLS / 2;
+            for (; shift < 0; ++shift)
+                do_game_step(game, Game_action_Left);
+            for (; shift > 0; --shift)
+                do_game_step(game, Game_action_Right);
+            do_game_step(game, Game_action_Drop);
+            --moves;
+            break;
+        case Game_state_Cleared:
+            do_game_step(game, Game_action_Finish_clearing);
+            break;
+        default: break;
+        }
+    }
+}
+
+void
+selfplay_run(Game *game, Opponent_ai *const players[2], Selfplay_clock clock, Selfplay_result *result)
+{
+    int placed[2];
+    double seconds[2];
+
+    placed[0] = placed[1] = 0;
+    seconds[0] = seconds[1] = 0;
+    while (!game_over(game)) {
+        int const player = game->current_player;
+        enum Game_action act;
+
+        /* the whole search happens when the piece is chosen; the following actions just replay its result */
+        if (clock && game->state == Game_state_Choose) {
+            double const start = clock();
+            act = ai_next_action(players[player], game);
+            seconds[player] += clock() - start;
+        } else {
+            act = ai_next_action(players[player], game);
+        }
+
+        if (act == Game_action_Drop)
+            ++placed[player];
+        do_game_step(game, act);
+    }
+
+    result->score[0] = game->score[0];
+    result->score[1] = game->score[1];
+    result->moves[0] = placed[0];
+    result->moves[1] = placed[1];
+    result->decision_seconds[0] = seconds[0];
+    result->decision_seconds[1] = seconds[1];
+
+    result->winner = selfplay_winner(game);
+}
+
+int
+selfplay_winner(Game const *game)
+{
+    if (game->kind == Game_kind_Singleplayer)
+        return game->state == Game_state_Win ? 0 : -1;
+    if (game->state == Game_state_Lose)
+        /* the player who could not place a piece is still the current one */
+        return !game->current_player;
+    if (game->score[0] != game->score[1])
+        return game->score[0] > game->score[1] ? 0 : 1;
+    return -1;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file selfplay.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_SELFPLAY_H
+#define XTETRIS_SELFPLAY_H
+
+#include "tetris.h"
+#include "opponentai.h"
+
+/**
+ * Outcome of a game played without any I/O.
+ */
+typedef struct Selfplay_result {
+    /** Final scores of both players. */
+    int score[2];
+    /** Pieces placed by each player during `selfplay_run`. */
+    int moves[2];
+    /** Time each player spent choosing a piece and its placement, as measured by the clock given to `selfplay_run`. */
+    double decision_seconds[2];
+    /**
+     * Index of the winning player, or -1 for a tie.  
+     * In single player, 0 if every piece was placed and -1 if the board filled up.
+     */
+    int winner;
+} Selfplay_result;
+
+/**
+ * Place `moves` pieces at random (random type, rotation and column), alternating players as usual.  
+ * Used to start games from varied positions: every random choice comes from the game's own RNG, so the opening
+ * is determined by the seed given to `game_init`. Stops early if the game ends.
+ */
+void selfplay_random_opening(Game *, int moves);
+/**
+ * A clock used to measure the time spent by each player: any monotonic time source in seconds (e.g. CPU time of the
+ * calling thread). Only differences between readings are used.
+ */
+typedef double (*Selfplay_clock)(void);
+
+/**
+ * Play the game until it ends, letting `players[i]` make every decision for player `i`.  
+ * In single player only `players[0]` is used. The same AI may be passed for both players.  
+ * If `clock` is not NULL, it is read around every decision; otherwise `decision_seconds` are left at 0.
+ */
+void selfplay_run(Game *, Opponent_ai *const players[2], Selfplay_clock clock, Selfplay_result *);
+/**
+ * @returns the winner of a finished game, as in `Selfplay_result`.
+ */
+int selfplay_winner(Game const *);
+#endif /* ifndef XTETRIS_SELFPLAY_H */
@@ -0,0 +1,229 @@
+/**
+ * @file spectate.c
+ * @author Maksim Kovalkov
+ */
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef XTETRIS_HAVE_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "tetris.h"
+#include "delta.h"
+#include "util.h"
+#include "spectate.h"
+
+#define SPECTATE_MAGIC "XTSPEC1"
+
+/**
+ * Orders the memory accesses before it against those after it, for the compiler and the processor, so that the
+ * sequence numbers of a slot are seen around its contents. Without GCC builtins, volatile accesses are all there is.
+ */
+#ifdef __GNUC__
+#define BARRIER() __sync_synchronize()
+#else
+#define BARRIER() ((void) 0)
+#endif
+
+typedef struct Spectate_slot {
+    /** `2*seq + 1` while frame number `seq` is being written, `2*seq + 2` once it is complete. */
+    volatile unsigned long lock;
+    unsigned short len;
+    unsigned char data[DELTA_MAX_LEN];
+} Spectate_slot;
+
+/** Layout of the broadcast file. */
+struct Spectate_ring {
+    /** Written last, once the rest of the header is valid. */
+    char magic[8];
+    unsigned short board_rows, board_cols, slots;
+    /** Size of the whole ring, to tell builds with a different layout apart. */
+    unsigned long size;
+    /** Frames published so far. */
+    volatile unsigned long head;
+    /** Sequence number of the latest keyframe, meaningful once `head` is not 0. */
+    volatile unsigned long keyframe;
+    Spectate_slot slot[SPECTATE_SLOTS];
+};
+
+static void copy_frame(Spectate_slot const *, unsigned char *, size_t *);
+
+int
+spectate_supported(void)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int
+spectate_open(Spectate_writer *w, char const *path)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    Spectate_ring *ring;
+    void *p;
+    int fd;
+
+    /* a new file, rather than truncating the old one under the feet of its readers */
+    unlink(path);
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -1;
+    if (ftruncate(fd, sizeof *ring) != 0) {
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, sizeof *ring, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    ring = p;
+    ring->board_rows = BOARD_ROWS;
+    ring->board_cols = BOARD_COLS;
+    ring->slots = SPECTATE_SLOTS;
+    ring->size = sizeof *ring;
+    ring->head = ring->keyframe = 0;
+    BARRIER();
+    memcpy(ring->magic, SPECTATE_MAGIC, sizeof ring->magic);
+    w->ring = ring;
+    w->seq = 0;
+    return 0;
+#else
+    (void) w;
+    (void) path;
+    return -1;
+#endif
+}
+
+void
+spectate_publish(Spectate_writer *w, Game const *game)
+{
+    Spectate_ring *const ring = w->ring;
+    Spectate_slot *const slot = &ring->slot[w->seq % SPECTATE_SLOTS];
+    int const key = w->seq % SPECTATE_KEYFRAME_EVERY == 0;
+    unsigned char buf[DELTA_MAX_LEN];
+    size_t const len = delta_encode(key ? NULL : &w->last, game, buf);
+
+    /* just the header: nothing visible changed */
+    if (!key && len == 1)
+        return;
+
+    slot->lock = 2 * w->seq + 1;
+    BARRIER();
+    slot->len = (unsigned short) len;
+    memcpy(slot->data, buf, len);
+    BARRIER();
+    slot->lock = 2 * w->seq + 2;
+    BARRIER();
+    if (key)
+        ring->keyframe = w->seq;
+    ring->head = w->seq + 1;
+
+    w->last = *game;
+    ++w->seq;
+}
+
+void
+spectate_close(Spectate_writer *w)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    if (w->ring)
+        munmap((void *) w->ring, sizeof *w->ring);
+#endif
+    w->ring = NULL;
+}
+
+int
+spectate_attach(Spectate_reader *r, char const *path)
+{
+    Spectate_ring const *ring;
+
+    if (!spectate_supported() || map_file(&r->file, path) != 0)
+        return -1;
+    ring = r->file.data;
+    if (r->file.size != sizeof *ring || memcmp(ring->magic, SPECTATE_MAGIC, sizeof ring->magic) != 0
+        || ring->size != sizeof *ring || ring->board_rows != BOARD_ROWS || ring->board_cols != BOARD_COLS
+        || ring->slots != SPECTATE_SLOTS) {
+        unmap_file(&r->file);
+        return -1;
+    }
+    r->ring = ring;
+    r->next = 0;
+    r->synced = 0;
+    r->skips = 0;
+    return 0;
+}
+
+/**
+ * Copy the contents of a slot, as they are; whether they are consistent is for the caller to check.
+ */
+void
+copy_frame(Spectate_slot const *slot, unsigned char *buf, size_t *len)
+{
+    *len = slot->len;
+    if (*len > DELTA_MAX_LEN)
+        *len = DELTA_MAX_LEN;
+    memcpy(buf, slot->data, *len);
+}
+
+int
+spectate_next(Spectate_reader *r, Game *game)
+{
+    Spectate_ring const *const ring = r->ring;
+    unsigned char buf[DELTA_MAX_LEN];
+
+    for (;;) {
+        unsigned long const head = ring->head;
+        Spectate_slot const *slot;
+        unsigned long seq, lock;
+        size_t len;
+        int valid;
+
+        BARRIER();
+        if (!head)
+            return 0;
+        if (r->synced && head - r->next >= SPECTATE_SLOTS) {
+            /* the next frame has already been overwritten */
+            r->synced = 0;
+            ++r->skips;
+        }
+        seq = r->synced ? r->next : ring->keyframe;
+        if (seq >= head)
+            return 0;
+
+        slot = &ring->slot[seq % SPECTATE_SLOTS];
+        lock = slot->lock;
+        BARRIER();
+        copy_frame(slot, buf, &len);
+        BARRIER();
+        valid = lock == 2 * seq + 2 && slot->lock == lock && len > 0;
+        if (!valid || (!r->synced && !(buf[0] & DELTA_KEYFRAME))) {
+            /* overwritten while we were reading it: we are behind, start again from the latest keyframe */
+            if (r->synced)
+                ++r->skips;
+            r->synced = 0;
+            continue;
+        }
+
+        if (delta_apply(game, buf, len) != 0)
+            return -1;
+        r->next = seq + 1;
+        r->synced = 1;
+        return 1;
+    }
+}
+
+void
+spectate_detach(Spectate_reader *r)
+{
+    unmap_file(&r->file);
+    r->ring = NULL;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file spectate.h
+ * @author Maksim Kovalkov
+ *
+ * Broadcast of a running game to any number of local spectators, through a ring of frames in a memory mapped file.
+ *
+ * The game publishes its visible state as delta frames (see delta.h), with a keyframe every
+ * `SPECTATE_KEYFRAME_EVERY` frames. Publishing never waits for anyone: the writer simply overwrites the oldest
+ * slot. Each slot is guarded by a sequence number, written before and after its contents, which lets readers detect
+ * a frame that was overwritten while they were copying it; readers never write to the file, so there can be as
+ * many as wanted. A reader that falls more than a ring behind cannot apply the deltas it missed: it skips ahead to
+ * the latest keyframe instead.
+ *
+ * Needs POSIX (memory mapping): see `spectate_supported`. Writer and readers must come from the same build.
+ */
+
+#ifndef XTETRIS_SPECTATE_H
+#define XTETRIS_SPECTATE_H
+
+#include <stddef.h>
+
+#include "tetris.h"
+#include "delta.h"
+#include "util.h"
+
+#define SPECTATE_DEFAULT_PATH "/tmp/x-tetris.spectate"
+/** Frames kept in the ring. */
+#define SPECTATE_SLOTS 256
+/** Frames between keyframes; well below `SPECTATE_SLOTS`, so that the latest keyframe is always in the ring. */
+#define SPECTATE_KEYFRAME_EVERY 64
+
+typedef struct Spectate_ring Spectate_ring;
+
+typedef struct Spectate_writer {
+    Spectate_ring *ring;
+    /** The state the next delta is computed against. */
+    Game last;
+    /** Frames published so far, i.e. the sequence number of the next one. */
+    unsigned long seq;
+} Spectate_writer;
+
+typedef struct Spectate_reader {
+    Mapped_file file;
+    Spectate_ring const *ring;
+    /** Sequence number of the next frame to apply. */
+    unsigned long next;
+    /** Set once a keyframe has been applied, so that deltas can follow. */
+    int synced;
+    /** Times the reader fell behind and skipped ahead to a keyframe. */
+    unsigned long skips;
+} Spectate_reader;
+
+/**
+ * @returns whether broadcasting is available on this platform.
+ */
+int spectate_supported(void);
+/**
+ * Create (or replace) the broadcast file at `path` and map it.
+ * @returns 0 on success, -1 on failure.
+ */
+int spectate_open(Spectate_writer *, char const *path);
+/**
+ * Publish the visible state of `game`, if it changed since the last call.
+ */
+void spectate_publish(Spectate_writer *, Game const *);
+/**
+ * Unmap the broadcast file; readers keep seeing the last frames until they close it too.
+ */
+void spectate_close(Spectate_writer *);
+/**
+ * Map an existing broadcast file.
+ * @returns 0 on success, -1 if it cannot be opened or was not written by a compatible build.
+ */
+int spectate_attach(Spectate_reader *, char const *path);
+/**
+ * Apply to `game` the next published frame, if any. The first frame applied is always a keyframe, and so is the
+ * first one after falling behind.
+ * @returns 1 if a frame was applied, 0 if there is nothing new, -1 if a frame could not be decoded.
+ */
+int spectate_next(Spectate_reader *, Game *);
+/**
+ * Unmap the broadcast file.
+ */
+void spectate_detach(Spectate_reader *);
+#endif /* ifndef XTETRIS_SPECTATE_H */
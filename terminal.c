@@ -0,0 +1,74 @@
+/**
+ * @file terminal.c
+ * @author Maksim Kovalkov
+ */
+
+#include "platform.h"
+
+#include <stddef.h>
+
+#ifdef XTETRIS_HAVE_POSIX
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#include "terminal.h"
+
+#ifdef XTETRIS_HAVE_POSIX
+/** Settings to restore, valid if `saved` is set. */
+static struct termios saved_termios;
+static volatile sig_atomic_t saved = 0;
+
+static void on_signal(int);
+
+/**
+ * Restore the terminal, then die of the signal as if it had not been caught (tcsetattr is async-signal-safe).
+ */
+void
+on_signal(int sig)
+{
+    if (saved)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+#endif
+
+int
+terminal_raw(void)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    struct termios raw;
+
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_termios) != 0)
+        return -1;
+    raw = saved_termios;
+    /* no line editing and no echo, one byte at a time as soon as it is typed; ^C and friends still work */
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    saved = 1;
+    signal(SIGINT, &on_signal);
+    signal(SIGTERM, &on_signal);
+    signal(SIGQUIT, &on_signal);
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        saved = 0;
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void
+terminal_restore(void)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    if (saved) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+        saved = 0;
+    }
+#endif
+}
@@ -0,0 +1,23 @@
+/**
+ * @file terminal.h
+ * @author Maksim Kovalkov
+ *
+ * Optional per-keystroke input: switches the terminal on standard input out of line-buffered ("canonical") mode,
+ * so that every key reaches the game the moment it is pressed, without echo. Needs POSIX termios (see platform.h);
+ * the line-buffered input of the standard library stays the portable default.
+ */
+
+#ifndef XTETRIS_TERMINAL_H
+#define XTETRIS_TERMINAL_H
+
+/**
+ * Put the terminal in raw mode, remembering its settings for `terminal_restore`. Interrupt keys keep working:
+ * the terminal is restored before the process dies of `SIGINT`, `SIGTERM` or `SIGQUIT`.
+ * @returns 0 on success, -1 if standard input is not a terminal or the platform has no termios.
+ */
+int terminal_raw(void);
+/**
+ * Give the terminal back the settings it had before `terminal_raw`. Does nothing if it was not called, or failed.
+ */
+void terminal_restore(void);
+#endif /* ifndef XTETRIS_TERMINAL_H */
@@ -8,23 +8,36 @@
  * See @link md_README the README page. @endlink
  * 
  * @section files_sec Documentation per file
+ * @li main.c
  * @li tetris.c
+ * @li xtetris.h
  * @li iohandler.c
  * @li opponentai.c
  * @li constants.h
  * @li util.h
+ * @li rng.h
+ * @li selfplay.h
+ * @li gamectx.h
+ * @li delta.h
+ * @li packed.h
+ * @li trainlog.h
+ * @li platform.h
+ * @li realtime.h
+ * @li terminal.h
+ * @li spectate.h
+ * @li match.h
+ * @li checkpoint.h
+ * @li book.h
+ * @li aibatch.h
  * 
  */
 #include <assert.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "constants.h"
 #include "tetris.h"
-#include "iohandler.h"
-#include "opponentai.h"
 
 /* ------ Function prototypes ------ */
 
@@ -32,21 +45,15 @@ static void handle_right(Game *);
 static void handle_left(Game *);
 static void handle_rotate(Game *);
 static int check_win_condition(Game *);
-static int mark_cleared_lines(Board);
-static void remove_cleared_lines(Board);
-static int do_game_step(Game *, enum Game_action);
-static void draw(Game *, Io_handler *);
-static void atexit_fn(void);
 
 static void state_place_handler(Game *, enum Game_action);
 static void state_choose_handler(Game *, enum Game_action);
 static void state_cleared_handler(Game *);
 
 static int action_belongs_to_state(enum Game_action, enum Game_state);
-static int run_menu(char const * const *, int);
-
-static void game_init(Game *, enum Game_kind);
-static void game_loop(Game *, Io_handler *, Opponent_ai *);
+#ifndef ROW_BITS_WORDS
+static int piece_bits_fit(Piece_bits const *, Row_bits const *, int, int);
+#endif
 
 /* ------ Static data ------ */
 /**
@@ -99,10 +106,6 @@ static const Tetrimino_shape tetrimino_shapes[] = {
 };
 
 
-Game g_game;
-Io_handler *g_io_handler = NULL;
-Opponent_ai *g_opp_ai = NULL;
-
 
 /* ------ Functions ------ */
 
@@ -198,6 +201,151 @@ lift_piece(Piece *piece, const Board board)
     }
 }
 
+void
+add_garbage(Board board, int rows, Rng *rng)
+{
+    int i, j;
+
+    for (i = 0; i < rows && i < BOARD_ROWS; ++i) {
+        unsigned char *const row = board[BOARD_ROWS-1-i];
+        for (j = 0; j < BOARD_COLS; ++j) {
+            if (row[j]) 
+                row[j] = Block_type_Empty;
+            else
+                row[j] = Tetrimino_type_I + rng_below(rng, 7);
+        }
+    }
+}
+
+Row_bits
+row_bits_pack(unsigned char const *row)
+{
+    Row_bits bits;
+    int x;
+
+#ifdef ROW_BITS_WORDS
+    memset(&bits, 0, sizeof bits);
+    for (x = 0; x < BOARD_COLS; ++x)
+        if (row[x])
+            bits.word[x / 32] |= 1UL << x % 32;
+#else
+    bits = 0;
+    for (x = 0; x < BOARD_COLS; ++x)
+        bits |= (Row_bits) ((Row_bits) (row[x] != 0) << x);
+#endif
+    return bits;
+}
+
+int
+row_bits_test(Row_bits const *bits, int x)
+{
+#ifdef ROW_BITS_WORDS
+    return (int) (bits->word[x / 32] >> x % 32 & 1);
+#else
+    return (int) (*bits >> x & 1);
+#endif
+}
+
+int
+row_bits_full(Row_bits const *bits)
+{
+#ifdef ROW_BITS_WORDS
+    int i;
+
+    for (i = 0; i < ROW_BITS_WORDS - 1; ++i)
+        if ((bits->word[i] & 0xffffffffUL) != 0xffffffffUL)
+            return 0;
+    return (bits->word[i] & 0xffffffffUL) == 0xffffffffUL >> (32 * ROW_BITS_WORDS - BOARD_COLS);
+#else
+    return *bits == (Row_bits) (((Row_bits) 1 << (BOARD_COLS - 1)) * 2 - 1);
+#endif
+}
+
+#ifndef ROW_BITS_WORDS
+
+void
+row_bits_tops(Row_bits const board[BOARD_ROWS], int top[BOARD_COLS])
+{
+    Row_bits const full = (Row_bits) (((Row_bits) 1 << (BOARD_COLS - 1)) * 2 - 1);
+    Row_bits seen = 0;
+    int i, j;
+
+    for (j = 0; j < BOARD_COLS; ++j)
+        top[j] = BOARD_ROWS;
+    /* from the top down, until every column has been seen occupied */
+    for (i = 0; i < BOARD_ROWS && seen != full; ++i) {
+        Row_bits fresh = (Row_bits) (board[i] & ~seen);
+        seen |= board[i];
+        for (j = 0; fresh; ++j, fresh >>= 1)
+            if (fresh & 1)
+                top[j] = i;
+    }
+}
+
+void
+piece_bits_init(Piece_bits *s, Piece const *piece)
+{
+    int i, j;
+
+    memset(s, 0, sizeof *s);
+    s->left = 4;
+    s->right = -1;
+    for (i = 0; i < 4; ++i) {
+        for (j = 0; j < 4; ++j) {
+            if (!piece->shape[i][j])
+                continue;
+            s->rows[i] |= 1UL << j;
+            s->bottom[j] = i;
+            if (j < s->left)
+                s->left = j;
+            if (j > s->right)
+                s->right = j;
+        }
+    }
+    /* the first occupied row of the grid, among the first 3, goes to the top row */
+    for (i = 0; i < 3 && !s->rows[i]; ++i)
+        --s->lift;
+}
+
+/**
+ * @returns whether a piece fits at row `y` and column `x`, as `!collides`; it must be within the walls.
+ */
+int
+piece_bits_fit(Piece_bits const *s, Row_bits const *board, int x, int y)
+{
+    int i;
+
+    for (i = 0; i < 4; ++i)
+        if (s->rows[i] && (y + i < 0 || y + i >= BOARD_ROWS
+                           || board[y + i] & (Row_bits) (x >= 0 ? s->rows[i] << x : s->rows[i] >> -x)))
+            return 0;
+    return 1;
+}
+
+int
+piece_bits_landing(Piece_bits const *s, Row_bits const board[BOARD_ROWS], int const top[BOARD_COLS], int x, int from)
+{
+    int j, y = BOARD_ROWS;
+
+    /* within the walls, and below the top of the board: `-lift` is the first row of the grid with blocks */
+    if (x + s->left < 0 || x + s->right >= BOARD_COLS || from - s->lift < 0)
+        return BOARD_ROWS;
+    /* the piece falls until one of its columns meets the top of the stack */
+    for (j = s->left; j <= s->right; ++j)
+        if (top[x + j] - 1 - s->bottom[j] < y)
+            y = top[x + j] - 1 - s->bottom[j];
+    if (y >= from)
+        return y;
+
+    /* unless it starts below the top of some column: then it stops at the first block it meets, if it fits at all */
+    if (!piece_bits_fit(s, board, x, from))
+        return BOARD_ROWS;
+    for (y = from; piece_bits_fit(s, board, x, y + 1); ++y) /* nop */;
+    return y;
+}
+
+#endif /* ifndef ROW_BITS_WORDS */
+
 /**
  * Move the active piece right by one, if possible.
  */
@@ -244,54 +392,48 @@ handle_rotate(Game *game)
     game->active_piece = rotated;
 }
 
-/**
- * Set each full line on the game board to `Block_type_Clear`.
- * @returns the amount of lines to be cleared.
- */
 int
-mark_cleared_lines(Board board)
+mark_cleared_lines(Board board, Piece const *piece)
 {
-    int i, j, cleared_count = 0;
+    int i, cleared_count = 0;
 
-    for (i = 0; i < BOARD_ROWS; ++i) {
-        int cleared = 1;
-        for (j = 0; j < BOARD_COLS; ++j)
-            if (!board[i][j]) cleared = 0;
-
-        if (cleared) {
-            memset(board[i], Block_type_Clear, BOARD_COLS);
-            ++cleared_count;
+    /* the rows covered by the piece, then any full rows of garbage it rests on */
+    for (i = piece->y < 0 ? 0 : piece->y; i < BOARD_ROWS; ++i) {
+        if (memchr(board[i], Block_type_Empty, BOARD_COLS)) {
+            if (i >= piece->y + 4)
+                break;
+            continue;
         }
+        memset(board[i], Block_type_Clear, BOARD_COLS);
+        ++cleared_count;
+    }
+    /* the top row, which stays marked when it is the only one (see `remove_cleared_lines`) */
+    if (piece->y > 0 && !memchr(board[0], Block_type_Empty, BOARD_COLS)) {
+        memset(board[0], Block_type_Clear, BOARD_COLS);
+        ++cleared_count;
     }
 
     return cleared_count;
 }
 
-/**
- * Remove every cleared line previously marked by `mark_cleared_lines` (more accurately, where at least
- * the *first* block is set to `Block_type_Clear`). Shift everything downwards.
- */
 void
 remove_cleared_lines(Board board)
 {
-    int i = BOARD_ROWS - 1;
+    int read, write = BOARD_ROWS - 1;
 
-    while (i > 0) {
-        if (board[i][0] != Block_type_Clear) {
-            --i;
+    /* single pass from the bottom up, moving each row that stays once; the top row is only removed along with
+       another one, as it always was */
+    for (read = BOARD_ROWS - 1; read >= 0; --read) {
+        if (board[read][0] == Block_type_Clear && (read > 0 || write > 0))
             continue;
-        }
-        
-        if (i != 0)
-            /* multidimensional arrays are contiguous in memory so this is valid */
-            memmove(
-                ((unsigned char *)board) + BOARD_COLS,
-                (unsigned char *)board,
-                i * BOARD_COLS
-            );
-        memset(board[0], Block_type_Empty, sizeof board[0]);
+        if (write != read)
+            memcpy(board[write], board[read], BOARD_COLS);
+        --write;
     }
+    for (; write >= 0; --write)
+        memset(board[write], Block_type_Empty, BOARD_COLS);
 }
+
 /**
  * Check whether the player has won, i.e. has used all of their pieces.
  */
@@ -304,38 +446,6 @@ check_win_condition(Game *game)
     return 1;
 }
 
-/**
- * Prepare the game state for drawing (possibly breaking invariants assumed elsewhere in the game logic!),
- * send the state to the I/O function for display, then restore everything to its original value.
- */
-void
-draw(Game *game, Io_handler *io_handler)
-{
-    Piece ghost;
-
-    /* prepare board state */
-    if (game->state == Game_state_Place) {
-        memcpy(&ghost, &game->active_piece, sizeof ghost);
-        drop_piece(&ghost, game->board[game->current_player]);
-        if (ghost.y - game->active_piece.y >= 3)
-            place_piece(&game->active_piece, game->board[game->current_player], game->active_piece.type);
-        place_piece(&ghost, game->board[game->current_player], Block_type_Ghost);
-    } else if (game->state == Game_state_Lose) {
-        place_piece(&game->active_piece, game->board[game->current_player], Block_type_Badbk);
-    }
-
-    iohandler_draw_and_read(io_handler, game);
-
-    /* done drawing */
-    fflush(stdout);
-
-    /* clean up board state */
-    if (game->state == Game_state_Place) {
-        place_piece(&game->active_piece, game->board[game->current_player], Block_type_Empty);
-        place_piece(&ghost, game->board[game->current_player], Block_type_Empty);
-    }
-}
-
 /**
  * Helper to handle actions for `Game_state_Place`.  
  * `act` must be an appropriate action for this state.
@@ -357,7 +467,7 @@ state_place_handler(Game *game, enum Game_action act)
         drop_piece(&game->active_piece, game->board[game->current_player]);
         place_piece(&game->active_piece, game->board[game->current_player], game->active_piece.type);
 
-        game->lines_cleared = mark_cleared_lines(game->board[game->current_player]);
+        game->lines_cleared = mark_cleared_lines(game->board[game->current_player], &game->active_piece);
         if (game->lines_cleared) {
             game->state = Game_state_Cleared;
         } else {
@@ -425,31 +535,15 @@ state_cleared_handler(Game *game)
     game->score[game->current_player] += score_per_lines[game->lines_cleared - 1];
     if (game->kind != Game_kind_Singleplayer) {
         game->current_player = !game->current_player;
-        if (game->lines_cleared >= 3) {
-            /* bonus for clearing many lines: do the other player dirty :P */
-            int i, j;
-            for (i = 0; i < game->lines_cleared; ++i) {
-                unsigned char *const row = game->board[game->current_player][BOARD_ROWS-1-i];
-                for (j = 0; j < BOARD_COLS; ++j) {
-                    if (row[j]) 
-                        row[j] = Block_type_Empty;
-                    else
-                        row[j] = Tetrimino_type_I + (rand() % 7);
-                }
-            }
-        }
+        /* bonus for clearing many lines: do the other player dirty :P */
+        if (game->lines_cleared >= GARBAGE_MIN_LINES)
+            add_garbage(game->board[game->current_player], game->lines_cleared, &game->rng);
     }
 
     game->lines_cleared = 0;
     game->state = check_win_condition(game) ? Game_state_Win : Game_state_Choose;
 }
 
-/**
- * Given one of the game actions as received from IO, advances the game state as needed.
- * Assumes the action given is coherent with the game state (the IO handler must ensure that!).
- * The return value determines whether other actions can be chained after the current one.
- * @returns 1 if the function can be called again in the same game loop iteration, otherwise 0.
- */
 int
 do_game_step(Game *game, enum Game_action act)
 {
@@ -475,6 +569,17 @@ do_game_step(Game *game, enum Game_action act)
     }
 }
 
+int
+game_gravity(Game *game)
+{
+    ++game->active_piece.y;
+    if (!collides(&game->active_piece, game->board[game->current_player]))
+        return 1;
+    --game->active_piece.y;
+    do_game_step(game, Game_action_Drop);
+    return 0;
+}
+
 /**
  * Check that a particular action can be executed in the given state.  
  * This function is just for extra peace of mind and to simplify debugging.
@@ -485,31 +590,23 @@ action_belongs_to_state(enum Game_action act, enum Game_state state)
     return ((act & 0xe0) == (state << 5));
 }
 
-/**
- * Run the game: keep executing the game loop until the game ends.
- */
-void
-game_loop(Game *game, Io_handler *io_handler, Opponent_ai *opp_ai)
+int
+action_is_legal(Game const *game, enum Game_action act)
 {
-    /* draw, then handle as many actions as we can */
-    for (;;) {
-        draw(game, io_handler);
-
-        if (game->state == Game_state_Win || game->state == Game_state_Lose)
-            break;
-
-        while (do_game_step(game, iohandler_next_action_1p(io_handler, game))) /* nop */;
-
-        if (game->kind == Game_kind_Vs_ai && game->current_player == 1)
-            while (do_game_step(game, ai_next_action(opp_ai, game))) /* nop */;
+    switch (game->state) {
+    case Game_state_Choose:
+        return Game_action_Choose_I <= act && act <= Game_action_Choose_O;
+    case Game_state_Place:
+        return Game_action_Left <= act && act <= Game_action_Drop;
+    case Game_state_Cleared:
+        return act == Game_action_Finish_clearing;
+    default:
+        return 0;
     }
 }
 
-/**
- * Set the game state to the initial configuration.
- */
 void
-game_init(Game *game, enum Game_kind kind)
+game_init(Game *game, enum Game_kind kind, unsigned long seed)
 {
     game->state = Game_state_Choose;
     memset(game->board, 0, BOARD_COLS * BOARD_ROWS * 2);
@@ -520,64 +617,5 @@ game_init(Game *game, enum Game_kind kind)
     memset(game->pieces_left, STARTING_PIECES * (kind == Game_kind_Singleplayer ? 1 : 2), sizeof game->pieces_left);
     game->lines_cleared = 0;
     game->kind = kind;
-}
-
-void
-atexit_fn()
-{
-    if (g_io_handler)
-        iohandler_destroy(g_io_handler);
-    if (g_opp_ai)
-        ai_destroy(g_opp_ai);
-}
-
-int
-run_menu(char const * const *entries, int entries_n)
-{
-    int i, ans;
-
-    for (;;) {
-        for (i = 0; i < entries_n; ++i) {
-            printf("%d.  %s\n", i+1, entries[i]);
-        }
-        if (1 == scanf("%d%*1[\n]", &ans)
-            && (--ans, 0 <= ans && ans < entries_n))
-            break;
-
-        scanf("%*[^\n]%*1[\n]"); /* discard until end of line */       
-    }
-
-    return ans;
-}
-
-/**
- * Main function.
- */
-int
-main()
-{
-    char const * const menu_items[] = {
-        "Single player",
-        "Multiplayer -- two players",
-        "Multiplayer -- vs. AI"
-    };
-    int choice;
-
-    puts(
-        " _       _____  ____ _____  ___   _   __ \n"
-        "\\ \\_/ __  | |  | |_   | |  | |_) | | ( (`\n"
-        "/_/ \\     |_|  |_|__  |_|  |_| \\ |_| _)_)\n"
-    );
-    puts("Welcome! Choose a game mode:");
-    choice = run_menu(menu_items, 3);
-
-    game_init(&g_game, (enum Game_kind) choice);
-    g_io_handler = iohandler_create(choice != 0);
-    if (choice != 0)
-        g_opp_ai = ai_create();
-    atexit(&atexit_fn);
-
-    game_loop(&g_game, g_io_handler, g_opp_ai);
-
-    return EXIT_SUCCESS;
+    rng_seed(&game->rng, seed);
 }
@@ -6,6 +6,7 @@
 #ifndef XTETRIS_TETRIS_H
 #define XTETRIS_TETRIS_H
 #include "constants.h"
+#include "rng.h"
 
 /**
  * Enum to represent the possible types of tetrimino, as well as the type ("color", like in the "standardized" versions
@@ -83,6 +84,40 @@ enum Game_kind {
  */
 typedef unsigned char Board[BOARD_ROWS][BOARD_COLS];
 
+/**
+ * One board row as a bitboard, with bit `x` set if column `x` is occupied, for the code that handles whole rows at
+ * once (packed states, training records, the AI's endgame table).  
+ * Rows of up to 16 and up to 32 columns fit a single word, and can be used as integers directly; wider rows are
+ * arrays of 32 bit words (`ROW_BITS_WORDS` is defined then), which only the `row_bits_*` functions should touch.
+ */
+#if BOARD_COLS <= 16
+typedef unsigned short Row_bits;
+#elif BOARD_COLS <= 32
+typedef unsigned long Row_bits;
+#else
+#define ROW_BITS_WORDS ((BOARD_COLS + 31) / 32)
+typedef struct Row_bits {
+    unsigned long word[ROW_BITS_WORDS];
+} Row_bits;
+#endif
+
+#ifndef ROW_BITS_WORDS
+/**
+ * A piece in one rotation as bitboards, for dropping pieces on boards of `Row_bits` (the AI's searches) without
+ * looking at their 4x4 grid. Only with single word rows: wider boards use `collides` and `drop_piece`.
+ */
+typedef struct Piece_bits {
+    /** Blocks of each row of the grid, bit `j` for column `j`. */
+    unsigned long rows[4];
+    /** Row of the grid at the top of the board, as `lift_piece` sets it. */
+    int lift;
+    /** First and last columns of the grid with blocks: every column in between has some. */
+    int left, right;
+    /** Lowest row of the grid with a block, for each of its columns. */
+    int bottom[4];
+} Piece_bits;
+#endif
+
 /** 
  * Struct representing the entire game state.
  */
@@ -101,6 +136,8 @@ typedef struct Game {
     int lines_cleared;
     /** Index of current player: 0 or 1. */
     int current_player;
+    /** Source of every random decision taken by the game itself; seeded once, in `game_init`. */
+    Rng rng;
 } Game;
 
 /**
@@ -157,4 +194,77 @@ void drop_piece(Piece *, const Board);
  * Leave a piece's x value unchanged, and set its y value so that the piece is in the topmost position on the screen.
  */
 void lift_piece(Piece *, const Board);
+/**
+ * Set each full line on the game board to `Block_type_Clear`, right after `piece` was placed on it.  
+ * Only the lines where the game can have left full ones are looked at: those covered by the piece, the full lines
+ * of garbage right below them (see `add_garbage`: when the board was empty there, the piece rests on them), and
+ * the top line (see `remove_cleared_lines`). Elsewhere, the previous placements have cleared them all.
+ * @returns the amount of lines to be cleared.
+ */
+int mark_cleared_lines(Board, Piece const *piece);
+/**
+ * Remove every cleared line previously marked by `mark_cleared_lines` (more accurately, where at least
+ * the *first* block is set to `Block_type_Clear`). Shift everything downwards, moving each remaining line once.
+ * The top line is only removed along with some other line.
+ */
+void remove_cleared_lines(Board);
+/**
+ * Garbage sent to the opponent for clearing at least `GARBAGE_MIN_LINES` lines at once: the bottom `rows` rows of
+ * the board are inverted, each empty cell getting a block of a random type and each block being removed.
+ */
+void add_garbage(Board, int rows, Rng *);
+/**
+ * @returns the bitboard of a board row (`BOARD_COLS` cells).
+ */
+Row_bits row_bits_pack(unsigned char const *row);
+/**
+ * @returns whether column `x` is occupied in a bitboard row.
+ */
+int row_bits_test(Row_bits const *, int x);
+/**
+ * @returns whether every column is occupied in a bitboard row.
+ */
+int row_bits_full(Row_bits const *);
+#ifndef ROW_BITS_WORDS
+/**
+ * Fill in the first occupied row of every column of a board of bitboard rows, `BOARD_ROWS` for an empty column.
+ */
+void row_bits_tops(Row_bits const board[BOARD_ROWS], int top[BOARD_COLS]);
+/**
+ * Describe the current shape of a piece (its type and rotation; not its position) as bitboards.
+ */
+void piece_bits_init(Piece_bits *, Piece const *);
+/**
+ * Where a piece comes to rest when dropped from row `from` at column `x`, as `drop_piece` finds it: the same
+ * as `!collides` then `drop_piece` on the board the bitboards were made from.
+ * @param top the first occupied row of every column, as given by `row_bits_tops`.
+ * @returns the row, or `BOARD_ROWS` if the piece does not fit at row `from` (walls included).
+ */
+int piece_bits_landing(Piece_bits const *, Row_bits const board[BOARD_ROWS], int const top[BOARD_COLS], int x,
+                       int from);
+#endif
+/**
+ * Set the game state to the initial configuration.
+ * The whole game is determined by `seed` together with the sequence of actions it receives.
+ */
+void game_init(Game *, enum Game_kind, unsigned long seed);
+/**
+ * Given one of the game actions as received from IO, advances the game state as needed.
+ * Assumes the action given is coherent with the game state (the IO handler must ensure that!).
+ * The return value determines whether other actions can be chained after the current one.
+ * @returns 1 if the function can be called again in the same game loop iteration, otherwise 0.
+ */
+int do_game_step(Game *, enum Game_action);
+/**
+ * Real-time mode only: let the active piece fall by one row or, if it already rests on something, lock it in place
+ * exactly as `Game_action_Drop` would. The game must be in `Game_state_Place`.
+ * @returns 1 if the piece moved down, 0 if it was locked.
+ */
+int game_gravity(Game *);
+/**
+ * Check whether `do_game_step` can be given this action in the current state, for actions that come from untrusted
+ * sources (the I/O handler only ever produces coherent actions). Choosing a piece that is not left is legal: it is
+ * simply ignored.
+ */
+int action_is_legal(Game const *, enum Game_action);
 #endif /* ifndef XTETRIS_TETRIS_H */
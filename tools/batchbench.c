@@ -0,0 +1,267 @@
+/**
+ * @file batchbench.c
+ * @author Maksim Kovalkov
+ *
+ * Throughput of batched AI decisions (see aibatch.h) against the single game path. A corpus of seeded games is
+ * played AI against AI twice: one game after the other with `ai_next_action`, then all of them side by side, the
+ * positions of every game waiting for a decision being decided in one call to `ai_batch_decide` per round. The
+ * games must end identically; the exit status is 1 if any does not. Reports decisions per second of CPU time for
+ * both, counting only the time spent deciding.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "aibatch.h"
+#include "selfplay.h"
+#include "util.h"
+
+typedef struct Options {
+    int games, opening;
+    unsigned long seed;
+    enum Game_kind kind;
+    Ai_config config;
+} Options;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static double cpu_seconds(void);
+static int game_over(Game const *);
+static int same_outcome(Game const *, Game const *);
+static void play_decision(Game *, Ai_decision const *);
+static double play_single(Options const *, Game *, long *);
+static double play_batched(Options const *, Game *, long *, long *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] [key=value...]\n", argv0);
+    fputs(
+        "  key=value pairs override fields of the configuration, as in ai_config_set.\n"
+        "  -g N      games played side by side (default 256)\n"
+        "  -o N      random opening moves per game (default 4)\n"
+        "  -k KIND   single or vs (default vs)\n"
+        "  -s SEED   seed of the first game (default 1)\n"
+        "  -w FILE   configuration to start from (default: built-in)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->games = 256;
+    opt->opening = 4;
+    opt->seed = 1;
+    opt->kind = Game_kind_Vs_ai;
+    ai_config_default(&opt->config);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        char *value;
+        if (a[0] == '-') {
+            if (!a[1] || a[2] || i + 1 >= argc)
+                return -1;
+            ++i;
+            switch (a[1]) {
+            case 'g': opt->games = atoi(argv[i]); break;
+            case 'o': opt->opening = atoi(argv[i]); break;
+            case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+            case 'k':
+                opt->kind = strcmp(argv[i], "single") == 0 ? Game_kind_Singleplayer : Game_kind_Vs_ai;
+                break;
+            case 'w':
+                if (ai_config_load(&opt->config, argv[i]) != 0) {
+                    fprintf(stderr, "cannot load %s\n", argv[i]);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&opt->config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return opt->games > 0 ? 0 : -1;
+}
+
+double
+cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+game_over(Game const *game)
+{
+    return game->state == Game_state_Win || game->state == Game_state_Lose;
+}
+
+/**
+ * @returns whether both games ended up in the same position.
+ */
+int
+same_outcome(Game const *a, Game const *b)
+{
+    return a->state == b->state && a->score[0] == b->score[0] && a->score[1] == b->score[1]
+        && memcmp(a->board, b->board, sizeof a->board) == 0
+        && memcmp(a->pieces_left, b->pieces_left, sizeof a->pieces_left) == 0;
+}
+
+/**
+ * Play a decision out, up to the end of the move, with the actions `ai_next_action` would give.
+ */
+void
+play_decision(Game *game, Ai_decision const *d)
+{
+    int rots = d->rots, last_x = INT_MIN;
+
+    do_game_step(game, (enum Game_action) (Game_action_Choose_I + d->type - Tetrimino_type_I));
+    while (game->state == Game_state_Place) {
+        enum Game_action act = Game_action_Drop;
+        if (rots) {
+            --rots;
+            act = Game_action_Rotate;
+        } else if (game->active_piece.x != last_x) {
+            if ((last_x = game->active_piece.x) < d->x)
+                act = Game_action_Right;
+            else if (game->active_piece.x > d->x)
+                act = Game_action_Left;
+        }
+        do_game_step(game, act);
+    }
+    if (game->state == Game_state_Cleared)
+        do_game_step(game, Game_action_Finish_clearing);
+}
+
+/**
+ * Play every game to the end, one after the other, with the single game path.
+ * @returns the CPU time spent deciding, in seconds.
+ */
+double
+play_single(Options const *opt, Game *games, long *decisions)
+{
+    Opponent_ai *const ai = ai_create(&opt->config);
+    double seconds = 0;
+    int g;
+
+    for (g = 0; g < opt->games; ++g) {
+        Game *const game = &games[g];
+        while (!game_over(game)) {
+            if (game->state == Game_state_Choose) {
+                double const start = cpu_seconds();
+                do_game_step(game, ai_next_action(ai, game));
+                seconds += cpu_seconds() - start;
+                ++*decisions;
+                continue;
+            }
+            do_game_step(game, ai_next_action(ai, game));
+        }
+    }
+    ai_destroy(ai);
+    return seconds;
+}
+
+/**
+ * Play every game to the end, side by side: each round, decide every game at once, then play the decisions out.
+ * @returns the CPU time spent deciding, in seconds.
+ */
+double
+play_batched(Options const *opt, Game *games, long *decisions, long *rounds)
+{
+    Ai_batch *const batch = ai_batch_create(&opt->config);
+    Ai_position *const positions = malloc_or_die(sizeof *positions * opt->games);
+    Ai_decision *const chosen = malloc_or_die(sizeof *chosen * opt->games);
+    int *const which = malloc_or_die(sizeof *which * opt->games);
+    double seconds = 0;
+
+    for (;;) {
+        double start;
+        int g, n = 0;
+
+        for (g = 0; g < opt->games; ++g) {
+            Game const *const game = &games[g];
+            if (game_over(game))
+                continue;
+            memcpy(positions[n].board, game->board[game->current_player], sizeof positions[n].board);
+            memcpy(positions[n].pieces_left, game->pieces_left, sizeof positions[n].pieces_left);
+            positions[n].kind = game->kind;
+            which[n++] = g;
+        }
+        if (!n)
+            break;
+
+        start = cpu_seconds();
+        ai_batch_decide(batch, positions, n, chosen);
+        seconds += cpu_seconds() - start;
+        *decisions += n;
+        ++*rounds;
+
+        for (g = 0; g < n; ++g)
+            play_decision(&games[which[g]], &chosen[g]);
+    }
+    free(which);
+    free(chosen);
+    free(positions);
+    ai_batch_destroy(batch);
+    return seconds;
+}
+
+int
+main(int argc, char **argv)
+{
+    Options opt;
+    Game *single, *batched;
+    double seconds[2];
+    long decisions[2] = { 0, 0 }, rounds = 0, differ = 0;
+    int g;
+
+    if (parse_options(&opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    single = malloc_or_die(sizeof *single * opt.games);
+    batched = malloc_or_die(sizeof *batched * opt.games);
+    for (g = 0; g < opt.games; ++g) {
+        game_init(&single[g], opt.kind, opt.seed + g);
+        selfplay_random_opening(&single[g], opt.opening);
+        /* openings that end the game leave nothing to decide; the rest start in Game_state_Choose */
+        while (!game_over(&single[g]) && single[g].state != Game_state_Choose)
+            do_game_step(&single[g], single[g].state == Game_state_Cleared ? Game_action_Finish_clearing
+                                                                           : Game_action_Drop);
+        batched[g] = single[g];
+    }
+
+    seconds[0] = play_single(&opt, single, &decisions[0]);
+    seconds[1] = play_batched(&opt, batched, &decisions[1], &rounds);
+
+    for (g = 0; g < opt.games; ++g)
+        if (!same_outcome(&single[g], &batched[g])) {
+            ++differ;
+            printf("seed %lu: the batched game ends differently\n", opt.seed + g);
+        }
+
+    printf("%d games, %ld decisions (%ld rounds of %.1f positions on average), %ld games differ\n", opt.games,
+           decisions[0], rounds, rounds ? (double) decisions[1] / rounds : 0.0, differ);
+    printf("decisions/s: single %.0f, batched %.0f (x%.2f)\n", decisions[0] / (seconds[0] ? seconds[0] : 1),
+           decisions[1] / (seconds[1] ? seconds[1] : 1),
+           seconds[1] ? (decisions[1] / seconds[1]) / (decisions[0] / (seconds[0] ? seconds[0] : 1)) : 0.0);
+
+    free(single);
+    free(batched);
+    return differ ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file boardbench.c
+ * @author Maksim Kovalkov
+ *
+ * Cost of the AI's search on the board size of this build (see `BOARD_ROWS` and `BOARD_COLS` in constants.h).
+ * A corpus of seeded games is played AI against AI, and the CPU time of every decision is measured: per decision,
+ * and per decision and board cell, which stays flat where the search grows linearly with the area of the board.
+ * `make boardbench` builds and runs this tool for several board sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "selfplay.h"
+
+typedef struct Options {
+    int games, opening;
+    unsigned long seed;
+    enum Game_kind kind;
+    Ai_config config;
+} Options;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static double cpu_seconds(void);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] [key=value...]\n", argv0);
+    fputs(
+        "  key=value pairs override fields of the configuration, as in ai_config_set.\n"
+        "  -g N      games played (default 20)\n"
+        "  -o N      random opening moves per game (default 4)\n"
+        "  -k KIND   single or vs (default vs)\n"
+        "  -s SEED   seed of the first game (default 1)\n"
+        "  -w FILE   configuration to start from (default: built-in)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->games = 20;
+    opt->opening = 4;
+    opt->seed = 1;
+    opt->kind = Game_kind_Vs_ai;
+    ai_config_default(&opt->config);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        char *value;
+        if (a[0] == '-') {
+            if (!a[1] || a[2] || i + 1 >= argc)
+                return -1;
+            ++i;
+            switch (a[1]) {
+            case 'g': opt->games = atoi(argv[i]); break;
+            case 'o': opt->opening = atoi(argv[i]); break;
+            case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+            case 'k':
+                opt->kind = strcmp(argv[i], "single") == 0 ? Game_kind_Singleplayer : Game_kind_Vs_ai;
+                break;
+            case 'w':
+                if (ai_config_load(&opt->config, argv[i]) != 0) {
+                    fprintf(stderr, "cannot load %s\n", argv[i]);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&opt->config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return opt->games > 0 ? 0 : -1;
+}
+
+/**
+ * CPU time of the calling thread, as the clock of `selfplay_run`.
+ */
+double
+cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(int argc, char **argv)
+{
+    Options opt;
+    Opponent_ai *ai;
+    Opponent_ai *players[2];
+    Game game;
+    double seconds = 0, max_game_ms = 0;
+    long decisions = 0, points = 0;
+    int g;
+
+    if (parse_options(&opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ai = ai_create(&opt.config);
+    players[0] = players[1] = ai;
+    for (g = 0; g < opt.games; ++g) {
+        Selfplay_result result;
+        double game_seconds;
+
+        game_init(&game, opt.kind, opt.seed + g);
+        ai_init(ai, &opt.config);
+        selfplay_random_opening(&game, opt.opening);
+        selfplay_run(&game, players, &cpu_seconds, &result);
+
+        game_seconds = result.decision_seconds[0] + result.decision_seconds[1];
+        seconds += game_seconds;
+        decisions += result.moves[0] + result.moves[1];
+        points += result.score[0] + result.score[1];
+        if (game_seconds * 1e3 > max_game_ms)
+            max_game_ms = game_seconds * 1e3;
+    }
+    ai_destroy(ai);
+
+    printf("board %dx%d: %d games, %ld decisions, %.1f points per game\n", BOARD_ROWS, BOARD_COLS, opt.games,
+           decisions, (double) points / opt.games);
+    printf("ms/decision %.3f, us/decision/cell %.3f, slowest game %.1f ms\n",
+           decisions ? seconds * 1e3 / decisions : 0,
+           decisions ? seconds * 1e6 / decisions / (BOARD_ROWS * BOARD_COLS) : 0, max_game_ms);
+    return EXIT_SUCCESS;
+}
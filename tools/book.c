@@ -0,0 +1,391 @@
+/**
+ * @file book.c
+ * @author Maksim Kovalkov
+ *
+ * Opening books for the AI (see book.h). From the start of a game, the AI's positions are expanded level by level
+ * up to a number of its own moves: each is searched once, deeper than in play, and the move found leads to the
+ * positions of the next level. In single player games, that is the only one; in games against a player, the AI
+ * moves second and its board only changes with its own moves, so the next positions are its board after the move
+ * with each piece the opponent can take in between (garbage is not foreseen: after it, positions are not in the
+ * book). The positions of a level are searched in parallel, one AI per worker.
+ *
+ * With `-r`, reads a book instead: prints its size, then plays every position of it with the AI of the configuration
+ * given, with and without the book, and compares the time per decision and the moves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "book.h"
+#include "util.h"
+#include "parallel.h"
+
+typedef struct Options {
+    int moves, depth, threads;
+    enum Game_kind kind;
+    char const *output, *report;
+    Ai_config config;
+} Options;
+
+/**
+ * A position of a level, and what searching it gave.
+ */
+typedef struct Node {
+    /** The position; its move once searched. */
+    Book_entry entry;
+    Board board;
+    /** Board after the move, and whether the game goes on from it. */
+    Board after;
+    int goes_on;
+} Node;
+
+typedef struct Builder {
+    Options const *opt;
+    Opponent_ai **ais;
+    Node *nodes;
+} Builder;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static double wall_ms(void);
+static void setup_game(Game *, enum Game_kind, Board const, unsigned char const *);
+static void play_move(Opponent_ai *, Game *);
+static void search_job(void *, int, int);
+static size_t add_node(Node **, size_t *, size_t, Board const, unsigned char const *);
+static int compare_nodes(void const *, void const *);
+static size_t dedupe(Node *, size_t);
+static int build(Options const *);
+static void unpack_board(Board, Book_entry const *);
+static int report(Options const *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] [key=value...]\n", argv0);
+    fputs(
+        "  key=value pairs override fields of the configuration, as in ai_config_set.\n"
+        "  -n N      moves of the AI covered (default 2)\n"
+        "  -d N      search depth of the book's moves (default: depth of the configuration + 1)\n"
+        "  -k KIND   single or vs (default vs)\n"
+        "  -o FILE   book to write (default x-tetris.book)\n"
+        "  -r FILE   read this book instead, and compare the AI's decisions with and without it\n"
+        "  -w FILE   configuration to start from (default: built-in)\n"
+        "  -j N      worker threads (default: number of CPUs)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->moves = 2;
+    opt->depth = -1;
+    opt->threads = parallel_ncpus();
+    opt->kind = Game_kind_Vs_ai;
+    opt->output = "x-tetris.book";
+    opt->report = NULL;
+    ai_config_default(&opt->config);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        char *value;
+        if (a[0] == '-') {
+            if (!a[1] || a[2] || i + 1 >= argc)
+                return -1;
+            ++i;
+            switch (a[1]) {
+            case 'n': opt->moves = atoi(argv[i]); break;
+            case 'd': opt->depth = atoi(argv[i]); break;
+            case 'j': opt->threads = atoi(argv[i]); break;
+            case 'k': opt->kind = strcmp(argv[i], "single") == 0 ? Game_kind_Singleplayer : Game_kind_Vs_ai; break;
+            case 'o': opt->output = argv[i]; break;
+            case 'r': opt->report = argv[i]; break;
+            case 'w':
+                if (ai_config_load(&opt->config, argv[i]) != 0) {
+                    fprintf(stderr, "cannot load %s\n", argv[i]);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&opt->config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    if (opt->depth < 0)
+        opt->depth = opt->config.depth + 1;
+    return opt->moves < 1 || opt->depth < 1 || opt->threads < 1 ? -1 : 0;
+}
+
+double
+wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/**
+ * Set a game up at a position of the AI, with the AI to choose: it plays on the first board, whatever the kind.
+ */
+void
+setup_game(Game *game, enum Game_kind kind, Board const board, unsigned char const *pieces_left)
+{
+    game_init(game, kind, 1);
+    memcpy(game->board[0], board, sizeof game->board[0]);
+    memcpy(game->pieces_left, pieces_left, sizeof game->pieces_left);
+}
+
+/**
+ * Let the AI make a decision and play it out, up to the end of the move (lines cleared included).
+ */
+void
+play_move(Opponent_ai *ai, Game *game)
+{
+    do_game_step(game, ai_next_action(ai, game));
+    while (game->state == Game_state_Place || game->state == Game_state_Cleared)
+        do_game_step(game, ai_next_action(ai, game));
+}
+
+void
+search_job(void *ctx, int job, int worker)
+{
+    Builder const *const b = ctx;
+    Node *const node = &b->nodes[job];
+    Ai_decision const *d;
+    Game game;
+
+    setup_game(&game, b->opt->kind, node->board, node->entry.pieces_left);
+    play_move(b->ais[worker], &game);
+    d = ai_last_decision(b->ais[worker]);
+    node->entry.type = d->type;
+    node->entry.rots = d->rots;
+    node->entry.x = (signed char) d->x;
+    memcpy(node->after, game.board[0], sizeof node->after);
+    /* a game against a player is won by whoever has cleared more when the pieces run out: keep expanding anyway */
+    node->goes_on = game.state != Game_state_Lose && game.state != Game_state_Win;
+}
+
+/**
+ * Append a position to a level, growing it as needed.
+ * @returns the new number of positions.
+ */
+size_t
+add_node(Node **nodes, size_t *cap, size_t n, Board const board, unsigned char const *pieces_left)
+{
+    if (n == *cap) {
+        Node *const grown = malloc_or_die(sizeof *grown * (*cap = *cap ? 2 * *cap : 64));
+        if (n)
+            memcpy(grown, *nodes, sizeof *grown * n);
+        free(*nodes);
+        *nodes = grown;
+    }
+    book_key(&(*nodes)[n].entry, board, pieces_left);
+    memcpy((*nodes)[n].board, board, sizeof (*nodes)[n].board);
+    return n + 1;
+}
+
+int
+compare_nodes(void const *a, void const *b)
+{
+    Book_entry const *const x = &((Node const *) a)->entry, *const y = &((Node const *) b)->entry;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return memcmp(x, y, offsetof(Book_entry, type));
+}
+
+/**
+ * Sort a level and keep one node per position: sequences of moves often lead to the same one.
+ * @returns the number of nodes kept.
+ */
+size_t
+dedupe(Node *nodes, size_t n)
+{
+    size_t i, kept = 0;
+
+    qsort(nodes, n, sizeof *nodes, &compare_nodes);
+    for (i = 0; i < n; ++i)
+        if (!kept || compare_nodes(&nodes[kept-1], &nodes[i]) != 0)
+            nodes[kept++] = nodes[i];
+    return kept;
+}
+
+int
+build(Options const *opt)
+{
+    Ai_config config = opt->config;
+    Builder b;
+    Book_entry *entries = NULL;
+    size_t n_entries = 0, n_level = 0, cap_level = 0;
+    Board empty;
+    Game start;
+    int move, w, t;
+
+    config.depth = opt->depth;
+    /* the book covers the opening only: never the exhaustive search of the end */
+    config.endgame = 0;
+    b.opt = opt;
+    b.nodes = NULL;
+    b.ais = malloc_or_die(sizeof *b.ais * opt->threads);
+    for (w = 0; w < opt->threads; ++w)
+        b.ais[w] = ai_create(&config);
+
+    /* first positions: the start of the game, and in games against a player, each piece the opponent takes first */
+    game_init(&start, opt->kind, 1);
+    memset(empty, 0, sizeof empty);
+    n_level = add_node(&b.nodes, &cap_level, n_level, empty, start.pieces_left);
+    if (opt->kind != Game_kind_Singleplayer)
+        for (t = 0; t < 7; ++t) {
+            --start.pieces_left[t];
+            n_level = add_node(&b.nodes, &cap_level, n_level, empty, start.pieces_left);
+            ++start.pieces_left[t];
+        }
+
+    for (move = 1; move <= opt->moves && n_level; ++move) {
+        Node *next = NULL;
+        size_t n_next = 0, cap_next = 0, i;
+        double ms;
+
+        n_level = dedupe(b.nodes, n_level);
+        ms = wall_ms();
+        parallel_for((int) n_level, opt->threads, &search_job, &b);
+        ms = wall_ms() - ms;
+        printf("move %d: %lu positions searched in %.1f s (%.1f ms each)\n", move, (unsigned long) n_level,
+               ms / 1e3, ms / n_level);
+        fflush(stdout);
+
+        {
+            Book_entry *const grown = malloc_or_die(sizeof *grown * (n_entries + n_level));
+            if (n_entries)
+                memcpy(grown, entries, sizeof *grown * n_entries);
+            free(entries);
+            entries = grown;
+        }
+        for (i = 0; i < n_level; ++i) {
+            Node const *const node = &b.nodes[i];
+            unsigned char left[7];
+            entries[n_entries++] = node->entry;
+            if (move == opt->moves || !node->goes_on)
+                continue;
+            memcpy(left, node->entry.pieces_left, sizeof left);
+            --left[node->entry.type-1];
+            if (opt->kind == Game_kind_Singleplayer) {
+                n_next = add_node(&next, &cap_next, n_next, node->after, left);
+                continue;
+            }
+            for (t = 0; t < 7; ++t)
+                if (left[t]) {
+                    --left[t];
+                    n_next = add_node(&next, &cap_next, n_next, node->after, left);
+                    ++left[t];
+                }
+        }
+        free(b.nodes);
+        b.nodes = next;
+        n_level = n_next;
+        cap_level = cap_next;
+    }
+
+    for (w = 0; w < opt->threads; ++w)
+        ai_destroy(b.ais[w]);
+    free(b.ais);
+    free(b.nodes);
+    if (book_save(opt->output, entries, n_entries, opt->depth, ai_config_book_hash(&opt->config)) != 0) {
+        fprintf(stderr, "cannot write %s\n", opt->output);
+        free(entries);
+        return -1;
+    }
+    printf("%lu positions written to %s\n", (unsigned long) n_entries, opt->output);
+    free(entries);
+    return 0;
+}
+
+void
+unpack_board(Board board, Book_entry const *e)
+{
+    int y, x;
+    for (y = 0; y < BOARD_ROWS; ++y)
+        for (x = 0; x < BOARD_COLS; ++x)
+            board[y][x] = row_bits_test(&e->rows[y], x) ? Tetrimino_type_O : Block_type_Empty;
+}
+
+int
+report(Options const *opt)
+{
+    Book book;
+    Book_header const *h;
+    Opponent_ai *with, *without;
+    double ms[2] = { 0, 0 };
+    unsigned long hits = 0, same = 0;
+    size_t i;
+
+    if (book_map(&book, opt->report) != 0) {
+        fprintf(stderr, "cannot load an opening book from %s\n", opt->report);
+        return -1;
+    }
+    h = book.file.data;
+    printf("%s: %lu positions, searched at depth %lu\n", opt->report, (unsigned long) book.n_entries, h->depth);
+
+    with = ai_create(&opt->config);
+    without = ai_create(&opt->config);
+    if (ai_set_book(with, &book) != 0) {
+        fprintf(stderr, "%s was built for another AI configuration\n", opt->report);
+        ai_destroy(with);
+        ai_destroy(without);
+        book_unmap(&book);
+        return -1;
+    }
+    for (i = 0; i < book.n_entries; ++i) {
+        Ai_decision const *d[2];
+        Board board;
+        Game game;
+        double start;
+
+        unpack_board(board, &book.entries[i]);
+        setup_game(&game, opt->kind, board, book.entries[i].pieces_left);
+        start = wall_ms();
+        ai_next_action(with, &game);
+        ms[0] += wall_ms() - start;
+        start = wall_ms();
+        ai_next_action(without, &game);
+        ms[1] += wall_ms() - start;
+
+        d[0] = ai_last_decision(with);
+        d[1] = ai_last_decision(without);
+        hits += d[0]->book;
+        same += d[0]->type == d[1]->type && d[0]->rots == d[1]->rots && d[0]->x == d[1]->x;
+    }
+    if (book.n_entries) {
+        printf("book moves taken: %lu of %lu\n", hits, (unsigned long) book.n_entries);
+        printf("same move as the search at depth %d: %.1f%%\n", opt->config.depth, 100.0 * same / book.n_entries);
+        printf("ms/decision: with the book %.4f, searched %.3f\n", ms[0] / book.n_entries, ms[1] / book.n_entries);
+    }
+
+    ai_destroy(with);
+    ai_destroy(without);
+    book_unmap(&book);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    Options opt;
+
+    if (parse_options(&opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return (opt.report ? report(&opt) : build(&opt)) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,248 @@
+/**
+ * @file botmatch.c
+ * @author Maksim Kovalkov
+ *
+ * Match between an external bot (see botproto.h and extbot.h) and the built-in AI, under the same conditions:
+ * the same seeded `Game_kind_Vs_ai` games, each seed played twice with the seats swapped, and both sides timed on
+ * the wall clock. A bot that answers late, crashes or plays a move that cannot be played forfeits the game, and is
+ * restarted for the next one.
+ *
+ * Games run in parallel with `-j`, each worker having its own bot process; the default of one worker keeps the
+ * latencies of both sides free from interference.
+ */
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "selfplay.h"
+#include "gamectx.h"
+#include "util.h"
+#include "parallel.h"
+#include "botproto.h"
+#include "extbot.h"
+
+typedef struct Options {
+    int games, opening, threads, binary;
+    unsigned limit_ms;
+    unsigned long seed;
+    char const *command;
+    Ai_config config;
+} Options;
+
+/** One game of the match, with the bot in seat `job % 2`. */
+typedef struct Match_game {
+    /** Result for the bot: 1 win, 0.5 tie, 0 loss. */
+    double result;
+    /** How the game ended for the bot. */
+    enum Ext_bot_status status;
+    /** Wall clock time spent by the built-in AI, and its decisions. */
+    double ai_ms, ai_max_ms;
+    int ai_decisions;
+} Match_game;
+
+typedef struct Botmatch {
+    Options opt;
+    Match_game *games;
+    Ext_bot *bots;
+    Game_ctx_pool ctx_pool;
+    Game_ctx **worker_ctx;
+} Botmatch;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static void play_job(void *, int, int);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] [key=value...] -c COMMAND\n", argv0);
+    fputs(
+        "  key=value pairs override fields of the built-in AI's configuration, as in ai_config_set.\n"
+        "  -c COMMAND shell command starting the bot\n"
+        "  -B         use the binary protocol instead of text\n"
+        "  -t MS      time limit per decision (default 1000)\n"
+        "  -g N       seeds, each played from both seats (default 10)\n", stderr);
+    fputs(
+        "  -o N       random opening moves per game (default 4)\n"
+        "  -s SEED    seed of the first game (default 1)\n"
+        "  -w FILE    configuration of the built-in AI (default: built-in)\n"
+        "  -j N       games played at once, one bot process each (default 1)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->games = 10;
+    opt->opening = 4;
+    opt->threads = 1;
+    opt->binary = 0;
+    opt->limit_ms = 1000;
+    opt->seed = 1;
+    opt->command = NULL;
+    ai_config_default(&opt->config);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        char *value;
+        if (strcmp(a, "-B") == 0) {
+            opt->binary = 1;
+        } else if (a[0] == '-') {
+            if (!a[1] || a[2] || i + 1 >= argc)
+                return -1;
+            ++i;
+            switch (a[1]) {
+            case 'c': opt->command = argv[i]; break;
+            case 't': opt->limit_ms = (unsigned) strtoul(argv[i], NULL, 10); break;
+            case 'g': opt->games = atoi(argv[i]); break;
+            case 'o': opt->opening = atoi(argv[i]); break;
+            case 'j': opt->threads = atoi(argv[i]); break;
+            case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+            case 'w':
+                if (ai_config_load(&opt->config, argv[i]) != 0) {
+                    fprintf(stderr, "cannot load %s\n", argv[i]);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&opt->config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return opt->command && opt->games > 0 && opt->threads > 0 && opt->limit_ms > 0 ? 0 : -1;
+}
+
+void
+play_job(void *ctx, int job, int worker)
+{
+    Botmatch *const bm = ctx;
+    Match_game *const mg = &bm->games[job];
+    Game_ctx *const gc = bm->worker_ctx[worker];
+    Ext_bot *const bot = &bm->bots[worker];
+    Game *const game = gc->game;
+    int const bot_seat = job % 2;
+
+    game_init(game, Game_kind_Vs_ai, bm->opt.seed + job / 2);
+    ai_init(gc->ai, &bm->opt.config);
+    selfplay_random_opening(game, bm->opt.opening);
+    mg->status = Ext_bot_status_Ok;
+    mg->ai_ms = mg->ai_max_ms = 0;
+    mg->ai_decisions = 0;
+
+    while (game->state != Game_state_Win && game->state != Game_state_Lose) {
+        if (game->current_player == bot_seat && game->state == Game_state_Choose) {
+            Bot_move move;
+            if ((mg->status = extbot_choose(bot, game, &move)) != Ext_bot_status_Ok
+                || (mg->status = extbot_play(bot, game, &move)) != Ext_bot_status_Ok)
+                break;
+        } else if (game->current_player != bot_seat && game->state == Game_state_Choose) {
+            /* on the wall clock, as the bot is */
+            double const start = extbot_now_ms();
+            enum Game_action const act = ai_next_action(gc->ai, game);
+            double const ms = extbot_now_ms() - start;
+            mg->ai_ms += ms;
+            if (ms > mg->ai_max_ms)
+                mg->ai_max_ms = ms;
+            ++mg->ai_decisions;
+            do_game_step(game, act);
+        } else {
+            /* the placement of the AI's piece, or clearing lines for either side */
+            do_game_step(game, ai_next_action(gc->ai, game));
+        }
+    }
+
+    if (mg->status != Ext_bot_status_Ok) {
+        mg->result = 0;
+    } else {
+        int const winner = selfplay_winner(game);
+        mg->result = winner == bot_seat ? 1.0 : winner < 0 ? 0.5 : 0.0;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    Botmatch bm;
+    Ext_bot_stats total;
+    double score = 0, ai_ms = 0, ai_max_ms = 0, fraction;
+    long ai_decisions = 0;
+    int wins = 0, ties = 0, losses = 0, timeouts = 0, failures = 0;
+    int n_games, i;
+    char const *name = "";
+
+    if (parse_options(&bm.opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    n_games = 2 * bm.opt.games;
+    bm.games = malloc_or_die(n_games * sizeof *bm.games);
+    bm.bots = malloc_or_die(bm.opt.threads * sizeof *bm.bots);
+    ctxpool_init(&bm.ctx_pool, bm.opt.threads, 0, ai_size(&bm.opt.config));
+    bm.worker_ctx = malloc_or_die(bm.opt.threads * sizeof *bm.worker_ctx);
+    for (i = 0; i < bm.opt.threads; ++i) {
+        extbot_init(&bm.bots[i], bm.opt.command, bm.opt.binary, bm.opt.limit_ms);
+        bm.worker_ctx[i] = ctxpool_acquire(&bm.ctx_pool);
+    }
+
+    parallel_for(n_games, bm.opt.threads, play_job, &bm);
+
+    memset(&total, 0, sizeof total);
+    for (i = 0; i < bm.opt.threads; ++i) {
+        Ext_bot_stats const *s = &bm.bots[i].stats;
+        if (bm.bots[i].name[0])
+            name = bm.bots[i].name;
+        total.moves += s->moves;
+        total.starts += s->starts;
+        total.total_ms += s->total_ms;
+        if (s->max_ms > total.max_ms)
+            total.max_ms = s->max_ms;
+    }
+    for (i = 0; i < n_games; ++i) {
+        Match_game const *mg = &bm.games[i];
+        score += mg->result;
+        wins += mg->result == 1.0;
+        ties += mg->result == 0.5;
+        losses += mg->result == 0.0;
+        timeouts += mg->status == Ext_bot_status_Timeout;
+        failures += mg->status == Ext_bot_status_Failed;
+        ai_ms += mg->ai_ms;
+        ai_decisions += mg->ai_decisions;
+        if (mg->ai_max_ms > ai_max_ms)
+            ai_max_ms = mg->ai_max_ms;
+    }
+
+    /* Elo difference from the score, with half a game added to each side so that it stays finite */
+    fraction = (score + 0.5) / (n_games + 1.0);
+    printf("bot '%s' vs built-in AI: %d won, %d tied, %d lost (%.1f%%), Elo %+.0f\n", name, wins, ties, losses,
+           100.0 * score / n_games, 400.0 * log10(fraction / (1.0 - fraction)));
+    printf("forfeits: %d on time, %d on errors; bot started %lu times\n", timeouts, failures, total.starts);
+    printf("ms/decision: bot %.3f (max %.3f, %lu answered), built-in %.3f (max %.3f, %ld)\n",
+           total.moves ? total.total_ms / total.moves : 0, total.max_ms, total.moves,
+           ai_decisions ? ai_ms / ai_decisions : 0, ai_max_ms, ai_decisions);
+
+    for (i = 0; i < bm.opt.threads; ++i) {
+        extbot_stop(&bm.bots[i]);
+        ctxpool_release(&bm.ctx_pool, bm.worker_ctx[i]);
+    }
+    free(bm.worker_ctx);
+    ctxpool_deinit(&bm.ctx_pool);
+    free(bm.bots);
+    free(bm.games);
+    return EXIT_SUCCESS;
+}
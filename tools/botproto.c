@@ -0,0 +1,161 @@
+/**
+ * @file botproto.c
+ * @author Maksim Kovalkov
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tetris.h"
+#include "botproto.h"
+
+static char const piece_letters[] = "ITJLSZO";
+
+static unsigned char * put16(unsigned char *, unsigned);
+static unsigned get16(unsigned char const *);
+
+unsigned char *
+put16(unsigned char *p, unsigned v)
+{
+    *p++ = (unsigned char) (v >> 8 & 0xff);
+    *p++ = (unsigned char) (v & 0xff);
+    return p;
+}
+
+unsigned
+get16(unsigned char const *p)
+{
+    return (unsigned) p[0] << 8 | p[1];
+}
+
+size_t
+botproto_encode_position(unsigned char *buf, Game const *game, int binary, unsigned limit_ms)
+{
+    int const me = game->current_player;
+    /* in single player there is no opponent: its score is sent as 0 */
+    int const opp_score = game->kind == Game_kind_Singleplayer ? 0 : game->score[!me];
+    int i, j;
+
+    if (limit_ms > 0xffff)
+        limit_ms = 0xffff;
+
+    if (binary) {
+        unsigned char *p = buf;
+        *p++ = BOTPROTO_POSITION;
+        *p++ = game->kind != Game_kind_Singleplayer;
+        p = put16(p, (unsigned) game->score[me] & 0xffff);
+        p = put16(p, (unsigned) opp_score & 0xffff);
+        memcpy(p, game->pieces_left, 7);
+        p += 7;
+        for (i = 0; i < BOARD_ROWS; ++i, p += BOTPROTO_ROW_LEN) {
+            memset(p, 0, BOTPROTO_ROW_LEN);
+            for (j = 0; j < BOARD_COLS; ++j)
+                if (game->board[me][i][j])
+                    p[BOTPROTO_ROW_LEN - 1 - j / 8] |= (unsigned char) (1 << j % 8);
+        }
+        p = put16(p, limit_ms);
+        return p - buf;
+    } else {
+        char *p = (char *) buf;
+        p += sprintf(p, "position %s %d %d", game->kind == Game_kind_Singleplayer ? "single" : "vs",
+                     game->score[me], opp_score);
+        for (i = 0; i < 7; ++i)
+            p += sprintf(p, " %d", game->pieces_left[i]);
+        for (i = 0; i < BOARD_ROWS; ++i) {
+            *p++ = ' ';
+            for (j = 0; j < BOARD_COLS; ++j)
+                *p++ = game->board[me][i][j] ? 'x' : '.';
+        }
+        p += sprintf(p, "\ngo %u\n", limit_ms);
+        return p - (char *) buf;
+    }
+}
+
+int
+botproto_decode_position(Game *game, unsigned *limit_ms, unsigned char const *buf, int binary)
+{
+    int i, j;
+
+    if (binary) {
+        unsigned char const *p = buf;
+        if (*p++ != BOTPROTO_POSITION || *p > 1)
+            return -1;
+        game_init(game, *p++ ? Game_kind_Vs_ai : Game_kind_Singleplayer, 0);
+        game->score[0] = (int) get16(p);
+        game->score[1] = (int) get16(p + 2);
+        p += 4;
+        memcpy(game->pieces_left, p, 7);
+        p += 7;
+        for (i = 0; i < BOARD_ROWS; ++i, p += BOTPROTO_ROW_LEN) {
+            for (j = 0; j < BOARD_COLS; ++j)
+                game->board[0][i][j] = p[BOTPROTO_ROW_LEN - 1 - j / 8] >> j % 8 & 1 ? Tetrimino_type_O : 0;
+        }
+        *limit_ms = get16(p);
+    } else {
+        char const *p = (char const *) buf;
+        char kind[8];
+        int score[2], left[7], n;
+
+        if (sscanf(p, "position %7s %d %d %d %d %d %d %d %d %d%n", kind, &score[0], &score[1], &left[0], &left[1],
+                   &left[2], &left[3], &left[4], &left[5], &left[6], &n) != 10)
+            return -1;
+        if (strcmp(kind, "single") != 0 && strcmp(kind, "vs") != 0)
+            return -1;
+        game_init(game, strcmp(kind, "vs") == 0 ? Game_kind_Vs_ai : Game_kind_Singleplayer, 0);
+        game->score[0] = score[0];
+        game->score[1] = score[1];
+        for (i = 0; i < 7; ++i) {
+            if (left[i] < 0 || left[i] > 0xff)
+                return -1;
+            game->pieces_left[i] = (unsigned char) left[i];
+        }
+        p += n;
+        for (i = 0; i < BOARD_ROWS; ++i) {
+            if (*p++ != ' ')
+                return -1;
+            for (j = 0; j < BOARD_COLS; ++j, ++p) {
+                if (*p != '.' && *p != 'x')
+                    return -1;
+                game->board[0][i][j] = *p == 'x' ? Tetrimino_type_O : 0;
+            }
+        }
+        if (*p)
+            return -1;
+    }
+    return 0;
+}
+
+size_t
+botproto_encode_move(unsigned char *buf, Bot_move const *move, int binary)
+{
+    if (binary) {
+        buf[0] = move->type;
+        buf[1] = move->rots;
+        buf[2] = (unsigned char) (move->x + BOTPROTO_X_BIAS);
+        return BOTPROTO_MOVE_LEN;
+    }
+    return sprintf((char *) buf, "place %c %d %d\n",
+                   move->type >= Tetrimino_type_I && move->type <= Tetrimino_type_O ? piece_letters[move->type - 1] : '?',
+                   move->rots, move->x);
+}
+
+int
+botproto_decode_move(Bot_move *move, unsigned char const *buf, int binary)
+{
+    if (binary) {
+        move->type = buf[0];
+        move->rots = buf[1];
+        move->x = buf[2] - BOTPROTO_X_BIAS;
+    } else {
+        char letter;
+        int rots;
+        char const *found;
+
+        if (sscanf((char const *) buf, "place %c %d %d", &letter, &rots, &move->x) != 3
+            || letter == 0 || (found = strchr(piece_letters, letter)) == NULL || rots < 0 || rots > 0xff)
+            return -1;
+        move->type = (unsigned char) (found - piece_letters + Tetrimino_type_I);
+        move->rots = (unsigned char) rots;
+    }
+    return move->type >= Tetrimino_type_I && move->type <= Tetrimino_type_O ? 0 : -1;
+}
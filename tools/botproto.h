@@ -0,0 +1,86 @@
+/**
+ * @file botproto.h
+ * @author Maksim Kovalkov
+ *
+ * Protocol between x-tetris and an external bot: a separate program started as a child process, reading requests
+ * on its standard input and answering on its standard output (its standard error is left alone, for logging).
+ * The bot only ever sees whole positions, so it keeps no state between requests and may be restarted at any time.
+ *
+ * The host opens with one text line, `xtp 1 MODE ROWS COLS`, where MODE is `text` or `binary` and ROWS and COLS
+ * are the board dimensions; the bot answers `ready NAME`. Every request then asks for one decision: the piece to
+ * play, the clockwise rotations to give it from the shape it spawns in, and the column the piece (its `Piece.x`,
+ * after rotating) should be moved to before dropping it, one column at a time from where it spawns. A move that
+ * cannot be played, including a rotation refused because the piece would collide and a column the piece cannot get
+ * to, or no answer within the time limit, forfeits the game.
+ *
+ * Text mode, in the style of UCI:
+ * - host: `position KIND OWN OPP I T J L S Z O ROW...`, with KIND `single` or `vs`, the scores of the bot and of
+ *   its opponent, the count of each piece left, then every row of the bot's board from the top, one character per
+ *   cell (`.` empty, `x` full).
+ * - host: `go MS`, the time limit in milliseconds, counted from when the request is sent.
+ * - bot: `place P R X`, with P a piece letter (`I T J L S Z O`). Any other line (e.g. `info ...`) is ignored.
+ * - host: `quit` before closing the pipe.
+ *
+ * Binary mode, all integers big-endian:
+ * - host: `BOTPROTO_POSITION`, the kind (0 single, 1 vs), both scores on 16 bits, the 7 piece counts, every row from
+ *   the top on `BOTPROTO_ROW_LEN` bytes (bit j set if column j is full; 16 bits on a board of 10 columns), then the
+ *   time limit in milliseconds on 16 bits.
+ * - bot: 3 bytes, the piece (`enum Tetrimino_type`), the rotations, and the column plus `BOTPROTO_X_BIAS`.
+ * - host: `BOTPROTO_QUIT` before closing the pipe.
+ */
+
+#ifndef XTETRIS_BOTPROTO_H
+#define XTETRIS_BOTPROTO_H
+
+#include <stddef.h>
+
+#include "tetris.h"
+
+#define BOTPROTO_VERSION 1
+#define BOTPROTO_NAME_LEN 64
+/** Longest line either side sends in text mode, newline included. */
+#define BOTPROTO_LINE_LEN (128 + BOARD_ROWS * (BOARD_COLS + 1))
+
+#define BOTPROTO_POSITION 'P'
+#define BOTPROTO_QUIT 'Q'
+/** Bytes of a board row in binary mode. */
+#define BOTPROTO_ROW_LEN ((BOARD_COLS + 7) / 8)
+#define BOTPROTO_POSITION_LEN (1 + 1 + 2 * 2 + 7 + BOTPROTO_ROW_LEN * BOARD_ROWS + 2)
+#define BOTPROTO_MOVE_LEN 3
+#define BOTPROTO_X_BIAS 128
+/** Room for any request, both lines of a text one included. */
+#define BOTPROTO_REQUEST_MAX (BOTPROTO_LINE_LEN + 16)
+
+/** A decision, as the bot answers it. */
+typedef struct Bot_move {
+    /** An `enum Tetrimino_type`. */
+    unsigned char type;
+    unsigned char rots;
+    int x;
+} Bot_move;
+
+/**
+ * Write the request for the current player's decision in `game` to `buf` (at least `BOTPROTO_REQUEST_MAX` bytes),
+ * in text mode both the `position` and the `go` lines.
+ * @returns the length of the request.
+ */
+size_t botproto_encode_position(unsigned char *buf, Game const *, int binary, unsigned limit_ms);
+/**
+ * Rebuild a game from a request, with the bot as player 0 and about to choose a piece: in text mode from the
+ * `position` line (NUL-terminated, without the newline), in binary mode from a whole request, which also gives
+ * the time limit.
+ * @returns 0 on success, -1 if the request is malformed.
+ */
+int botproto_decode_position(Game *, unsigned *limit_ms, unsigned char const *buf, int binary);
+/**
+ * Write an answer to `buf` (at least `BOTPROTO_LINE_LEN` bytes).
+ * @returns its length.
+ */
+size_t botproto_encode_move(unsigned char *buf, Bot_move const *, int binary);
+/**
+ * Read an answer: in text mode a `place` line (NUL-terminated, without the newline), in binary mode
+ * `BOTPROTO_MOVE_LEN` bytes. Only the syntax is checked, not whether the move can be played.
+ * @returns 0 on success, -1 if it is malformed.
+ */
+int botproto_decode_move(Bot_move *, unsigned char const *buf, int binary);
+#endif /* ifndef XTETRIS_BOTPROTO_H */
@@ -0,0 +1,202 @@
+/**
+ * @file client.c
+ * @author Maksim Kovalkov
+ *
+ * Scripted client for x-tetris-server (see netproto.h), for testing and load generation.
+ * It keeps a local copy of the game, rebuilt from the frames the server sends, and plays one action at a time,
+ * waiting for the answer to each: either the actions read from standard input, or those of a local AI (`-a`).
+ *
+ * Script format: whitespace-separated action names, `I T J L S Z O` to choose a piece, `left right rotate drop` to
+ * place it, `clear` to continue after clearing lines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "delta.h"
+#include "netproto.h"
+
+static struct {
+    char const *name;
+    enum Game_action act;
+} const action_names[] = {
+    { "I", Game_action_Choose_I },
+    { "T", Game_action_Choose_T },
+    { "J", Game_action_Choose_J },
+    { "L", Game_action_Choose_L },
+    { "S", Game_action_Choose_S },
+    { "Z", Game_action_Choose_Z },
+    { "O", Game_action_Choose_O },
+    { "left", Game_action_Left },
+    { "right", Game_action_Right },
+    { "rotate", Game_action_Rotate },
+    { "drop", Game_action_Drop },
+    { "clear", Game_action_Finish_clearing }
+};
+
+#define ACTION_NAMES_N (sizeof action_names / sizeof action_names[0])
+
+static void usage(char const *);
+static int read_full(int, unsigned char *, size_t);
+static int read_frame(int, Game *, int);
+static int game_over(Game const *);
+static int my_turn(Game const *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [-S PATH] [-k single|vs] [-s SEED] [-a] [-v] < SCRIPT\n", argv0);
+    fputs(
+        "  -a        play with the built-in AI instead of reading a script\n"
+        "  -v        print a line for every frame received\n", stderr);
+}
+
+/**
+ * @returns 0 after reading exactly `len` bytes, -1 on error or end of file.
+ */
+int
+read_full(int fd, unsigned char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Receive one frame and apply it to the local copy of the game.
+ * @returns 0 on success, -1 if the connection was closed or the frame is malformed.
+ */
+int
+read_frame(int fd, Game *game, int verbose)
+{
+    unsigned char buf[DELTA_MAX_LEN];
+    size_t len;
+
+    if (read_full(fd, buf, NETPROTO_FRAME_HEADER_LEN) != 0)
+        return -1;
+    len = (size_t) buf[0] << 8 | buf[1];
+    if (len > sizeof buf || read_full(fd, buf, len) != 0 || delta_apply(game, buf, len) != 0)
+        return -1;
+    if (verbose)
+        printf("frame %3lu bytes: state %d, player %d, score %d-%d\n", (unsigned long) len, (int) game->state,
+               game->current_player, game->score[0], game->score[1]);
+    return 0;
+}
+
+int
+game_over(Game const *game)
+{
+    return game->state == Game_state_Win || game->state == Game_state_Lose;
+}
+
+/**
+ * @returns whether the server is waiting for an action from us (we are always player 1, i.e. index 0).
+ */
+int
+my_turn(Game const *game)
+{
+    return !game_over(game) && (game->kind == Game_kind_Singleplayer || game->current_player == 0);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sockaddr_un addr;
+    char const *path = NETPROTO_DEFAULT_PATH;
+    unsigned char hello[NETPROTO_HELLO_LEN];
+    unsigned long seed = 1;
+    enum Game_kind kind = Game_kind_Vs_ai;
+    int use_ai = 0, verbose = 0, connected = 1, fd, i;
+    unsigned long actions = 0;
+    Opponent_ai *ai = NULL;
+    Game game;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-a") == 0) {
+            use_ai = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            ++i;
+            kind = strcmp(argv[i], "single") == 0 ? Game_kind_Singleplayer : Game_kind_Vs_ai;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr *) &addr, sizeof addr) != 0) {
+        perror("cannot connect");
+        return EXIT_FAILURE;
+    }
+
+    hello[0] = NETPROTO_HELLO;
+    hello[1] = (unsigned char) kind;
+    hello[2] = (unsigned char) (seed >> 24 & 0xff);
+    hello[3] = (unsigned char) (seed >> 16 & 0xff);
+    hello[4] = (unsigned char) (seed >> 8 & 0xff);
+    hello[5] = (unsigned char) (seed & 0xff);
+    memset(&game, 0, sizeof game);
+    if (write(fd, hello, sizeof hello) != (ssize_t) sizeof hello || read_frame(fd, &game, verbose) != 0) {
+        fputs("no answer from the server\n", stderr);
+        return EXIT_FAILURE;
+    }
+    if (use_ai)
+        ai = ai_create(NULL);
+
+    while (connected) {
+        unsigned char act;
+
+        /* the AI opponent's move arrives as one more frame */
+        while (connected && !my_turn(&game) && !game_over(&game))
+            connected = read_frame(fd, &game, verbose) == 0;
+        if (!connected || game_over(&game))
+            break;
+
+        if (use_ai) {
+            act = (unsigned char) ai_next_action(ai, &game);
+        } else {
+            char token[16];
+            unsigned j;
+            if (scanf("%15s", token) != 1)
+                break;
+            for (j = 0; j < ACTION_NAMES_N && strcmp(token, action_names[j].name) != 0; ++j) /* nop */;
+            if (j == ACTION_NAMES_N) {
+                fprintf(stderr, "unknown action '%s'\n", token);
+                continue;
+            }
+            act = (unsigned char) action_names[j].act;
+        }
+
+        connected = write(fd, &act, 1) == 1 && read_frame(fd, &game, verbose) == 0;
+        ++actions;
+    }
+
+    if (ai)
+        ai_destroy(ai);
+    close(fd);
+    if (!connected) {
+        fputs("disconnected\n", stderr);
+        return EXIT_FAILURE;
+    }
+    printf("%lu actions, state %d, score %d-%d\n", actions, (int) game.state, game.score[0], game.score[1]);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file evalcheck.c
+ * @author Maksim Kovalkov
+ *
+ * Regression check between the two evaluation modes of the AI (`Ai_eval_Double` and `Ai_eval_Fixed`).
+ * A corpus of seeded games is played by the double AI; at every decision the fixed point AI is asked as well, from
+ * the same position, and the two resulting boards are compared. The exit status is 1 if any decision differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "selfplay.h"
+
+typedef struct Options {
+    int games, opening, verbose;
+    unsigned long seed;
+    enum Game_kind kind;
+    Ai_config config;
+} Options;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static double play_decision(Opponent_ai *, Game *);
+static int same_outcome(Game const *, Game const *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] [key=value...]\n", argv0);
+    fputs(
+        "  key=value pairs override fields of the configuration, as in ai_config_set.\n"
+        "  -g N      games in the corpus (default 50)\n"
+        "  -o N      random opening moves per game (default 4)\n"
+        "  -k KIND   single or vs (default vs)\n"
+        "  -s SEED   seed of the first game (default 1)\n"
+        "  -w FILE   configuration to start from (default: built-in)\n"
+        "  -v        print every decision that differs\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->games = 50;
+    opt->opening = 4;
+    opt->verbose = 0;
+    opt->seed = 1;
+    opt->kind = Game_kind_Vs_ai;
+    ai_config_default(&opt->config);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        char *value;
+        if (strcmp(a, "-v") == 0) {
+            opt->verbose = 1;
+        } else if (a[0] == '-') {
+            if (!a[1] || a[2] || i + 1 >= argc)
+                return -1;
+            ++i;
+            switch (a[1]) {
+            case 'g': opt->games = atoi(argv[i]); break;
+            case 'o': opt->opening = atoi(argv[i]); break;
+            case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+            case 'k': opt->kind = strcmp(argv[i], "single") == 0 ? Game_kind_Singleplayer : Game_kind_Vs_ai; break;
+            case 'w':
+                if (ai_config_load(&opt->config, argv[i]) != 0) {
+                    fprintf(stderr, "cannot load %s\n", argv[i]);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&opt->config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return opt->games < 1 ? -1 : 0;
+}
+
+/**
+ * Let the AI make the current player's decision and play it out, up to the drop.
+ * @returns the CPU time spent choosing, in seconds.
+ */
+double
+play_decision(Opponent_ai *ai, Game *game)
+{
+    clock_t const start = clock();
+    double seconds;
+
+    do_game_step(game, ai_next_action(ai, game));
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    while (game->state == Game_state_Place)
+        do_game_step(game, ai_next_action(ai, game));
+    return seconds;
+}
+
+/**
+ * @returns whether both games ended up in the same position after a decision.
+ */
+int
+same_outcome(Game const *a, Game const *b)
+{
+    return a->state == b->state && a->current_player == b->current_player
+        && memcmp(a->board, b->board, sizeof a->board) == 0
+        && memcmp(a->pieces_left, b->pieces_left, sizeof a->pieces_left) == 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    Options opt;
+    Ai_config config;
+    Opponent_ai *ai_double, *ai_fixed;
+    double seconds[2] = { 0, 0 };
+    long decisions = 0, differ = 0;
+    int g;
+
+    if (parse_options(&opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    config = opt.config;
+    config.eval = Ai_eval_Double;
+    ai_double = ai_create(&config);
+    config.eval = Ai_eval_Fixed;
+    ai_fixed = ai_create(&config);
+
+    for (g = 0; g < opt.games; ++g) {
+        Game game, other;
+        int move = 0;
+
+        game_init(&game, opt.kind, opt.seed + g);
+        selfplay_random_opening(&game, opt.opening);
+        while (game.state != Game_state_Win && game.state != Game_state_Lose) {
+            if (game.state != Game_state_Choose) {
+                do_game_step(&game, ai_next_action(ai_double, &game));
+                continue;
+            }
+            other = game;
+            seconds[1] += play_decision(ai_fixed, &other);
+            seconds[0] += play_decision(ai_double, &game);
+            ++decisions;
+            ++move;
+            if (!same_outcome(&game, &other)) {
+                ++differ;
+                if (opt.verbose)
+                    printf("seed %lu, move %d: the fixed point AI plays differently\n", opt.seed + g, move);
+            }
+        }
+    }
+
+    printf("%ld decisions, %ld differ (%.3f%%)\n", decisions, differ, 100.0 * differ / (decisions ? decisions : 1));
+    printf("ms/decision: double %.3f, fixed %.3f\n", 1e3 * seconds[0] / (decisions ? decisions : 1),
+           1e3 * seconds[1] / (decisions ? decisions : 1));
+
+    ai_destroy(ai_double);
+    ai_destroy(ai_fixed);
+    return differ ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,365 @@
+/**
+ * @file extbot.c
+ * @author Maksim Kovalkov
+ *
+ * Every read from the bot goes through `poll`, with the time left before the deadline of the current request:
+ * a bot that hangs, loops or answers too late is detected without any extra thread, then killed.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tetris.h"
+#include "botproto.h"
+#include "extbot.h"
+
+/** Time given to a bot to exit after `quit`, before it is killed. */
+#define QUIT_GRACE_MS 100
+
+/** Serializes process creation, so that no other thread forks while pipes are still inheritable. */
+static pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int spawn(Ext_bot *);
+static int write_all(int, unsigned char const *, size_t);
+static int fill(Ext_bot *, double);
+static int read_line(Ext_bot *, char *, double);
+static int read_bytes(Ext_bot *, unsigned char *, size_t, double);
+static void consume(Ext_bot *, size_t);
+static int handshake(Ext_bot *);
+static void kill_bot(Ext_bot *);
+
+double
+extbot_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/**
+ * Start the bot process with its standard input and output connected to our pipes.
+ * @returns 0 on success, -1 on failure.
+ */
+int
+spawn(Ext_bot *bot)
+{
+    int in[2], out[2];
+    pid_t pid;
+
+    pthread_mutex_lock(&spawn_lock);
+    if (pipe(in) != 0) {
+        pthread_mutex_unlock(&spawn_lock);
+        return -1;
+    }
+    if (pipe(out) != 0) {
+        close(in[0]);
+        close(in[1]);
+        pthread_mutex_unlock(&spawn_lock);
+        return -1;
+    }
+    /* our ends must not leak into other bots started later */
+    fcntl(in[1], F_SETFD, FD_CLOEXEC);
+    fcntl(out[0], F_SETFD, FD_CLOEXEC);
+
+    pid = fork();
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(out[1]);
+        execl("/bin/sh", "sh", "-c", bot->command, (char *) NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    pthread_mutex_unlock(&spawn_lock);
+
+    if (pid < 0) {
+        close(in[1]);
+        close(out[0]);
+        return -1;
+    }
+    bot->pid = pid;
+    bot->to_bot = in[1];
+    bot->from_bot = out[0];
+    bot->in_len = 0;
+    ++bot->stats.starts;
+    return 0;
+}
+
+/**
+ * @returns 0 after writing the whole buffer, -1 on error (e.g. the bot exited).
+ */
+int
+write_all(int fd, unsigned char const *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t const n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Wait until the bot sends more bytes, or until `deadline` (as given by `extbot_now_ms`).
+ * @returns 1 after reading some, 0 on timeout, -1 on end of file, error, or if the buffer is full.
+ */
+int
+fill(Ext_bot *bot, double deadline)
+{
+    struct pollfd pfd;
+    ssize_t n;
+
+    if (bot->in_len == sizeof bot->in)
+        return -1;
+    pfd.fd = bot->from_bot;
+    pfd.events = POLLIN;
+    for (;;) {
+        double const left = deadline - extbot_now_ms();
+        int ready;
+        if (left <= 0)
+            return 0;
+        ready = poll(&pfd, 1, (int) left + 1);
+        if (ready > 0)
+            break;
+        if (ready < 0 && errno != EINTR)
+            return -1;
+    }
+    do
+        n = read(bot->from_bot, bot->in + bot->in_len, sizeof bot->in - bot->in_len);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return -1;
+    bot->in_len += n;
+    return 1;
+}
+
+void
+consume(Ext_bot *bot, size_t len)
+{
+    memmove(bot->in, bot->in + len, bot->in_len - len);
+    bot->in_len -= len;
+}
+
+/**
+ * Read one line, without its newline, into `line` (at least `BOTPROTO_LINE_LEN` bytes).
+ * @returns as `fill`.
+ */
+int
+read_line(Ext_bot *bot, char *line, double deadline)
+{
+    for (;;) {
+        unsigned char *const nl = memchr(bot->in, '\n', bot->in_len);
+        int status;
+        if (nl) {
+            size_t const len = nl - bot->in;
+            memcpy(line, bot->in, len);
+            line[len] = 0;
+            if (len > 0 && line[len - 1] == '\r')
+                line[len - 1] = 0;
+            consume(bot, len + 1);
+            return 1;
+        }
+        if ((status = fill(bot, deadline)) != 1)
+            return status;
+    }
+}
+
+/**
+ * Read exactly `len` bytes.
+ * @returns as `fill`.
+ */
+int
+read_bytes(Ext_bot *bot, unsigned char *buf, size_t len, double deadline)
+{
+    while (bot->in_len < len) {
+        int const status = fill(bot, deadline);
+        if (status != 1)
+            return status;
+    }
+    memcpy(buf, bot->in, len);
+    consume(bot, len);
+    return 1;
+}
+
+/**
+ * Send the opening line and wait for `ready`.
+ * @returns as `fill`.
+ */
+int
+handshake(Ext_bot *bot)
+{
+    char line[BOTPROTO_LINE_LEN];
+    double const deadline = extbot_now_ms() + EXTBOT_HANDSHAKE_MS;
+    int status;
+
+    status = sprintf(line, "xtp %d %s %d %d\n", BOTPROTO_VERSION, bot->binary ? "binary" : "text", BOARD_ROWS,
+                     BOARD_COLS);
+    if (write_all(bot->to_bot, (unsigned char *) line, status) != 0)
+        return -1;
+    do {
+        if ((status = read_line(bot, line, deadline)) != 1)
+            return status;
+    } while (strncmp(line, "ready", 5) != 0 || (line[5] != ' ' && line[5] != 0));
+
+    bot->name[0] = 0;
+    if (line[5])
+        sprintf(bot->name, "%.*s", BOTPROTO_NAME_LEN - 1, line + 6);
+    return 1;
+}
+
+/**
+ * Stop the bot at once, without asking.
+ */
+void
+kill_bot(Ext_bot *bot)
+{
+    if (!bot->pid)
+        return;
+    close(bot->to_bot);
+    close(bot->from_bot);
+    kill((pid_t) bot->pid, SIGKILL);
+    while (waitpid((pid_t) bot->pid, NULL, 0) < 0 && errno == EINTR) /* nop */;
+    bot->pid = 0;
+}
+
+void
+extbot_init(Ext_bot *bot, char const *command, int binary, unsigned limit_ms)
+{
+    memset(bot, 0, sizeof *bot);
+    bot->command = command;
+    bot->binary = binary;
+    bot->limit_ms = limit_ms;
+}
+
+enum Ext_bot_status
+extbot_choose(Ext_bot *bot, Game const *game, Bot_move *move)
+{
+    unsigned char buf[BOTPROTO_REQUEST_MAX];
+    double start = 0, deadline;
+    size_t len;
+    int status;
+
+    if (!bot->pid) {
+        if (spawn(bot) != 0) {
+            ++bot->stats.failures;
+            return Ext_bot_status_Failed;
+        }
+        status = handshake(bot);
+    } else {
+        status = 1;
+    }
+
+    if (status == 1) {
+        len = botproto_encode_position(buf, game, bot->binary, bot->limit_ms);
+        start = extbot_now_ms();
+        deadline = start + bot->limit_ms;
+        if (write_all(bot->to_bot, buf, len) != 0) {
+            status = -1;
+        } else if (bot->binary) {
+            if ((status = read_bytes(bot, buf, BOTPROTO_MOVE_LEN, deadline)) == 1)
+                status = botproto_decode_move(move, buf, 1) == 0 ? 1 : -1;
+        } else {
+            /* skip whatever the bot says before its move, as in `info` lines */
+            while ((status = read_line(bot, (char *) buf, deadline)) == 1 && strncmp((char *) buf, "place ", 6) != 0)
+                /* nop */;
+            if (status == 1)
+                status = botproto_decode_move(move, buf, 0) == 0 ? 1 : -1;
+        }
+    }
+
+    if (status == 1) {
+        double const ms = extbot_now_ms() - start;
+        if (!game->pieces_left[move->type - 1] || move->rots > 3 || move->x <= -4 || move->x >= BOARD_COLS)
+            status = -1;
+        else if (ms > bot->limit_ms)
+            status = 0;
+        else {
+            ++bot->stats.moves;
+            bot->stats.total_ms += ms;
+            if (ms > bot->stats.max_ms)
+                bot->stats.max_ms = ms;
+            return Ext_bot_status_Ok;
+        }
+    }
+    kill_bot(bot);
+    if (status == 0) {
+        ++bot->stats.timeouts;
+        return Ext_bot_status_Timeout;
+    }
+    ++bot->stats.failures;
+    return Ext_bot_status_Failed;
+}
+
+enum Ext_bot_status
+extbot_play(Ext_bot *bot, Game *game, Bot_move const *move)
+{
+    Piece rotated;
+    int i, last_x, refused;
+
+    do_game_step(game, (enum Game_action) (Game_action_Choose_I + move->type - Tetrimino_type_I));
+    /* a rotation that collides is refused: the piece must end up in the shape the move asks for */
+    rotated = game->active_piece;
+    for (i = 0; i < move->rots; ++i) {
+        do_game_step(game, Game_action_Rotate);
+        rotate_shape_cw(rotated.shape);
+    }
+    refused = game->state == Game_state_Place
+        && memcmp(rotated.shape, game->active_piece.shape, sizeof rotated.shape) != 0;
+    /* as the built-in AI does: move until the column is reached or the piece is stuck */
+    do {
+        last_x = game->active_piece.x;
+        if (last_x < move->x)
+            do_game_step(game, Game_action_Right);
+        else if (last_x > move->x)
+            do_game_step(game, Game_action_Left);
+    } while (!refused && game->active_piece.x != last_x);
+    if (refused || game->active_piece.x != move->x) {
+        kill_bot(bot);
+        ++bot->stats.failures;
+        return Ext_bot_status_Failed;
+    }
+    do_game_step(game, Game_action_Drop);
+    return Ext_bot_status_Ok;
+}
+
+void
+extbot_stop(Ext_bot *bot)
+{
+    unsigned char const quit_binary = BOTPROTO_QUIT;
+    int waited;
+
+    if (!bot->pid)
+        return;
+    if (bot->binary)
+        write_all(bot->to_bot, &quit_binary, 1);
+    else
+        write_all(bot->to_bot, (unsigned char const *) "quit\n", 5);
+    close(bot->to_bot);
+    close(bot->from_bot);
+    for (waited = 0; waited < QUIT_GRACE_MS; waited += 5) {
+        struct timespec const pause = { 0, 5000000L };
+        if (waitpid((pid_t) bot->pid, NULL, WNOHANG) == (pid_t) bot->pid) {
+            bot->pid = 0;
+            return;
+        }
+        nanosleep(&pause, NULL);
+    }
+    kill((pid_t) bot->pid, SIGKILL);
+    while (waitpid((pid_t) bot->pid, NULL, 0) < 0 && errno == EINTR) /* nop */;
+    bot->pid = 0;
+}
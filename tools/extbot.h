@@ -0,0 +1,83 @@
+/**
+ * @file extbot.h
+ * @author Maksim Kovalkov
+ *
+ * Host side of the external bot protocol (see botproto.h): runs a bot as a child process connected through pipes,
+ * asks it for decisions under a time limit and keeps track of how long it takes to answer (POSIX only).
+ * Programs using it should ignore `SIGPIPE`, which a bot exiting unexpectedly would otherwise raise.
+ */
+
+#ifndef XTETRIS_EXTBOT_H
+#define XTETRIS_EXTBOT_H
+
+#include <stddef.h>
+
+#include "tetris.h"
+#include "botproto.h"
+
+/** Time a bot is given to start and answer the opening line, in milliseconds. */
+#define EXTBOT_HANDSHAKE_MS 5000
+
+enum Ext_bot_status {
+    Ext_bot_status_Ok,
+    /** No complete answer within the time limit. */
+    Ext_bot_status_Timeout,
+    /** The bot could not be started, exited, or answered something malformed or a move that cannot be played. */
+    Ext_bot_status_Failed
+};
+
+/** Per-move accounting, over the lifetime of an `Ext_bot` (restarts included). */
+typedef struct Ext_bot_stats {
+    /** Decisions answered in time, and those that were not. */
+    unsigned long moves, timeouts, failures;
+    /** Process starts. */
+    unsigned long starts;
+    /** Latency of the answered decisions, from sending the request to reading the whole answer (wall clock). */
+    double total_ms, max_ms;
+} Ext_bot_stats;
+
+typedef struct Ext_bot {
+    /** Shell command starting the bot, run with `/bin/sh -c`. */
+    char const *command;
+    int binary;
+    unsigned limit_ms;
+    /** Process id of the bot, or 0 if it is not running. */
+    long pid;
+    int to_bot, from_bot;
+    /** As given by the bot in its `ready` line. */
+    char name[BOTPROTO_NAME_LEN];
+    /** Bytes read from the bot and not consumed yet. */
+    unsigned char in[BOTPROTO_LINE_LEN];
+    size_t in_len;
+    Ext_bot_stats stats;
+} Ext_bot;
+
+/**
+ * Set up a bot without starting it: that happens on the first decision asked, and again after every failure.
+ */
+void extbot_init(Ext_bot *, char const *command, int binary, unsigned limit_ms);
+/**
+ * Start the bot if it is not running, and ask it for the current player's decision in `game`, which must be in
+ * `Game_state_Choose`. Whatever the bot answers is checked to be playable: the piece must be left, with less than
+ * 4 rotations and a column that keeps some of the piece on the board.
+ * On anything but `Ext_bot_status_Ok` the bot is killed: its answers can no longer be matched to requests.
+ */
+enum Ext_bot_status extbot_choose(Ext_bot *, Game const *, Bot_move *);
+/**
+ * Play a move returned by `extbot_choose` in `game`, up to and including the drop. The piece is rotated, then moved
+ * as the built-in AI moves its own; if a rotation is refused, or the moves do not bring it to the column of the
+ * move, because of the walls or the blocks in the way, the move cannot be played: nothing is dropped, and the bot
+ * is killed as in `extbot_choose`.
+ * @returns `Ext_bot_status_Ok` if the move was played, `Ext_bot_status_Failed` otherwise.
+ */
+enum Ext_bot_status extbot_play(Ext_bot *, Game *, Bot_move const *);
+/**
+ * Wall clock time in milliseconds, from an arbitrary origin: the bot runs in another process, so the CPU time of the
+ * calling thread would not count its work. Latencies of `Ext_bot_stats` are measured with it.
+ */
+double extbot_now_ms(void);
+/**
+ * Ask the bot to quit, and kill it if it does not do so promptly. Nothing happens if it is not running.
+ */
+void extbot_stop(Ext_bot *);
+#endif /* ifndef XTETRIS_EXTBOT_H */
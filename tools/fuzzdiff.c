@@ -0,0 +1,532 @@
+/**
+ * @file fuzzdiff.c
+ * @author Maksim Kovalkov
+ *
+ * Differential fuzzing of the engine's hot kernels against their reference implementation (see reference.h).
+ * Random boards and pieces (sparse, stacked with holes, nearly full, with pieces just placed on them), and the
+ * positions of random games played with random legal actions, are given to both implementations of every kernel,
+ * and their results and the boards they leave must be identical. With `-p`, the same inputs are timed instead, and
+ * the speed of each optimized kernel is reported relative to the reference.
+ *
+ * Built with `-DXTETRIS_LIBFUZZER` (see `make fuzzdiff-libfuzzer`), the file is a libFuzzer target instead: the
+ * fuzzer's input bytes drive the same generators, and a difference aborts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "xtetris.h"
+#include "rng.h"
+#include "util.h"
+#include "reference.h"
+
+/** Cases generated for `-p`, all timed together. */
+#define PERF_CASES 4096
+/** Most actions of a random game that are checked. */
+#define GAME_STEPS_MAX 2000
+
+/** Where the random choices come from: a seeded generator, or the bytes of a fuzzer input. */
+typedef struct Source {
+    Rng rng;
+    /** The fuzzer input if not NULL: each choice takes the next byte(s), and 0 once they run out. */
+    unsigned char const *data;
+    size_t size, pos;
+} Source;
+
+/** A generated input of the kernels. */
+typedef struct Case {
+    Board board;
+    Piece piece;
+    Ai_weights weights;
+    /** For timing the clearing kernels: `piece` dropped from the top and locked on `board`, as in play. */
+    Board placed;
+    Piece landed;
+} Case;
+
+typedef struct Options {
+    long boards, games;
+    int perf, reps;
+    unsigned long seed;
+} Options;
+
+static unsigned long draw(Source *, unsigned long);
+static void random_board(Source *, Board);
+static void random_piece(Source *, Piece *);
+static void random_weights(Source *, Ai_weights *);
+static void random_case(Source *, Case *);
+static void report(char const *, Board const, Piece const *);
+static int check_kernels(Board const, Piece const *, Ai_weights const *);
+#ifndef ROW_BITS_WORDS
+static int check_landing(Board const, Piece const *);
+#endif
+static int check_case(Source *);
+static int check_game(Source *);
+
+/** Set by `report`, for the caller to stop. */
+static long g_failures;
+
+unsigned long
+draw(Source *src, unsigned long n)
+{
+    unsigned long v = 0;
+
+    if (!src->data)
+        return rng_below(&src->rng, n);
+    if (src->pos < src->size)
+        v = src->data[src->pos++];
+    if (n > 256 && src->pos < src->size)
+        v = v << 8 | src->data[src->pos++];
+    return v % n;
+}
+
+/**
+ * A board of one of several kinds, filled with blocks of random types (never `Block_type_Clear`).
+ */
+void
+random_board(Source *src, Board board)
+{
+    int const kind = (int) draw(src, 4);
+    int i, j, density = (int) draw(src, 101);
+
+    memset(board, 0, sizeof (Board));
+    switch (kind) {
+    case 0:
+        /* uniform, any density */
+        for (i = 0; i < BOARD_ROWS; ++i)
+            for (j = 0; j < BOARD_COLS; ++j)
+                if ((int) draw(src, 100) < density)
+                    board[i][j] = (unsigned char) (Tetrimino_type_I + draw(src, 7));
+        break;
+    case 1:
+    case 2:
+        /* a skyline of columns with holes, as in play; and with some full rows */
+        density = 60 + density * 2 / 5;
+        for (j = 0; j < BOARD_COLS; ++j) {
+            int const height = (int) draw(src, BOARD_ROWS + 1);
+            for (i = BOARD_ROWS - height; i < BOARD_ROWS; ++i)
+                if (i == BOARD_ROWS - height || (int) draw(src, 100) < density)
+                    board[i][j] = (unsigned char) (Tetrimino_type_I + draw(src, 7));
+        }
+        if (kind == 2)
+            for (j = (int) draw(src, 5); j > 0; --j)
+                memset(board[draw(src, BOARD_ROWS)], Tetrimino_type_O, BOARD_COLS);
+        break;
+    default:
+        /* full rows, some with a gap */
+        for (i = BOARD_ROWS - 1 - (int) draw(src, BOARD_ROWS); i < BOARD_ROWS; ++i) {
+            memset(board[i], Tetrimino_type_T, BOARD_COLS);
+            if ((int) draw(src, 100) >= density)
+                board[i][draw(src, BOARD_COLS)] = Block_type_Empty;
+        }
+        break;
+    }
+}
+
+/**
+ * A piece of any type and rotation, anywhere on or around the board.
+ */
+void
+random_piece(Source *src, Piece *p)
+{
+    int rots;
+
+    p->type = (unsigned char) (Tetrimino_type_I + draw(src, 7));
+    init_piece_shape(p);
+    for (rots = (int) draw(src, 4); rots > 0; --rots)
+        ref_rotate_shape_cw(p->shape);
+    p->x = (int) draw(src, BOARD_COLS + 6) - 3;
+    p->y = (int) draw(src, BOARD_ROWS + 6) - 3;
+}
+
+/**
+ * Weights of either sign and of very different magnitudes.
+ */
+void
+random_weights(Source *src, Ai_weights *w)
+{
+    int i;
+
+    for (i = 0; i < AI_WEIGHTS_N; ++i)
+        *ai_weight(w, i) = ((double) draw(src, 2001) - 1000) / (1 << draw(src, 8));
+}
+
+void
+random_case(Source *src, Case *c)
+{
+    random_board(src, c->board);
+    random_piece(src, &c->piece);
+    random_weights(src, &c->weights);
+}
+
+#ifndef ROW_BITS_WORDS
+/**
+ * Drop `p` from where it is on the bitboards of `board`, as the AI's searches do, and compare where it lands (or that
+ * it does not fit) with `ref_collides` then `ref_drop_piece`.
+ */
+int
+check_landing(Board const board, Piece const *p)
+{
+    Row_bits rows[BOARD_ROWS];
+    int top[BOARD_COLS];
+    Piece_bits bits;
+    Piece pr = *p;
+    int i, landing, expected = BOARD_ROWS;
+
+    for (i = 0; i < BOARD_ROWS; ++i)
+        rows[i] = row_bits_pack(board[i]);
+    row_bits_tops(rows, top);
+    piece_bits_init(&bits, p);
+    landing = piece_bits_landing(&bits, rows, top, p->x, p->y);
+    if (!ref_collides(&pr, board)) {
+        ref_drop_piece(&pr, board);
+        expected = pr.y;
+    }
+    if (landing != expected) {
+        report("piece_bits_landing", board, p);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * Print a difference in `kernel`, with its input.
+ */
+void
+report(char const *kernel, Board const board, Piece const *p)
+{
+    int i, j;
+
+    ++g_failures;
+    fprintf(stderr, "%s differs from the reference; piece %d at x=%d y=%d, shape", kernel, p->type, p->x, p->y);
+    for (i = 0; i < 4; ++i) {
+        fputc(' ', stderr);
+        for (j = 0; j < 4; ++j)
+            fputc(p->shape[i][j] ? '#' : '.', stderr);
+    }
+    fputs(", board:\n", stderr);
+    for (i = 0; i < BOARD_ROWS; ++i) {
+        for (j = 0; j < BOARD_COLS; ++j)
+            fputc(board[i][j] == Block_type_Clear ? '=' : board[i][j] ? '#' : '.', stderr);
+        fputc('\n', stderr);
+    }
+#ifdef XTETRIS_LIBFUZZER
+    abort();
+#endif
+}
+
+/**
+ * Run every kernel on the input, in both implementations.
+ * @returns 0 if they all agree, -1 otherwise (reported).
+ */
+int
+check_kernels(Board const board, Piece const *p, Ai_weights const *w)
+{
+    Board mine, ref;
+    Piece pm = *p, pr = *p;
+    Ai_features fm, fr;
+    int n_mine, n_ref, placed;
+
+    rotate_shape_cw(pm.shape);
+    ref_rotate_shape_cw(pr.shape);
+    if (memcmp(pm.shape, pr.shape, sizeof pm.shape) != 0)
+        report("rotate_shape_cw", board, p);
+
+    if (collides(p, board) != ref_collides(p, board)) {
+        report("collides", board, p);
+        return -1;
+    }
+#ifndef ROW_BITS_WORDS
+    if (check_landing(board, p) != 0)
+        return -1;
+#endif
+
+    memcpy(mine, board, sizeof mine);
+    memcpy(ref, board, sizeof ref);
+    placed = !ref_collides(p, board);
+    if (placed) {
+        /* drop the piece and lock it, so that clearing works on boards just played on */
+        pm = pr = *p;
+        drop_piece(&pm, board);
+        ref_drop_piece(&pr, board);
+        if (pm.y != pr.y) {
+            report("drop_piece", board, p);
+            return -1;
+        }
+        place_piece(&pr, mine, pr.type);
+        place_piece(&pr, ref, pr.type);
+    }
+
+    ai_board_features(mine, &fm);
+    ref_board_features(ref, &fr);
+    if (fm.max_height != fr.max_height || fm.lines != fr.lines || fm.holes != fr.holes || fm.bumps != fr.bumps
+     || fm.row_trans != fr.row_trans || fm.col_trans != fr.col_trans || fm.wells != fr.wells
+     || fm.covered != fr.covered)
+        report("ai_board_features", ref, p);
+    if (ai_heuristic(w, mine) != ref_heuristic(w, ref))
+        report("ai_heuristic", ref, p);
+
+    if (placed) {
+        n_mine = mark_cleared_lines(mine, &pr);
+        n_ref = ref_mark_cleared_lines(ref);
+        if (n_mine != n_ref || memcmp(mine, ref, sizeof mine) != 0) {
+            report("mark_cleared_lines", ref, &pr);
+            return -1;
+        }
+        remove_cleared_lines(mine);
+        ref_remove_cleared_lines(ref);
+        if (memcmp(mine, ref, sizeof mine) != 0)
+            report("remove_cleared_lines", ref, &pr);
+    }
+    return g_failures ? -1 : 0;
+}
+
+/**
+ * Check one random board and piece.
+ */
+int
+check_case(Source *src)
+{
+    Case c;
+
+    random_case(src, &c);
+    /* as in play, the full lines of earlier placements are gone (but for the top one; see `mark_cleared_lines`) */
+    ref_mark_cleared_lines(c.board);
+    ref_remove_cleared_lines(c.board);
+    return check_kernels(c.board, &c.piece, &c.weights);
+}
+
+/**
+ * Play a random game with random legal actions, checking the kernels on its board before every action: with the
+ * active piece while there is one, with a random one dropped from the top otherwise. In single player games,
+ * garbage is now and then added to the board about to be played on, as in a match.
+ */
+int
+check_game(Source *src)
+{
+    Game game;
+    Xtetris_config config;
+    Ai_weights w;
+    int steps;
+
+    config.kind = draw(src, 2) ? Game_kind_Vs_ai : Game_kind_Singleplayer;
+    config.seed = draw(src, 1UL << 16);
+    xtetris_init(&game, &config);
+    random_weights(src, &w);
+
+    for (steps = 0; steps < GAME_STEPS_MAX && !xtetris_over(&game); ++steps) {
+        enum Game_action actions[XTETRIS_ACTIONS_MAX];
+        int const n = xtetris_legal_actions(&game, actions);
+        Piece p;
+
+        if (game.state == Game_state_Place) {
+            p = game.active_piece;
+        } else {
+            random_piece(src, &p);
+            lift_piece(&p, game.board[game.current_player]);
+        }
+        /* at most once per placement, as in play: two batches would invert each other */
+        if (game.kind == Game_kind_Singleplayer && game.state == Game_state_Choose && !draw(src, 16))
+            add_garbage(game.board[game.current_player], 1 + (int) draw(src, 4), &game.rng);
+        /* the board holds marked lines while they are being cleared, which the clearing kernels do not expect */
+        if (game.state != Game_state_Cleared && check_kernels(game.board[game.current_player], &p, &w) != 0)
+            return -1;
+        /* mostly moves and rotations, so that pieces travel before they drop */
+        if (game.state == Game_state_Place && draw(src, 4))
+            xtetris_step(&game, actions[draw(src, 3)]);
+        else
+            xtetris_step(&game, actions[draw(src, (unsigned long) n)]);
+    }
+    return 0;
+}
+
+#ifdef XTETRIS_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(unsigned char const *, size_t);
+
+int
+LLVMFuzzerTestOneInput(unsigned char const *data, size_t size)
+{
+    Source src;
+
+    /* an empty input must not fall back to the generator */
+    src.data = size ? data : (unsigned char const *) "";
+    src.size = size;
+    src.pos = 0;
+    if (draw(&src, 2))
+        check_game(&src);
+    else
+        check_case(&src);
+    return 0;
+}
+
+#else
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static double cpu_seconds(void);
+static void perf(Options const *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options]\n", argv0);
+    fputs(
+        "  -n N      random boards and pieces to check (default 200000)\n"
+        "  -g N      random games to check (default 2000)\n"
+        "  -s SEED   seed (default 1)\n"
+        "  -p        time the kernels on the same inputs instead of checking them\n"
+        "  -r N      passes over the inputs with -p (default 50)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->boards = 200000;
+    opt->games = 2000;
+    opt->perf = 0;
+    opt->reps = 50;
+    opt->seed = 1;
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        if (strcmp(a, "-p") == 0) {
+            opt->perf = 1;
+            continue;
+        }
+        if (a[0] != '-' || !a[1] || a[2] || i + 1 >= argc)
+            return -1;
+        ++i;
+        switch (a[1]) {
+        case 'n': opt->boards = atol(argv[i]); break;
+        case 'g': opt->games = atol(argv[i]); break;
+        case 'r': opt->reps = atoi(argv[i]); break;
+        case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+        default:
+            return -1;
+        }
+    }
+    return opt->boards >= 0 && opt->games >= 0 && opt->reps > 0 ? 0 : -1;
+}
+
+double
+cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Time both implementations of every kernel over the same `PERF_CASES` inputs, `reps` times each.
+ */
+void
+perf(Options const *opt)
+{
+    static char const *const names[] = {
+        "rotate_shape_cw", "collides", "drop_piece", "clear lines", "ai_heuristic"
+    };
+    Case *const cases = malloc_or_die(PERF_CASES * sizeof *cases);
+    Source src;
+    volatile double sink = 0;
+    int k, impl, r, i;
+
+    rng_seed(&src.rng, opt->seed);
+    src.data = NULL;
+    for (i = 0; i < PERF_CASES; ++i) {
+        Case *const c = &cases[i];
+        random_case(&src, c);
+        /* drop_piece needs a piece that fits to start from */
+        if (ref_collides(&c->piece, c->board))
+            lift_piece(&c->piece, c->board);
+        memcpy(c->placed, c->board, sizeof c->placed);
+        ref_mark_cleared_lines(c->placed);
+        ref_remove_cleared_lines(c->placed);
+        c->landed = c->piece;
+        lift_piece(&c->landed, c->placed);
+        if (!ref_collides(&c->landed, c->placed)) {
+            ref_drop_piece(&c->landed, c->placed);
+            place_piece(&c->landed, c->placed, c->landed.type);
+        }
+    }
+
+    printf("%-16s %12s %12s %8s\n", "kernel", "ref ns/call", "opt ns/call", "speedup");
+    for (k = 0; k < 5; ++k) {
+        double ns[2];
+        for (impl = 0; impl < 2; ++impl) {
+            double const start = cpu_seconds();
+            for (r = 0; r < opt->reps; ++r) {
+                for (i = 0; i < PERF_CASES; ++i) {
+                    Case *const c = &cases[i];
+                    Piece p = c->piece;
+                    Board b;
+                    switch (k) {
+                    case 0:
+                        (impl ? rotate_shape_cw : ref_rotate_shape_cw)(p.shape);
+                        sink += p.shape[1][1];
+                        break;
+                    case 1:
+                        sink += (impl ? collides : ref_collides)(&p, c->board);
+                        break;
+                    case 2:
+                        (impl ? drop_piece : ref_drop_piece)(&p, c->board);
+                        sink += p.y;
+                        break;
+                    case 3:
+                        memcpy(b, c->placed, sizeof b);
+                        sink += impl ? mark_cleared_lines(b, &c->landed) : ref_mark_cleared_lines(b);
+                        (impl ? remove_cleared_lines : ref_remove_cleared_lines)(b);
+                        sink += b[BOARD_ROWS-1][0];
+                        break;
+                    default:
+                        sink += (impl ? ai_heuristic : ref_heuristic)(&c->weights, c->board);
+                        break;
+                    }
+                }
+            }
+            ns[impl] = (cpu_seconds() - start) * 1e9 / ((double) opt->reps * PERF_CASES);
+        }
+        printf("%-16s %12.1f %12.1f %7.2fx\n", names[k], ns[0], ns[1], ns[1] > 0 ? ns[0] / ns[1] : 0);
+    }
+    free(cases);
+}
+
+int
+main(int argc, char **argv)
+{
+    Options opt;
+    Source src;
+    long i;
+
+    if (parse_options(&opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (opt.perf) {
+        perf(&opt);
+        return EXIT_SUCCESS;
+    }
+
+    rng_seed(&src.rng, opt.seed);
+    src.data = NULL;
+    for (i = 0; i < opt.boards && !g_failures; ++i)
+        check_case(&src);
+    for (i = 0; i < opt.games && !g_failures; ++i)
+        check_game(&src);
+
+    if (g_failures) {
+        fprintf(stderr, "seed %lu: kernels differ from the reference\n", opt.seed);
+        return EXIT_FAILURE;
+    }
+    printf("seed %lu: %ld boards and %ld games, every kernel matches the reference\n", opt.seed, opt.boards,
+           opt.games);
+    return EXIT_SUCCESS;
+}
+
+#endif /* ifdef XTETRIS_LIBFUZZER */
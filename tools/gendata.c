@@ -0,0 +1,240 @@
+/**
+ * @file gendata.c
+ * @author Maksim Kovalkov
+ *
+ * Training data generator: plays seeded AI-vs-AI games in parallel and writes one record per decision (see
+ * trainlog.h). Each worker keeps the records of its current game in its own buffer, fills in the outcome once the
+ * game is over, then appends the whole game to the shared file; nothing is allocated per game or per record.
+ *
+ * With `-r FILE`, it maps an existing file instead and prints a summary of its records.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "selfplay.h"
+#include "gamectx.h"
+#include "trainlog.h"
+#include "util.h"
+#include "parallel.h"
+
+/** Most decisions a game can take: one per piece. */
+#define MAX_GAME_RECORDS (7 * 2 * STARTING_PIECES)
+
+typedef struct Options {
+    int games, opening, threads;
+    unsigned long seed;
+    enum Game_kind kind;
+    Ai_config config;
+    char const *output, *input;
+} Options;
+
+typedef struct Gendata {
+    Options opt;
+    Trainlog_writer writer;
+    pthread_mutex_t lock;
+    int failed;
+    unsigned long written;
+    Game_ctx_pool ctx_pool;
+    Game_ctx **worker_ctx;
+    /** `MAX_GAME_RECORDS` records per worker. */
+    Trainlog_record *worker_records;
+} Gendata;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static void play_job(void *, int, int);
+static int summarize(char const *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] [key=value...] -O FILE\n       %s -r FILE\n", argv0, argv0);
+    fputs(
+        "  key=value pairs override fields of the AI configuration, as in ai_config_set.\n"
+        "  -O FILE   output file of records\n"
+        "  -r FILE   print a summary of an existing file instead\n"
+        "  -g N      games to play (default 100)\n"
+        "  -o N      random opening moves per game (default 4)\n"
+        "  -k KIND   single or vs (default vs)\n", stderr);
+    fputs(
+        "  -s SEED   seed of the first game (default 1)\n"
+        "  -w FILE   AI configuration to start from (default: built-in)\n"
+        "  -j N      worker threads (default: number of CPUs)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->games = 100;
+    opt->opening = 4;
+    opt->threads = parallel_ncpus();
+    opt->seed = 1;
+    opt->kind = Game_kind_Vs_ai;
+    opt->output = opt->input = NULL;
+    ai_config_default(&opt->config);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        char *value;
+        if (a[0] == '-') {
+            if (!a[1] || a[2] || i + 1 >= argc)
+                return -1;
+            ++i;
+            switch (a[1]) {
+            case 'O': opt->output = argv[i]; break;
+            case 'r': opt->input = argv[i]; break;
+            case 'g': opt->games = atoi(argv[i]); break;
+            case 'o': opt->opening = atoi(argv[i]); break;
+            case 'j': opt->threads = atoi(argv[i]); break;
+            case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+            case 'k': opt->kind = strcmp(argv[i], "single") == 0 ? Game_kind_Singleplayer : Game_kind_Vs_ai; break;
+            case 'w':
+                if (ai_config_load(&opt->config, argv[i]) != 0) {
+                    fprintf(stderr, "cannot load %s\n", argv[i]);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&opt->config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    if (opt->input)
+        return 0;
+    return opt->output && opt->games > 0 && opt->threads > 0 ? 0 : -1;
+}
+
+/**
+ * Play game number `job` and append its records to the output.
+ */
+void
+play_job(void *ctx, int job, int worker)
+{
+    Gendata *const gd = ctx;
+    Game_ctx *const gc = gd->worker_ctx[worker];
+    Trainlog_record *const records = gd->worker_records + (size_t) worker * MAX_GAME_RECORDS;
+    Game *const game = gc->game;
+    size_t n = 0;
+
+    game_init(game, gd->opt.kind, gd->opt.seed + job);
+    ai_init(gc->ai, &gd->opt.config);
+    selfplay_random_opening(game, gd->opt.opening);
+
+    while (game->state != Game_state_Win && game->state != Game_state_Lose) {
+        enum Game_action const act = ai_next_action(gc->ai, game);
+        /* the game is still in the state the decision was made from */
+        if (game->state == Game_state_Choose && n < MAX_GAME_RECORDS) {
+            trainlog_fill(&records[n], game, ai_last_decision(gc->ai), (int) n);
+            ++n;
+        }
+        do_game_step(game, act);
+    }
+    trainlog_set_outcome(records, n, selfplay_winner(game));
+
+    pthread_mutex_lock(&gd->lock);
+    if (trainlog_write(&gd->writer, records, n) != 0)
+        gd->failed = 1;
+    gd->written += n;
+    pthread_mutex_unlock(&gd->lock);
+}
+
+/**
+ * Print statistics about a file of records, reading them in place.
+ * @returns 0 on success, -1 if the file cannot be used.
+ */
+int
+summarize(char const *path)
+{
+    Trainlog_reader reader;
+    unsigned long outcomes[4] = { 0, 0, 0, 0 }, games = 0, endgame = 0;
+    unsigned long margins = 0;
+    double candidates = 0, margin = 0;
+    size_t i;
+
+    if (trainlog_map(&reader, path) != 0) {
+        fprintf(stderr, "cannot read %s, or not a training data file from a compatible build\n", path);
+        return -1;
+    }
+    for (i = 0; i < reader.count; ++i) {
+        Trainlog_record const *const r = &reader.records[i];
+        games += r->move == 0;
+        ++outcomes[r->outcome < 4 ? r->outcome : 0];
+        endgame += r->endgame;
+        candidates += r->n_candidates;
+        /* leave out positions where the runner-up loses the game (its score is a huge negative placeholder) */
+        if (r->n_candidates >= 2 && r->candidates[1].score > -1e19) {
+            margin += r->candidates[0].score - r->candidates[1].score;
+            ++margins;
+        }
+    }
+    printf("%lu records from %lu games\n", (unsigned long) reader.count, games);
+    printf("outcome: %lu won, %lu tied, %lu lost, %lu unknown\n", outcomes[Trainlog_outcome_Win],
+           outcomes[Trainlog_outcome_Tie], outcomes[Trainlog_outcome_Loss], outcomes[Trainlog_outcome_Unknown]);
+    if (reader.count)
+        printf("%.1f candidates per record, mean margin of the best %.3f, %lu endgame moves\n",
+               candidates / reader.count, margins ? margin / margins : 0, endgame);
+    trainlog_unmap(&reader);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    Gendata gd;
+    int i;
+
+    if (parse_options(&gd.opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (gd.opt.input)
+        return summarize(gd.opt.input) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (trainlog_open(&gd.writer, gd.opt.output) != 0) {
+        perror(gd.opt.output);
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&gd.lock, NULL);
+    gd.failed = 0;
+    gd.written = 0;
+
+    ctxpool_init(&gd.ctx_pool, gd.opt.threads, 0, ai_size(&gd.opt.config));
+    gd.worker_ctx = malloc_or_die(gd.opt.threads * sizeof *gd.worker_ctx);
+    for (i = 0; i < gd.opt.threads; ++i)
+        gd.worker_ctx[i] = ctxpool_acquire(&gd.ctx_pool);
+    gd.worker_records = malloc_or_die((size_t) gd.opt.threads * MAX_GAME_RECORDS * sizeof *gd.worker_records);
+
+    parallel_for(gd.opt.games, gd.opt.threads, play_job, &gd);
+
+    if (trainlog_close(&gd.writer) != 0)
+        gd.failed = 1;
+    printf("%lu records from %d games written to %s\n", gd.written, gd.opt.games, gd.opt.output);
+
+    free(gd.worker_records);
+    for (i = 0; i < gd.opt.threads; ++i)
+        ctxpool_release(&gd.ctx_pool, gd.worker_ctx[i]);
+    free(gd.worker_ctx);
+    ctxpool_deinit(&gd.ctx_pool);
+    pthread_mutex_destroy(&gd.lock);
+
+    if (gd.failed) {
+        fprintf(stderr, "error writing %s\n", gd.opt.output);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,370 @@
+/**
+ * @file matchplay.c
+ * @author Maksim Kovalkov
+ *
+ * Matches between 2 to 8 seats (see match.h), each played by the built-in AI or by a human at this terminal.
+ * In every round, the AI seats decide on worker threads while the human seats, if any, are asked for their moves;
+ * the decisions are then applied in seat order. Prints the standings at the end of each match, and how long rounds
+ * took.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "rng.h"
+#include "opponentai.h"
+#include "iohandler.h"
+#include "match.h"
+#include "util.h"
+#include "parallel.h"
+
+typedef struct Options {
+    int seats, humans, matches, opening, threads, verbose;
+    enum Match_garbage garbage;
+    unsigned long seed;
+    Ai_config config;
+} Options;
+
+typedef struct Match_play {
+    Options opt;
+    Match match;
+    Opponent_ai *ai[MATCH_SEATS_MAX];
+    Match_move moves[MATCH_SEATS_MAX];
+    /** AI seats to decide for in the current round. */
+    int jobs[MATCH_SEATS_MAX];
+    int n_jobs;
+    Io_handler *io;
+    /** Source of the random opening moves. */
+    Rng rng;
+    /* totals over every match */
+    unsigned long rounds, decisions, redecisions, garbage;
+    double round_ms, max_round_ms;
+} Match_play;
+
+static char const *const garbage_names[] = { "next", "random", "leader" };
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static double wall_ms(void);
+static void random_move(Match_play *, int);
+static void decide(Match_play *, int);
+static void decide_job(void *, int, int);
+static void * decide_all(void *);
+static void print_standings(Match const *, int);
+static int human_move(Match_play *, int);
+static int play_round(Match_play *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] [key=value...]\n", argv0);
+    fputs(
+        "  key=value pairs override fields of the AI configuration, as in ai_config_set.\n"
+        "  -p N      seats, from 2 to 8 (default 4)\n"
+        "  -H N      seats played by humans, the first ones (default 0)\n"
+        "  -G RULE   where garbage goes: next, random or leader (default next)\n", stderr);
+    fputs(
+        "  -g N      matches played (default 1)\n"
+        "  -o N      rounds of random moves of the AI seats at the start of a match (default 4)\n"
+        "  -s SEED   seed of the first match (default 1)\n"
+        "  -j N      threads deciding for the AI seats (default: one per processor)\n"
+        "  -w FILE   AI configuration (default: built-in)\n"
+        "  -v        print the standings after every round\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+    unsigned g;
+
+    opt->seats = 4;
+    opt->humans = 0;
+    opt->matches = 1;
+    opt->opening = 4;
+    opt->threads = parallel_ncpus();
+    opt->verbose = 0;
+    opt->garbage = Match_garbage_Next;
+    opt->seed = 1;
+    ai_config_default(&opt->config);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        char *value;
+        if (strcmp(a, "-v") == 0) {
+            opt->verbose = 1;
+        } else if (a[0] == '-') {
+            if (!a[1] || a[2] || i + 1 >= argc)
+                return -1;
+            ++i;
+            switch (a[1]) {
+            case 'p': opt->seats = atoi(argv[i]); break;
+            case 'H': opt->humans = atoi(argv[i]); break;
+            case 'g': opt->matches = atoi(argv[i]); break;
+            case 'o': opt->opening = atoi(argv[i]); break;
+            case 'j': opt->threads = atoi(argv[i]); break;
+            case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+            case 'G':
+                for (g = 0; g < 3 && strcmp(argv[i], garbage_names[g]) != 0; ++g) /* nop */;
+                if (g == 3)
+                    return -1;
+                opt->garbage = (enum Match_garbage) g;
+                break;
+            case 'w':
+                if (ai_config_load(&opt->config, argv[i]) != 0) {
+                    fprintf(stderr, "cannot load %s\n", argv[i]);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&opt->config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return opt->seats >= 2 && opt->seats <= MATCH_SEATS_MAX && opt->humans >= 0 && opt->humans <= opt->seats
+        && opt->matches > 0 && opt->opening >= 0 && opt->threads > 0 ? 0 : -1;
+}
+
+double
+wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/**
+ * Pick a random move for `seat` (as `selfplay_random_opening` does), so that the AI seats, which would all play the
+ * same from the same position, start the match on different boards.
+ */
+void
+random_move(Match_play *mp, int seat)
+{
+    Game const *const game = match_seat(&mp->match, seat);
+    int i, available = 0;
+
+    for (i = 0; i < 7; ++i)
+        available += game->pieces_left[i] != 0;
+    available = (int) rng_below(&mp->rng, available);
+    for (i = 0; !game->pieces_left[i] || available--; ++i) /* nop */;
+    mp->moves[seat].type = (unsigned char) (Tetrimino_type_I + i);
+    mp->moves[seat].rots = (unsigned char) rng_below(&mp->rng, 4);
+    mp->moves[seat].x = (int) rng_below(&mp->rng, BOARD_COLS) - 1;
+}
+
+/**
+ * Let the AI of `seat` decide its move, from the seat's game as it is now.
+ */
+void
+decide(Match_play *mp, int seat)
+{
+    Ai_decision const *d;
+
+    if (mp->match.rounds < (unsigned long) mp->opt.opening) {
+        random_move(mp, seat);
+        return;
+    }
+
+    ai_next_action(mp->ai[seat], match_seat(&mp->match, seat));
+    d = ai_last_decision(mp->ai[seat]);
+    mp->moves[seat].type = d->type;
+    mp->moves[seat].rots = d->rots;
+    mp->moves[seat].x = d->x;
+}
+
+void
+decide_job(void *ctx, int job, int worker)
+{
+    Match_play *const mp = ctx;
+    (void) worker;
+    decide(mp, mp->jobs[job]);
+}
+
+/**
+ * Thread body deciding for every AI seat of the round, while the calling thread asks the humans.
+ */
+void *
+decide_all(void *ctx)
+{
+    Match_play *const mp = ctx;
+    parallel_for(mp->n_jobs, mp->opt.threads, decide_job, mp);
+    return NULL;
+}
+
+void
+print_standings(Match const *m, int humans)
+{
+    int i;
+
+    printf("round %3lu:", m->rounds);
+    for (i = 0; i < m->n_seats; ++i) {
+        printf("  %c%d %3d%s", i < humans ? 'H' : '#', i + 1, m->seat[i].score[0], m->playing[i] ? "" : " out");
+    }
+    putchar('\n');
+}
+
+/**
+ * Ask the human at `seat` for a move, played on a copy of the seat's game with the single player screen until the
+ * piece is dropped (or turns out not to fit).
+ * @returns 0 with the move in `mp->moves`, -1 if the input ended.
+ */
+int
+human_move(Match_play *mp, int seat)
+{
+    Game game = *match_seat(&mp->match, seat);
+    Match_move *const move = &mp->moves[seat];
+
+    print_standings(&mp->match, mp->opt.humans);
+    printf("seat %d to play\n", seat + 1);
+    for (;;) {
+        enum Game_action act;
+
+        iohandler_draw_and_read(mp->io, &game);
+        while ((act = iohandler_next_action_1p(mp->io, &game)) != Game_action_Queue_empty) {
+            if (act != Game_action_Drop)
+                do_game_step(&game, act);
+            if (act == Game_action_Drop || game.state == Game_state_Lose) {
+                Piece p;
+                /* the rotations that give the shape dropped, as `packed_from_game` finds them */
+                p.type = game.active_piece.type;
+                init_piece_shape(&p);
+                for (move->rots = 0; move->rots < 3 && memcmp(p.shape, game.active_piece.shape, sizeof p.shape) != 0;
+                     ++move->rots)
+                    rotate_shape_cw(p.shape);
+                move->type = game.active_piece.type;
+                move->x = game.active_piece.x;
+                return 0;
+            }
+        }
+        if (iohandler_input_ended(mp->io))
+            return -1;
+    }
+}
+
+/**
+ * Play one round: decide for every seat, at once for the AI seats, then apply the moves in seat order.
+ * @returns 0 on success, -1 if a human's input ended.
+ */
+int
+play_round(Match_play *mp)
+{
+    Match *const m = &mp->match;
+    pthread_t thread;
+    double const start = wall_ms();
+    double ms;
+    int seat, status = 0;
+
+    mp->n_jobs = 0;
+    for (seat = mp->opt.humans; seat < m->n_seats; ++seat) {
+        if (!match_to_play(m, seat))
+            continue;
+        /* opening moves come from the one random source, in seat order, so they are drawn here */
+        if (m->rounds < (unsigned long) mp->opt.opening)
+            random_move(mp, seat);
+        else
+            mp->jobs[mp->n_jobs++] = seat;
+    }
+    mp->decisions += mp->n_jobs;
+
+    if (mp->opt.humans == 0) {
+        decide_all(mp);
+    } else {
+        if (pthread_create(&thread, NULL, &decide_all, mp) != 0) {
+            perror("cannot create thread");
+            exit(EXIT_FAILURE);
+        }
+        for (seat = 0; seat < mp->opt.humans && status == 0; ++seat)
+            if (match_to_play(m, seat))
+                status = human_move(mp, seat);
+        pthread_join(thread, NULL);
+        if (status != 0)
+            return -1;
+    }
+
+    for (seat = 0; seat < m->n_seats; ++seat) {
+        if (!match_to_play(m, seat))
+            continue;
+        /* the piece was taken by an earlier seat: decide again, from the pool as it is now */
+        while (match_play(m, seat, &mp->moves[seat]) != 0) {
+            ++mp->redecisions;
+            if (seat < mp->opt.humans) {
+                if (human_move(mp, seat) != 0)
+                    return -1;
+            } else {
+                decide(mp, seat);
+            }
+        }
+    }
+    for (seat = 0; seat < m->n_seats; ++seat)
+        mp->garbage += m->garbage_due[seat] != 0;
+    match_end_round(m);
+
+    ms = wall_ms() - start;
+    mp->round_ms += ms;
+    if (ms > mp->max_round_ms)
+        mp->max_round_ms = ms;
+    ++mp->rounds;
+    if (mp->opt.verbose)
+        print_standings(m, mp->opt.humans);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    Match_play mp;
+    int i, g, winner;
+
+    if (parse_options(&mp.opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < mp.opt.seats; ++i)
+        mp.ai[i] = ai_create(&mp.opt.config);
+    mp.io = mp.opt.humans ? iohandler_create(0) : NULL;
+    mp.rounds = mp.decisions = mp.redecisions = mp.garbage = 0;
+    mp.round_ms = mp.max_round_ms = 0;
+
+    for (g = 0; g < mp.opt.matches; ++g) {
+        match_init(&mp.match, mp.opt.seats, mp.opt.garbage, mp.opt.seed + g);
+        rng_seed(&mp.rng, mp.opt.seed + g);
+        for (i = 0; i < mp.opt.seats; ++i)
+            ai_init(mp.ai[i], &mp.opt.config);
+        while (!mp.match.over)
+            if (play_round(&mp) != 0)
+                break;
+
+        winner = match_winner(&mp.match);
+        print_standings(&mp.match, mp.opt.humans);
+        if (!mp.match.over)
+            printf("match %d: abandoned, the input ended\n", g + 1);
+        else if (winner < 0)
+            printf("match %d: tie\n", g + 1);
+        else
+            printf("match %d: seat %d wins\n", g + 1, winner + 1);
+        if (!mp.match.over)
+            break;
+    }
+
+    printf("%lu rounds of %d seats, garbage '%s': %.3f ms/round (max %.3f), %lu AI decisions, %lu decided again, "
+           "%lu garbage deliveries\n", mp.rounds, mp.opt.seats, garbage_names[mp.opt.garbage],
+           mp.rounds ? mp.round_ms / mp.rounds : 0, mp.max_round_ms, mp.decisions, mp.redecisions, mp.garbage);
+
+    for (i = 0; i < mp.opt.seats; ++i)
+        ai_destroy(mp.ai[i]);
+    if (mp.io)
+        iohandler_destroy(mp.io);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file netproto.h
+ * @author Maksim Kovalkov
+ *
+ * Wire protocol between x-tetris-server and its clients, over a Unix domain stream socket.
+ *
+ * The client opens with a hello message: `NETPROTO_HELLO`, the game kind (`Game_kind_Singleplayer` or
+ * `Game_kind_Vs_ai`), and a 32-bit big-endian seed. After that, every byte it sends is a `Game_action`; illegal
+ * actions are ignored.
+ *
+ * The server sends frames, each a 16-bit big-endian length followed by a frame in the format of delta.h: first a
+ * keyframe, then one delta after every batch of actions it reads (even if nothing changed, so that a client can
+ * wait for the answer to each action), and one more after the AI opponent has moved. The connection is closed by
+ * the client when the game is over.
+ */
+
+#ifndef XTETRIS_NETPROTO_H
+#define XTETRIS_NETPROTO_H
+
+#define NETPROTO_DEFAULT_PATH "/tmp/x-tetris.sock"
+#define NETPROTO_HELLO 'X'
+#define NETPROTO_HELLO_LEN 6
+#define NETPROTO_FRAME_HEADER_LEN 2
+#endif /* ifndef XTETRIS_NETPROTO_H */
@@ -0,0 +1,96 @@
+/**
+ * @file parallel.c
+ * @author Maksim Kovalkov
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "util.h"
+
+#include "parallel.h"
+
+typedef struct Loop {
+    pthread_mutex_t lock;
+    int next_job, n_jobs;
+    Parallel_job_fn fn;
+    void *ctx;
+} Loop;
+
+typedef struct Worker {
+    Loop *loop;
+    int index;
+    pthread_t thread;
+} Worker;
+
+static void * worker_main(void *);
+
+int
+parallel_ncpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+
+/**
+ * Keep taking the next job from the loop until there are none left.
+ */
+void *
+worker_main(void *arg)
+{
+    Worker *const w = arg;
+    Loop *const loop = w->loop;
+
+    for (;;) {
+        int job;
+        pthread_mutex_lock(&loop->lock);
+        job = loop->next_job < loop->n_jobs ? loop->next_job++ : -1;
+        pthread_mutex_unlock(&loop->lock);
+
+        if (job < 0)
+            return NULL;
+        loop->fn(loop->ctx, job, w->index);
+    }
+}
+
+void
+parallel_for(int n_jobs, int n_workers, Parallel_job_fn fn, void *ctx)
+{
+    Loop loop;
+    Worker *workers;
+    int i;
+
+    if (n_workers > n_jobs)
+        n_workers = n_jobs;
+    if (n_workers < 1)
+        n_workers = 1;
+
+    loop.next_job = 0;
+    loop.n_jobs = n_jobs;
+    loop.fn = fn;
+    loop.ctx = ctx;
+    pthread_mutex_init(&loop.lock, NULL);
+
+    workers = malloc_or_die(n_workers * sizeof *workers);
+    for (i = 0; i < n_workers; ++i) {
+        workers[i].loop = &loop;
+        workers[i].index = i;
+    }
+    for (i = 1; i < n_workers; ++i) {
+        if (pthread_create(&workers[i].thread, NULL, &worker_main, &workers[i]) != 0) {
+            perror("cannot create thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* the calling thread is worker 0 */
+    worker_main(&workers[0]);
+
+    for (i = 1; i < n_workers; ++i)
+        pthread_join(workers[i].thread, NULL);
+
+    pthread_mutex_destroy(&loop.lock);
+    free(workers);
+}
@@ -0,0 +1,26 @@
+/**
+ * @file parallel.h
+ * @author Maksim Kovalkov
+ *
+ * Minimal fork-join helper shared by the command line tools (POSIX threads).
+ */
+
+#ifndef XTETRIS_PARALLEL_H
+#define XTETRIS_PARALLEL_H
+
+/**
+ * Body of a parallel loop: run job number `job` on worker number `worker` (0 <= worker < the number of workers).
+ * Jobs running on the same worker never overlap, so per-worker scratch data can be indexed by `worker`.
+ */
+typedef void (*Parallel_job_fn)(void *ctx, int job, int worker);
+
+/**
+ * @returns the number of online processors, or 1 if it cannot be determined.
+ */
+int parallel_ncpus(void);
+/**
+ * Run `fn` for every job in [0, n_jobs) on `n_workers` threads (the calling thread being one of them), handing
+ * out jobs one at a time to whichever worker is free. Returns when every job is done. Exits on failure.
+ */
+void parallel_for(int n_jobs, int n_workers, Parallel_job_fn fn, void *ctx);
+#endif /* ifndef XTETRIS_PARALLEL_H */
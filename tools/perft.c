@@ -0,0 +1,551 @@
+/**
+ * @file perft.c
+ * @author Maksim Kovalkov
+ *
+ * Move generation counts, after chess engines' "perft": from a starting position (a board and the pieces left), all
+ * the placements the AI considers are made (every piece left, in every rotation, dropped at every column where it
+ * fits at the top), level by level up to a given depth. For each depth, prints the number of distinct positions
+ * reached (occupied cells and pieces left), the number of placement sequences reaching them, how many positions of
+ * the previous depth were stuck (nothing left, or nothing fits), the placements made, and the time taken.
+ *
+ * The counts are a ground truth for any other move generator. Each level is a set of positions split in shards,
+ * which worker threads expand into the next level's shards (each behind its own lock). The children of a worker
+ * are generated into a buffer of its own, and only added to the next level, hashed and deduplicated, when it is
+ * full, so that both steps are timed apart: the generation rate, per second of CPU time of a thread, is a
+ * throughput figure for the placement kernels (`collides`, `drop_piece`, `place_piece`, and with `-c` the line
+ * clearing ones); the deduplication rate is that of the hash tables.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "util.h"
+#include "parallel.h"
+
+/** Number of shards of a level (a power of two), which is also the number of jobs expanding it. */
+#define SHARDS 256
+/** Initial number of slots of a shard's hash table (a power of two). */
+#define SHARD_SLOTS_MIN 64
+/** Type given to every block: positions only keep which cells are occupied. */
+#define PERFT_BLOCK Tetrimino_type_O
+/** Children a worker generates before adding them to the next level. */
+#define PENDING_MAX 4096
+
+typedef struct Options {
+    int depth, clears, threads;
+    Board board;
+    unsigned char pieces_left[7];
+} Options;
+
+/**
+ * A position: occupied cells and pieces left. Compared and hashed as raw bytes, so always zeroed before being filled.
+ */
+typedef struct Position {
+    Row_bits rows[BOARD_ROWS];
+    unsigned char pieces_left[7];
+} Position;
+
+/**
+ * A distinct position of a level, and how many placement sequences reach it; 0 paths for an empty slot.
+ */
+typedef struct Node {
+    Position pos;
+    unsigned long hash;
+    /** Can exceed the range of `unsigned long`; exact up to 2^53. */
+    double paths;
+} Node;
+
+/**
+ * The positions of a level whose hash selects this shard: an open addressing table, at most half full.
+ */
+typedef struct Shard {
+    pthread_mutex_t lock;
+    Node *slots;
+    size_t n, cap;
+} Shard;
+
+typedef struct Level {
+    Shard shard[SHARDS];
+} Level;
+
+/** What a worker counts while expanding a level. */
+typedef struct Counters {
+    /** Placements generated. */
+    double placements;
+    /** Positions where nothing can be placed: no pieces left, or none fits. */
+    unsigned long stuck;
+    /** CPU time spent generating placements, and adding them to the next level, in seconds. */
+    double gen_seconds, dedup_seconds;
+} Counters;
+
+/**
+ * A position generated and not added to the next level yet, and the paths reaching it through its parent.
+ */
+typedef struct Child {
+    Position pos;
+    double paths;
+} Child;
+
+typedef struct Worker {
+    Counters counters;
+    Child *pending;
+    size_t n_pending;
+    /** CPU time when the current stretch of generation started. */
+    double since;
+} Worker;
+
+typedef struct Perft {
+    Options opt;
+    Level *from, *to;
+    Worker *workers;
+} Perft;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static int load_board(Board, char const *);
+static double wall_ms(void);
+static double cpu_seconds(void);
+static unsigned long position_hash(Position const *);
+static void pack(Position *, Board const, unsigned char const *);
+static void unpack(Board, Position const *);
+static Node * new_slots(size_t);
+static void level_init(Level *);
+static void level_free(Level *);
+static size_t level_size(Level const *);
+static double level_paths(Level const *);
+static void shard_insert(Shard *, Node const *);
+static void level_add(Level *, Position const *, double);
+static void flush(Perft *, Worker *);
+static void expand(Perft *, Node const *, Worker *);
+static void expand_job(void *, int, int);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options]\n", argv0);
+    fputs(
+        "  -d N      depth, in placements (default 3)\n"
+        "  -c        clear full lines after each placement, as in play\n"
+        "  -b FILE   starting board: one line of text per row, '.' or ' ' for empty cells (default: empty)\n"
+        "  -p LIST   pieces left, as 7 comma separated counts in the order I,T,J,L,S,Z,O (default: 20 each)\n"
+        "  -j N      worker threads (default: number of CPUs)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->depth = 3;
+    opt->clears = 0;
+    opt->threads = parallel_ncpus();
+    memset(opt->board, Block_type_Empty, sizeof opt->board);
+    memset(opt->pieces_left, STARTING_PIECES, sizeof opt->pieces_left);
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        if (strcmp(a, "-c") == 0) {
+            opt->clears = 1;
+            continue;
+        }
+        if (a[0] != '-' || !a[1] || a[2] || i + 1 >= argc)
+            return -1;
+        ++i;
+        switch (a[1]) {
+        case 'd': opt->depth = atoi(argv[i]); break;
+        case 'j': opt->threads = atoi(argv[i]); break;
+        case 'b':
+            if (load_board(opt->board, argv[i]) != 0) {
+                fprintf(stderr, "cannot read a board from %s\n", argv[i]);
+                return -1;
+            }
+            break;
+        case 'p': {
+            unsigned n[7];
+            int k;
+            if (sscanf(argv[i], "%u,%u,%u,%u,%u,%u,%u", &n[0], &n[1], &n[2], &n[3], &n[4], &n[5], &n[6]) != 7)
+                return -1;
+            for (k = 0; k < 7; ++k) {
+                if (n[k] > 255)
+                    return -1;
+                opt->pieces_left[k] = (unsigned char) n[k];
+            }
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    return opt->depth >= 0 && opt->threads > 0 ? 0 : -1;
+}
+
+/**
+ * Read a board drawn as text, top row first; missing rows and columns are empty.
+ * @returns 0 on success, -1 if the file cannot be read or has more than `BOARD_ROWS` rows.
+ */
+int
+load_board(Board board, char const *path)
+{
+    char line[BOARD_COLS + 16];
+    int rows = 0, ok = 1, j;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return -1;
+    while (ok && fgets(line, sizeof line, f)) {
+        if (rows == BOARD_ROWS) {
+            ok = 0;
+            break;
+        }
+        for (j = 0; j < BOARD_COLS && line[j] && line[j] != '\n'; ++j)
+            if (line[j] != '.' && line[j] != ' ')
+                board[rows][j] = PERFT_BLOCK;
+        ++rows;
+    }
+    if (ferror(f))
+        ok = 0;
+    fclose(f);
+    if (!ok)
+        return -1;
+    /* rows are drawn from the top, but the stack sits on the floor */
+    if (rows < BOARD_ROWS) {
+        memmove(board[BOARD_ROWS - rows], board[0], rows * sizeof board[0]);
+        memset(board[0], Block_type_Empty, (BOARD_ROWS - rows) * sizeof board[0]);
+    }
+    return 0;
+}
+
+double
+wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+double
+cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+unsigned long
+position_hash(Position const *pos)
+{
+    unsigned long h = 2166136261UL;
+    unsigned char const *p = (unsigned char const *) pos;
+    size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < sizeof *pos; ++i)
+        h = ((h ^ p[i]) * 16777619UL) & 0xffffffffUL;
+    return h;
+}
+
+void
+pack(Position *pos, Board const board, unsigned char const *pieces_left)
+{
+    int i;
+
+    memset(pos, 0, sizeof *pos);
+    for (i = 0; i < BOARD_ROWS; ++i)
+        pos->rows[i] = row_bits_pack(board[i]);
+    memcpy(pos->pieces_left, pieces_left, sizeof pos->pieces_left);
+}
+
+void
+unpack(Board board, Position const *pos)
+{
+    int i, j;
+
+    for (i = 0; i < BOARD_ROWS; ++i)
+        for (j = 0; j < BOARD_COLS; ++j)
+            board[i][j] = row_bits_test(&pos->rows[i], j) ? PERFT_BLOCK : Block_type_Empty;
+}
+
+/**
+ * @returns a table of `cap` empty slots.
+ */
+Node *
+new_slots(size_t cap)
+{
+    Node *const slots = malloc_or_die(cap * sizeof *slots);
+    size_t i;
+
+    for (i = 0; i < cap; ++i)
+        slots[i].paths = 0;
+    return slots;
+}
+
+void
+level_init(Level *level)
+{
+    int s;
+
+    for (s = 0; s < SHARDS; ++s) {
+        Shard *const shard = &level->shard[s];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->n = 0;
+        shard->cap = SHARD_SLOTS_MIN;
+        shard->slots = new_slots(shard->cap);
+    }
+}
+
+void
+level_free(Level *level)
+{
+    int s;
+
+    for (s = 0; s < SHARDS; ++s) {
+        pthread_mutex_destroy(&level->shard[s].lock);
+        free(level->shard[s].slots);
+    }
+}
+
+size_t
+level_size(Level const *level)
+{
+    size_t n = 0;
+    int s;
+
+    for (s = 0; s < SHARDS; ++s)
+        n += level->shard[s].n;
+    return n;
+}
+
+double
+level_paths(Level const *level)
+{
+    double paths = 0;
+    size_t i;
+    int s;
+
+    for (s = 0; s < SHARDS; ++s)
+        for (i = 0; i < level->shard[s].cap; ++i)
+            paths += level->shard[s].slots[i].paths;
+    return paths;
+}
+
+/**
+ * Add the paths of a node to its position's slot, taking a free slot if the position is new. The shard must be at
+ * most half full.
+ */
+void
+shard_insert(Shard *shard, Node const *node)
+{
+    /* the low bits chose the shard */
+    size_t i = (node->hash / SHARDS) & (shard->cap - 1);
+
+    for (;;) {
+        Node *const slot = &shard->slots[i];
+        if (slot->paths == 0) {
+            *slot = *node;
+            ++shard->n;
+            return;
+        }
+        if (slot->hash == node->hash && memcmp(&slot->pos, &node->pos, sizeof slot->pos) == 0) {
+            slot->paths += node->paths;
+            return;
+        }
+        i = (i + 1) & (shard->cap - 1);
+    }
+}
+
+/**
+ * Add `paths` placement sequences reaching `pos` to a level; thread safe.
+ */
+void
+level_add(Level *level, Position const *pos, double paths)
+{
+    Node node;
+    Shard *shard;
+
+    node.pos = *pos;
+    node.hash = position_hash(pos);
+    node.paths = paths;
+    shard = &level->shard[node.hash % SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+    if (2 * (shard->n + 1) > shard->cap) {
+        Node *const old = shard->slots;
+        size_t const old_cap = shard->cap;
+        size_t i;
+        shard->cap *= 2;
+        shard->slots = new_slots(shard->cap);
+        shard->n = 0;
+        for (i = 0; i < old_cap; ++i)
+            if (old[i].paths != 0)
+                shard_insert(shard, &old[i]);
+        free(old);
+    }
+    shard_insert(shard, &node);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * Add the children pending in a worker's buffer to the next level, and account the time since the last flush to
+ * generation, the time of this one to deduplication.
+ */
+void
+flush(Perft *pf, Worker *w)
+{
+    double const start = cpu_seconds();
+    size_t i;
+
+    w->counters.gen_seconds += start - w->since;
+    for (i = 0; i < w->n_pending; ++i)
+        level_add(pf->to, &w->pending[i].pos, w->pending[i].paths);
+    w->n_pending = 0;
+    w->since = cpu_seconds();
+    w->counters.dedup_seconds += w->since - start;
+}
+
+/**
+ * Make every placement from a position of the current level, into the worker's buffer of children for the next one.
+ * The placements are those of the AI's search: every piece left, in each of its 4 rotations (identical ones
+ * included), at every column where it fits at the top of the board, dropped.
+ */
+void
+expand(Perft *pf, Node const *node, Worker *w)
+{
+    Board board, after;
+    Piece piece, dropped;
+    unsigned char pieces_left[7];
+    double placements = 0;
+
+    unpack(board, &node->pos);
+    memcpy(pieces_left, node->pos.pieces_left, sizeof pieces_left);
+
+    for (piece.type = Tetrimino_type_I; piece.type <= Tetrimino_type_O; ++piece.type) {
+        int rots;
+        if (pieces_left[piece.type-1] == 0)
+            continue;
+        --pieces_left[piece.type-1];
+
+        init_piece_shape(&piece);
+        for (rots = 0; rots < 4; ++rots) {
+            lift_piece(&piece, board);
+            for (piece.x = -2; piece.x + 2 < BOARD_COLS; ++piece.x) {
+                Child *child;
+                if (collides(&piece, board))
+                    continue;
+                if (w->n_pending == PENDING_MAX)
+                    flush(pf, w);
+                child = &w->pending[w->n_pending++];
+                child->paths = node->paths;
+                dropped = piece;
+                drop_piece(&dropped, board);
+                if (pf->opt.clears) {
+                    memcpy(after, board, sizeof after);
+                    place_piece(&dropped, after, PERFT_BLOCK);
+                    if (mark_cleared_lines(after, &dropped))
+                        remove_cleared_lines(after);
+                    pack(&child->pos, after, pieces_left);
+                } else {
+                    place_piece(&dropped, board, PERFT_BLOCK);
+                    pack(&child->pos, board, pieces_left);
+                    place_piece(&dropped, board, Block_type_Empty);
+                }
+                ++placements;
+            }
+            rotate_shape_cw(piece.shape);
+        }
+        ++pieces_left[piece.type-1];
+    }
+
+    w->counters.placements += placements;
+    if (placements == 0)
+        ++w->counters.stuck;
+}
+
+void
+expand_job(void *ctx, int job, int worker)
+{
+    Perft *const pf = ctx;
+    Shard const *const shard = &pf->from->shard[job];
+    Worker *const w = &pf->workers[worker];
+    size_t i;
+
+    w->since = cpu_seconds();
+    for (i = 0; i < shard->cap; ++i)
+        if (shard->slots[i].paths != 0)
+            expand(pf, &shard->slots[i], w);
+    flush(pf, w);
+}
+
+int
+main(int argc, char **argv)
+{
+    Perft pf;
+    Position root;
+    int depth, w;
+
+    if (parse_options(&pf.opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    pf.from = malloc_or_die(sizeof *pf.from);
+    pf.to = malloc_or_die(sizeof *pf.to);
+    pf.workers = malloc_or_die(pf.opt.threads * sizeof *pf.workers);
+    for (w = 0; w < pf.opt.threads; ++w) {
+        pf.workers[w].pending = malloc_or_die(PENDING_MAX * sizeof *pf.workers[w].pending);
+        pf.workers[w].n_pending = 0;
+    }
+    level_init(pf.from);
+    pack(&root, pf.opt.board, pf.opt.pieces_left);
+    level_add(pf.from, &root, 1);
+
+    printf("board %dx%d, line clears %s, %d thread%s\n", BOARD_ROWS, BOARD_COLS, pf.opt.clears ? "on" : "off",
+           pf.opt.threads, pf.opt.threads == 1 ? "" : "s");
+    /* rates per second of CPU time of one thread */
+    printf("%5s %12s %16s %10s %14s %10s %14s %14s\n", "depth", "positions", "paths", "stuck", "placements",
+           "seconds", "generated/s", "deduplicated/s");
+    printf("%5d %12lu %16.0f\n", 0, 1UL, 1.0);
+
+    for (depth = 1; depth <= pf.opt.depth; ++depth) {
+        Counters total;
+        Level *swap;
+        double ms;
+
+        level_init(pf.to);
+        for (w = 0; w < pf.opt.threads; ++w)
+            memset(&pf.workers[w].counters, 0, sizeof pf.workers[w].counters);
+        ms = wall_ms();
+        parallel_for(SHARDS, pf.opt.threads, &expand_job, &pf);
+        ms = wall_ms() - ms;
+
+        memset(&total, 0, sizeof total);
+        for (w = 0; w < pf.opt.threads; ++w) {
+            Counters const *const c = &pf.workers[w].counters;
+            total.placements += c->placements;
+            total.stuck += c->stuck;
+            total.gen_seconds += c->gen_seconds;
+            total.dedup_seconds += c->dedup_seconds;
+        }
+        printf("%5d %12lu %16.0f %10lu %14.0f %10.3f %14.0f %14.0f\n", depth, (unsigned long) level_size(pf.to),
+               level_paths(pf.to), total.stuck, total.placements, ms / 1e3,
+               total.gen_seconds > 0 ? total.placements / total.gen_seconds : 0,
+               total.dedup_seconds > 0 ? total.placements / total.dedup_seconds : 0);
+        fflush(stdout);
+
+        level_free(pf.from);
+        swap = pf.from;
+        pf.from = pf.to;
+        pf.to = swap;
+    }
+
+    level_free(pf.from);
+    free(pf.from);
+    free(pf.to);
+    for (w = 0; w < pf.opt.threads; ++w)
+        free(pf.workers[w].pending);
+    free(pf.workers);
+    return EXIT_SUCCESS;
+}
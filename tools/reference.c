@@ -0,0 +1,194 @@
+/**
+ * @file reference.c
+ * @author Maksim Kovalkov
+ *
+ * Do not optimize anything here: these are the yardstick.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "reference.h"
+
+void
+ref_rotate_shape_cw(Tetrimino_shape shape)
+{
+    /*
+     * (0,0) (0,1) (0,2) (0,3)      (3,0) (2,0) (1,0) (0,0)
+     * (1,0) (1,1) (1,2) (1,3)  ->  (3,1) (2,1) (1,1) (0,1)
+     * (2,0) (2,1) (2,2) (2,3)      (3,2) (2,2) (1,2) (0,2)
+     * (3,0) (3,1) (3,2) (3,3)      (3,3) (2,3) (1,3) (0,3)
+     */
+    int i;
+    unsigned char t;
+
+    /* rotate outer ring */
+    for (i = 0; i < 3; ++i) {
+        t = shape[0][i];
+        shape[0][i] = shape[3-i][0];
+        shape[3-i][0] = shape[3][3-i];
+        shape[3][3-i] = shape[i][3];
+        shape[i][3] = t;
+    }
+    /* rotate inner ring */
+    t = shape[1][1];
+    shape[1][1] = shape[2][1];
+    shape[2][1] = shape[2][2];
+    shape[2][2] = shape[1][2];
+    shape[1][2] = t;
+}
+
+int
+ref_collides(const Piece *p, const Board board)
+{
+    int i, j;
+
+    for (i = 0; i < 4; ++i) {
+        for (j = 0; j < 4; ++j) {
+            if (!p->shape[i][j]) continue;
+            if (p->y + i < 0 || p->y + i >= BOARD_ROWS
+             || p->x + j < 0 || p->x + j >= BOARD_COLS)
+               return 1;
+            if (board[p->y + i][p->x + j]) return 1;
+        }
+    }
+    return 0;
+}
+
+void
+ref_drop_piece(Piece *piece, const Board board)
+{
+    for (;;) {
+        ++piece->y;
+        if (ref_collides(piece, board)) {
+            --piece->y;
+            return;
+        }
+    }
+}
+
+int
+ref_mark_cleared_lines(Board board)
+{
+    int i, j, cleared_count = 0;
+
+    for (i = 0; i < BOARD_ROWS; ++i) {
+        int cleared = 1;
+        for (j = 0; j < BOARD_COLS; ++j)
+            if (!board[i][j]) cleared = 0;
+
+        if (cleared) {
+            memset(board[i], Block_type_Clear, BOARD_COLS);
+            ++cleared_count;
+        }
+    }
+
+    return cleared_count;
+}
+
+void
+ref_remove_cleared_lines(Board board)
+{
+    int i = BOARD_ROWS - 1;
+
+    /* note that row 0 is never looked at */
+    while (i > 0) {
+        if (board[i][0] != Block_type_Clear) {
+            --i;
+            continue;
+        }
+        memmove(((unsigned char *)board) + BOARD_COLS, (unsigned char *)board, i * BOARD_COLS);
+        memset(board[0], Block_type_Empty, sizeof board[0]);
+    }
+}
+
+void
+ref_board_features(Board const board, Ai_features *f)
+{
+    int heights[BOARD_COLS];
+    int i, j;
+
+    f->max_height = f->lines = f->holes = f->bumps = 0;
+    f->row_trans = f->col_trans = f->wells = f->covered = 0;
+
+    for (j = 0; j < BOARD_COLS; ++j) {
+        for (i = 0; i < BOARD_ROWS && !board[i][j]; ++i) /* nop */;
+        heights[j] = BOARD_ROWS - i;
+    }
+
+    for (i = 0; i < BOARD_COLS; ++i)
+        if (heights[i] > f->max_height)
+            f->max_height = heights[i];
+
+    for (i = 0; i < BOARD_ROWS; ++i) {
+        int full = 1;
+        for (j = 0; full && j < BOARD_COLS; ++j) {
+            if (!board[i][j])
+                full = 0;
+        }
+        f->lines += full;
+    }
+
+    for (j = 0; j < BOARD_COLS; ++j) {
+        for (i = BOARD_ROWS - heights[j] + 1; i < BOARD_ROWS; ++i) {
+            if (!board[i][j])
+                ++f->holes;
+        }
+    }
+
+    for (i = 1; i < BOARD_COLS; ++i)
+        f->bumps += abs(heights[i] - heights[i-1]);
+
+    /* walls are occupied */
+    for (i = 0; i < BOARD_ROWS; ++i) {
+        for (j = 0; j <= BOARD_COLS; ++j) {
+            int const left = j == 0 || board[i][j-1];
+            int const cell = j == BOARD_COLS || board[i][j];
+            if (left != cell)
+                ++f->row_trans;
+        }
+    }
+
+    /* the floor is occupied, the space above the board is not looked at */
+    for (j = 0; j < BOARD_COLS; ++j) {
+        for (i = 1; i <= BOARD_ROWS; ++i) {
+            int const up = board[i-1][j] != 0;
+            int const cell = i == BOARD_ROWS || board[i][j];
+            if (up != cell)
+                ++f->col_trans;
+        }
+    }
+
+    for (j = 0; j < BOARD_COLS; ++j) {
+        for (i = 0; i < BOARD_ROWS - heights[j]; ++i) {
+            int const left = j == 0 || board[i][j-1];
+            int const right = j == BOARD_COLS - 1 || board[i][j+1];
+            if (left && right)
+                ++f->wells;
+        }
+    }
+
+    for (j = 0; j < BOARD_COLS; ++j) {
+        int k;
+        for (i = 0; i < BOARD_ROWS; ++i) {
+            if (!board[i][j])
+                continue;
+            for (k = i + 1; k < BOARD_ROWS && board[k][j]; ++k) /* nop */;
+            if (k < BOARD_ROWS)
+                ++f->covered;
+        }
+    }
+}
+
+double
+ref_heuristic(Ai_weights const *w, Board const board)
+{
+    Ai_features f;
+
+    ref_board_features(board, &f);
+    return w->height * f.max_height + w->lines * f.lines + w->penalty * (f.lines >= 3)
+            + w->holes * f.holes + w->bumps * f.bumps
+            + w->row_trans * f.row_trans + w->col_trans * f.col_trans + w->wells * f.wells + w->covered * f.covered;
+}
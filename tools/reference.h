@@ -0,0 +1,25 @@
+/**
+ * @file reference.h
+ * @author Maksim Kovalkov
+ *
+ * Reference implementation of the engine's hot kernels: the original, straightforward cell by cell versions, kept
+ * unchanged as the specification that any optimized version in tetris.c or opponentai.c must match exactly (see
+ * fuzzdiff.c). Each function behaves like the kernel of the same name without the `ref_` prefix; as the latter
+ * only looks where the game can leave full lines, `ref_mark_cleared_lines`, which looks at every line, is its
+ * specification on the boards the game can produce.
+ */
+
+#ifndef XTETRIS_REFERENCE_H
+#define XTETRIS_REFERENCE_H
+
+#include "tetris.h"
+#include "opponentai.h"
+
+void ref_rotate_shape_cw(Tetrimino_shape);
+int ref_collides(const Piece *, const Board);
+void ref_drop_piece(Piece *, const Board);
+int ref_mark_cleared_lines(Board);
+void ref_remove_cleared_lines(Board);
+void ref_board_features(Board const, Ai_features *);
+double ref_heuristic(Ai_weights const *, Board const);
+#endif /* ifndef XTETRIS_REFERENCE_H */
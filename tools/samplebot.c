@@ -0,0 +1,138 @@
+/**
+ * @file samplebot.c
+ * @author Maksim Kovalkov
+ *
+ * Sample external bot (see botproto.h), answering with the built-in AI: a reference for writing bots in other
+ * languages, and a baseline for x-tetris-botmatch, against which it should score about even.
+ * `-D MS` delays every answer, to exercise the host's timeouts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "botproto.h"
+
+static void usage(char const *);
+static void answer(Opponent_ai *, Game const *, int, unsigned long);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [-D MS] [-w FILE] [key=value...]\n", argv0);
+    fputs(
+        "  key=value pairs override fields of the AI configuration, as in ai_config_set.\n"
+        "  -D MS     wait this long before every answer\n"
+        "  -w FILE   AI configuration to start from (default: built-in)\n", stderr);
+}
+
+/**
+ * Decide and write the move for `game`, after waiting `delay_ms`.
+ */
+void
+answer(Opponent_ai *ai, Game const *game, int binary, unsigned long delay_ms)
+{
+    unsigned char buf[BOTPROTO_LINE_LEN];
+    Ai_decision const *d;
+    Bot_move move;
+    Game played = *game;
+    Piece spawned;
+    enum Game_action act;
+
+    do_game_step(&played, ai_next_action(ai, &played));
+    d = ai_last_decision(ai);
+    move.type = d->type;
+    spawned = played.active_piece;
+    /* the rotations and column the search settled on may not be reachable from the top, where the host rotates and
+       moves the piece: answer those the built-in AI ends up dropping it with */
+    while (played.state == Game_state_Place && (act = ai_next_action(ai, &played)) != Game_action_Drop)
+        do_game_step(&played, act);
+    for (move.rots = 0; move.rots < 3 && memcmp(spawned.shape, played.active_piece.shape, sizeof spawned.shape) != 0;
+         ++move.rots)
+        rotate_shape_cw(spawned.shape);
+    move.x = played.active_piece.x;
+    if (delay_ms) {
+        struct timespec pause;
+        pause.tv_sec = (time_t) (delay_ms / 1000);
+        pause.tv_nsec = (long) (delay_ms % 1000) * 1000000L;
+        nanosleep(&pause, NULL);
+    }
+    fwrite(buf, 1, botproto_encode_move(buf, &move, binary), stdout);
+    fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+    char line[BOTPROTO_LINE_LEN];
+    Ai_config config;
+    Opponent_ai *ai;
+    Game game;
+    unsigned long delay_ms = 0;
+    int version, rows, cols, binary, have_position = 0, i;
+    char mode[8];
+
+    ai_config_default(&config);
+    for (i = 1; i < argc; ++i) {
+        char *value;
+        if (strcmp(argv[i], "-D") == 0 && i + 1 < argc) {
+            delay_ms = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            if (ai_config_load(&config, argv[++i]) != 0) {
+                fprintf(stderr, "cannot load %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if ((value = strchr(argv[i], '=')) != NULL) {
+            *value++ = 0;
+            if (ai_config_set(&config, argv[i], value) != 0) {
+                fprintf(stderr, "invalid setting %s=%s\n", argv[i], value);
+                return EXIT_FAILURE;
+            }
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!fgets(line, sizeof line, stdin) || sscanf(line, "xtp %d %7s %d %d", &version, mode, &rows, &cols) != 4)
+        return EXIT_FAILURE;
+    if (version != BOTPROTO_VERSION || rows != BOARD_ROWS || cols != BOARD_COLS) {
+        fprintf(stderr, "unsupported protocol version %d or board size %dx%d\n", version, rows, cols);
+        return EXIT_FAILURE;
+    }
+    binary = strcmp(mode, "binary") == 0;
+    ai = ai_create(&config);
+    printf("ready x-tetris-samplebot\n");
+    fflush(stdout);
+
+    if (binary) {
+        unsigned char req[BOTPROTO_POSITION_LEN];
+        unsigned limit_ms;
+        while (fread(req, 1, 1, stdin) == 1 && req[0] == BOTPROTO_POSITION) {
+            if (fread(req + 1, 1, sizeof req - 1, stdin) != sizeof req - 1
+                || botproto_decode_position(&game, &limit_ms, req, 1) != 0)
+                break;
+            answer(ai, &game, 1, delay_ms);
+        }
+    } else {
+        while (fgets(line, sizeof line, stdin)) {
+            line[strcspn(line, "\r\n")] = 0;
+            if (strncmp(line, "position ", 9) == 0) {
+                unsigned limit_ms;
+                have_position = botproto_decode_position(&game, &limit_ms, (unsigned char *) line, 0) == 0;
+                if (!have_position)
+                    fprintf(stderr, "malformed position\n");
+            } else if (strncmp(line, "go", 2) == 0 && have_position) {
+                answer(ai, &game, 0, delay_ms);
+            } else if (strcmp(line, "quit") == 0) {
+                break;
+            }
+        }
+    }
+
+    ai_destroy(ai);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,516 @@
+/**
+ * @file server.c
+ * @author Maksim Kovalkov
+ *
+ * Server hosting many independent games at once for clients connecting over a Unix domain socket (see netproto.h).
+ *
+ * A single I/O thread runs an epoll loop: it accepts connections, applies the actions each client sends to its game
+ * and writes back state deltas. Whenever it is the AI opponent's turn in a `Game_kind_Vs_ai` game, the game is
+ * handed to a pool of worker threads, and its connection stops being read until the AI has moved, so the I/O
+ * thread never waits for a search. Sessions and game contexts come from pools allocated at startup.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "gamectx.h"
+#include "delta.h"
+#include "util.h"
+#include "parallel.h"
+#include "netproto.h"
+
+#define IN_BUF_LEN 256
+#define OUT_BUF_LEN (8 * (NETPROTO_FRAME_HEADER_LEN + DELTA_MAX_LEN))
+#define MAX_EVENTS 64
+
+typedef struct Session {
+    int fd;
+    /** NULL until the hello message has been received. */
+    Game_ctx *ctx;
+    /** The state the client has, i.e. the one the next delta is computed against. */
+    Game sent;
+    /** Set while an AI worker owns the game; the connection is not read meanwhile. */
+    int busy;
+    /** Set if the client went away while the session was busy: free it when the worker is done. */
+    int hangup;
+    unsigned char in[IN_BUF_LEN];
+    size_t in_len, in_off;
+    unsigned char out[OUT_BUF_LEN];
+    size_t out_len;
+    /** Link in the job or completion queue. */
+    struct Session *next;
+} Session;
+
+typedef struct Server {
+    int epfd, listen_fd;
+    /** Workers write a byte here after finishing a job, to wake up the I/O thread. */
+    int wake_pipe[2];
+    Pool sessions;
+    Game_ctx_pool ctxs;
+    Ai_config ai_config;
+
+    pthread_mutex_t lock;
+    pthread_cond_t have_job;
+    Session *jobs_head, *jobs_tail, *done;
+    int stopping;
+    pthread_t *workers;
+    int n_workers;
+
+    unsigned long games_started, ai_turns;
+} Server;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void usage(char const *);
+static void on_signal(int);
+static void set_nonblocking(int);
+static void watch(Server *, Session *, int);
+static void update_interest(Server *, Session *);
+static void free_session(Server *, Session *);
+static void flush_output(Server *, Session *);
+static int queue_frame(Server *, Session *);
+static int needs_ai(Game const *);
+static void submit_ai_turn(Server *, Session *);
+static void * worker_main(void *);
+static void process_input(Server *, Session *);
+static void handle_readable(Server *, Session *);
+static void handle_accept(Server *);
+static void handle_completions(Server *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options]\n", argv0);
+    fputs(
+        "  -S PATH   socket path (default " NETPROTO_DEFAULT_PATH ")\n"
+        "  -n N      maximum number of simultaneous games (default 1024)\n"
+        "  -j N      AI worker threads (default: number of CPUs)\n"
+        "  -w FILE   AI configuration\n", stderr);
+}
+
+void
+on_signal(int sig)
+{
+    (void) sig;
+    g_stop = 1;
+}
+
+void
+set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * Register a session's socket with epoll (`add` nonzero) or update the events it is watched for.
+ */
+void
+watch(Server *srv, Session *s, int add)
+{
+    struct epoll_event ev;
+    ev.events = (s->busy ? 0 : EPOLLIN) | (s->out_len ? EPOLLOUT : 0);
+    ev.data.ptr = s;
+    epoll_ctl(srv->epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+void
+update_interest(Server *srv, Session *s)
+{
+    watch(srv, s, 0);
+}
+
+void
+free_session(Server *srv, Session *s)
+{
+    close(s->fd);
+    if (s->ctx)
+        ctxpool_release(&srv->ctxs, s->ctx);
+    pool_put(&srv->sessions, s);
+}
+
+/**
+ * Write as much pending output as the socket takes without blocking.
+ */
+void
+flush_output(Server *srv, Session *s)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < s->out_len) {
+        n = write(s->fd, s->out + off, s->out_len - off);
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    memmove(s->out, s->out + off, s->out_len - off);
+    s->out_len -= off;
+    update_interest(srv, s);
+}
+
+/**
+ * Append a frame with the changes since the last one (or a keyframe, for the first one) to the output buffer.
+ * @returns 0 on success, -1 if the client is not keeping up and its buffer is full.
+ */
+int
+queue_frame(Server *srv, Session *s)
+{
+    unsigned char *const frame = s->out + s->out_len;
+    Game const *const game = s->ctx->game;
+    size_t len;
+
+    if (OUT_BUF_LEN - s->out_len < NETPROTO_FRAME_HEADER_LEN + DELTA_MAX_LEN)
+        return -1;
+
+    /* states count from 1: a zeroed one means that the client has nothing yet */
+    len = delta_encode(s->sent.state ? &s->sent : NULL, game, frame + NETPROTO_FRAME_HEADER_LEN);
+    frame[0] = (unsigned char) (len >> 8);
+    frame[1] = (unsigned char) (len & 0xff);
+    s->out_len += NETPROTO_FRAME_HEADER_LEN + len;
+    s->sent = *game;
+
+    flush_output(srv, s);
+    return 0;
+}
+
+/**
+ * @returns whether it is the AI's turn to move.
+ */
+int
+needs_ai(Game const *game)
+{
+    return game->kind == Game_kind_Vs_ai && game->current_player == 1
+        && game->state != Game_state_Win && game->state != Game_state_Lose;
+}
+
+/**
+ * Hand the game over to the worker pool; the session must not be touched until it comes back.
+ */
+void
+submit_ai_turn(Server *srv, Session *s)
+{
+    s->busy = 1;
+    s->next = NULL;
+    update_interest(srv, s);
+
+    pthread_mutex_lock(&srv->lock);
+    if (srv->jobs_tail)
+        srv->jobs_tail->next = s;
+    else
+        srv->jobs_head = s;
+    srv->jobs_tail = s;
+    pthread_cond_signal(&srv->have_job);
+    pthread_mutex_unlock(&srv->lock);
+}
+
+/**
+ * Worker thread: play the AI's turns of the submitted games.
+ */
+void *
+worker_main(void *arg)
+{
+    Server *const srv = arg;
+
+    for (;;) {
+        Session *s;
+        Game *game;
+        char const wake = 1;
+
+        pthread_mutex_lock(&srv->lock);
+        while (!srv->jobs_head && !srv->stopping)
+            pthread_cond_wait(&srv->have_job, &srv->lock);
+        if (srv->stopping) {
+            pthread_mutex_unlock(&srv->lock);
+            return NULL;
+        }
+        s = srv->jobs_head;
+        if (!(srv->jobs_head = s->next))
+            srv->jobs_tail = NULL;
+        pthread_mutex_unlock(&srv->lock);
+
+        game = s->ctx->game;
+        while (needs_ai(game))
+            do_game_step(game, ai_next_action(s->ctx->ai, game));
+
+        pthread_mutex_lock(&srv->lock);
+        s->next = srv->done;
+        srv->done = s;
+        pthread_mutex_unlock(&srv->lock);
+        if (write(srv->wake_pipe[1], &wake, 1) < 0) {
+            /* the pipe is full, so the I/O thread is going to wake up anyway */
+        }
+    }
+}
+
+/**
+ * Consume buffered input: the hello message first, then actions, until the buffer is empty or the AI has to move.
+ */
+void
+process_input(Server *srv, Session *s)
+{
+    int acted = 0;
+
+    while (s->in_off < s->in_len && !s->busy) {
+        if (!s->ctx) {
+            unsigned char const *h = s->in + s->in_off;
+            unsigned long seed;
+            enum Game_kind kind;
+
+            if (s->in_len - s->in_off < NETPROTO_HELLO_LEN)
+                break;
+            s->in_off += NETPROTO_HELLO_LEN;
+            kind = (enum Game_kind) h[1];
+            seed = (unsigned long) h[2] << 24 | (unsigned long) h[3] << 16 | (unsigned long) h[4] << 8 | h[5];
+            if (h[0] != NETPROTO_HELLO || (kind != Game_kind_Singleplayer && kind != Game_kind_Vs_ai)
+                || !(s->ctx = ctxpool_acquire(&srv->ctxs))) {
+                s->hangup = 1;
+                return;
+            }
+            game_init(s->ctx->game, kind, seed);
+            ai_init(s->ctx->ai, &srv->ai_config);
+            s->sent.state = (enum Game_state) 0;
+            ++srv->games_started;
+            acted = 1;
+        } else {
+            enum Game_action const act = (enum Game_action) s->in[s->in_off++];
+            if (action_is_legal(s->ctx->game, act))
+                do_game_step(s->ctx->game, act);
+            acted = 1;
+        }
+
+        if (s->ctx && needs_ai(s->ctx->game)) {
+            /* let the client see its own move right away */
+            if (queue_frame(srv, s) != 0) {
+                s->hangup = 1;
+                return;
+            }
+            acted = 0;
+            ++srv->ai_turns;
+            submit_ai_turn(srv, s);
+        }
+    }
+
+    memmove(s->in, s->in + s->in_off, s->in_len - s->in_off);
+    s->in_len -= s->in_off;
+    s->in_off = 0;
+
+    if (acted && queue_frame(srv, s) != 0)
+        s->hangup = 1;
+}
+
+void
+handle_readable(Server *srv, Session *s)
+{
+    ssize_t n = read(s->fd, s->in + s->in_len, IN_BUF_LEN - s->in_len);
+
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        s->hangup = 1;
+        return;
+    }
+    if (n > 0) {
+        s->in_len += n;
+        process_input(srv, s);
+    }
+}
+
+void
+handle_accept(Server *srv)
+{
+    int fd;
+
+    while ((fd = accept(srv->listen_fd, NULL, NULL)) >= 0) {
+        Session *s = pool_get(&srv->sessions);
+        if (!s) {
+            /* full: turn the client away */
+            close(fd);
+            continue;
+        }
+        set_nonblocking(fd);
+        s->fd = fd;
+        s->ctx = NULL;
+        s->busy = s->hangup = 0;
+        s->in_len = s->in_off = s->out_len = 0;
+        watch(srv, s, 1);
+    }
+}
+
+/**
+ * Take back the games whose AI turn is over, send the result and resume reading their input.
+ */
+void
+handle_completions(Server *srv)
+{
+    char drain[64];
+    Session *s, *next;
+
+    while (read(srv->wake_pipe[0], drain, sizeof drain) > 0) /* nop */;
+
+    pthread_mutex_lock(&srv->lock);
+    s = srv->done;
+    srv->done = NULL;
+    pthread_mutex_unlock(&srv->lock);
+
+    for (; s; s = next) {
+        next = s->next;
+        s->busy = 0;
+        if (s->hangup || queue_frame(srv, s) != 0) {
+            free_session(srv, s);
+            continue;
+        }
+        process_input(srv, s);
+        if (s->hangup && !s->busy)
+            free_session(srv, s);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    Server srv;
+    struct sockaddr_un addr;
+    struct epoll_event ev, events[MAX_EVENTS];
+    char const *path = NETPROTO_DEFAULT_PATH;
+    int max_games = 1024, i;
+
+    srv.n_workers = parallel_ncpus();
+    ai_config_default(&srv.ai_config);
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        if (a[0] != '-' || !a[1] || a[2] || i + 1 >= argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        ++i;
+        switch (a[1]) {
+        case 'S': path = argv[i]; break;
+        case 'n': max_games = atoi(argv[i]); break;
+        case 'j': srv.n_workers = atoi(argv[i]); break;
+        case 'w':
+            if (ai_config_load(&srv.ai_config, argv[i]) != 0) {
+                fprintf(stderr, "cannot load AI configuration from %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (max_games < 1 || srv.n_workers < 1 || strlen(path) >= sizeof addr.sun_path) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, &on_signal);
+    signal(SIGTERM, &on_signal);
+
+    pool_init(&srv.sessions, sizeof (Session), max_games);
+    ctxpool_init(&srv.ctxs, max_games, 0, ai_size(&srv.ai_config));
+    srv.games_started = srv.ai_turns = 0;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if ((srv.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+        || bind(srv.listen_fd, (struct sockaddr *) &addr, sizeof addr) != 0
+        || listen(srv.listen_fd, 128) != 0
+        || pipe(srv.wake_pipe) != 0
+        || (srv.epfd = epoll_create(MAX_EVENTS)) < 0) {
+        perror("cannot set up the server");
+        return EXIT_FAILURE;
+    }
+    set_nonblocking(srv.listen_fd);
+    set_nonblocking(srv.wake_pipe[0]);
+    set_nonblocking(srv.wake_pipe[1]);
+
+    /* the listening socket and the pipe are told apart from sessions by their data pointer */
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv.listen_fd;
+    epoll_ctl(srv.epfd, EPOLL_CTL_ADD, srv.listen_fd, &ev);
+    ev.data.ptr = &srv.wake_pipe;
+    epoll_ctl(srv.epfd, EPOLL_CTL_ADD, srv.wake_pipe[0], &ev);
+
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_cond_init(&srv.have_job, NULL);
+    srv.jobs_head = srv.jobs_tail = srv.done = NULL;
+    srv.stopping = 0;
+    srv.workers = malloc_or_die(srv.n_workers * sizeof *srv.workers);
+    for (i = 0; i < srv.n_workers; ++i) {
+        if (pthread_create(&srv.workers[i], NULL, &worker_main, &srv) != 0) {
+            perror("cannot create thread");
+            return EXIT_FAILURE;
+        }
+    }
+
+    fprintf(stderr, "listening on %s (%d games max, %d AI workers)\n", path, max_games, srv.n_workers);
+    while (!g_stop) {
+        int const n = epoll_wait(srv.epfd, events, MAX_EVENTS, -1);
+        int woken = 0;
+
+        for (i = 0; i < n; ++i) {
+            void *const tag = events[i].data.ptr;
+            Session *s;
+
+            if (tag == &srv.listen_fd) {
+                handle_accept(&srv);
+                continue;
+            }
+            if (tag == &srv.wake_pipe) {
+                /* handled after this batch, since it can free sessions that still have events in it */
+                woken = 1;
+                continue;
+            }
+
+            s = tag;
+            if (s->busy) {
+                /* only the output buffer is not owned by the worker */
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    /* reported even when not requested: stop watching until the worker is done */
+                    s->hangup = 1;
+                    epoll_ctl(srv.epfd, EPOLL_CTL_DEL, s->fd, &ev);
+                } else if (events[i].events & EPOLLOUT) {
+                    flush_output(&srv, s);
+                }
+                continue;
+            }
+            if (events[i].events & EPOLLOUT)
+                flush_output(&srv, s);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                handle_readable(&srv, s);
+            /* a busy session is freed when its worker is done */
+            if (s->hangup && !s->busy)
+                free_session(&srv, s);
+        }
+        if (woken)
+            handle_completions(&srv);
+    }
+
+    pthread_mutex_lock(&srv.lock);
+    srv.stopping = 1;
+    pthread_cond_broadcast(&srv.have_job);
+    pthread_mutex_unlock(&srv.lock);
+    for (i = 0; i < srv.n_workers; ++i)
+        pthread_join(srv.workers[i], NULL);
+
+    fprintf(stderr, "served %lu games, %lu AI turns\n", srv.games_started, srv.ai_turns);
+    unlink(path);
+    close(srv.epfd);
+    close(srv.listen_fd);
+    free(srv.workers);
+    ctxpool_deinit(&srv.ctxs);
+    pool_deinit(&srv.sessions);
+    return EXIT_SUCCESS;
+}
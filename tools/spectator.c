@@ -0,0 +1,129 @@
+/**
+ * @file spectator.c
+ * @author Maksim Kovalkov
+ *
+ * Spectator for a game broadcast with `x-tetris -S PATH` (see spectate.h). It only reads the broadcast file, so any
+ * number of spectators can watch at once without the game ever waiting for them: a spectator that falls behind
+ * skips ahead to the latest keyframe, and only the latest state is drawn after catching up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "iohandler.h"
+#include "spectate.h"
+
+/** Interval between checks for new frames. */
+#define POLL_MS 10
+
+static void usage(char const *);
+static void render(Io_handler *, Game const *);
+static int game_over(Game const *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [-f PATH] [-i SECONDS] [-n]\n", argv0);
+    fputs(
+        "  -f PATH     broadcast file (default " SPECTATE_DEFAULT_PATH ")\n"
+        "  -i SECONDS  give up after this long without a new frame (default 10, 0: never)\n"
+        "  -n          do not draw, only count the frames received and the skips\n", stderr);
+}
+
+/**
+ * Draw the game as the player sees it: with the piece being placed, and where it would land.
+ */
+void
+render(Io_handler *io, Game const *game)
+{
+    static Game view;
+    Piece ghost;
+
+    view = *game;
+    if (view.state == Game_state_Place) {
+        ghost = view.active_piece;
+        drop_piece(&ghost, view.board[view.current_player]);
+        place_piece(&ghost, view.board[view.current_player], Block_type_Ghost);
+        place_piece(&view.active_piece, view.board[view.current_player], view.active_piece.type);
+    } else if (view.state == Game_state_Lose) {
+        place_piece(&view.active_piece, view.board[view.current_player], Block_type_Badbk);
+    }
+    iohandler_draw(io, &view);
+    putchar('\n');
+    fflush(stdout);
+}
+
+int
+game_over(Game const *game)
+{
+    return game->state == Game_state_Win || game->state == Game_state_Lose;
+}
+
+int
+main(int argc, char **argv)
+{
+    char const *path = SPECTATE_DEFAULT_PATH;
+    unsigned long frames = 0, idle_ms = 0, idle_limit_ms = 10000;
+    int count_only = 0, synced = 0, i;
+    Spectate_reader reader;
+    Io_handler *io = NULL;
+    struct timespec pause;
+    Game game;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0) {
+            count_only = 1;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            idle_limit_ms = strtoul(argv[++i], NULL, 10) * 1000;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (spectate_attach(&reader, path) != 0) {
+        fprintf(stderr, "no game is broadcast at %s\n", path);
+        return EXIT_FAILURE;
+    }
+    memset(&game, 0, sizeof game);
+    pause.tv_sec = 0;
+    pause.tv_nsec = POLL_MS * 1000000L;
+
+    while (!(synced && game_over(&game)) && (!idle_limit_ms || idle_ms < idle_limit_ms)) {
+        unsigned long received = 0;
+        int r;
+
+        /* catch up with everything published so far, then draw once */
+        while ((r = spectate_next(&reader, &game)) == 1)
+            ++received;
+        if (r < 0) {
+            fputs("malformed frame\n", stderr);
+            break;
+        }
+        if (!received) {
+            nanosleep(&pause, NULL);
+            idle_ms += POLL_MS;
+            continue;
+        }
+        frames += received;
+        idle_ms = 0;
+        synced = 1;
+
+        if (!count_only) {
+            if (!io)
+                io = iohandler_create(game.kind != Game_kind_Singleplayer);
+            render(io, &game);
+        }
+    }
+
+    fprintf(stderr, "spectator: %lu frames, %lu skips to a keyframe\n", frames, reader.skips);
+    if (io)
+        iohandler_destroy(io);
+    spectate_detach(&reader);
+    return EXIT_SUCCESS;
+}
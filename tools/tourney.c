@@ -0,0 +1,428 @@
+/**
+ * @file tourney.c
+ * @author Maksim Kovalkov
+ *
+ * Round-robin tournament between AI configurations.
+ * Every pair of entrants plays the same set of `Game_kind_Vs_ai` games, headless and in parallel, each seed twice
+ * with the seats swapped. The report gives Elo ratings (Bradley-Terry fit, anchored on the first entrant) with
+ * bootstrap confidence intervals, next to the CPU time each entrant spends per decision.
+ *
+ * In gating mode there are exactly two entrants, a baseline and a candidate: the exit status tells whether the
+ * candidate is no weaker than the baseline (within a margin) and no slower than allowed.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "selfplay.h"
+#include "gamectx.h"
+#include "util.h"
+#include "parallel.h"
+
+#define NAME_LEN 32
+#define FIT_ITERATIONS 500
+#define CONFIDENCE 0.95
+
+typedef struct Entrant {
+    char name[NAME_LEN];
+    Ai_config config;
+} Entrant;
+
+/** One game of the tournament, with entrant `a` sitting in seat 0. */
+typedef struct Match_game {
+    int a, b;
+    unsigned long seed;
+    /** Result for `a`: 1 win, 0.5 tie, 0 loss. */
+    double result;
+    double seconds[2];
+    int decisions[2];
+} Match_game;
+
+typedef struct Options {
+    int games, opening, threads, bootstrap;
+    unsigned long seed;
+    /** Gating mode: enabled if `gate` is set. */
+    int gate;
+    double gate_margin, gate_max_slowdown;
+} Options;
+
+typedef struct Tourney {
+    Options opt;
+    Entrant *entrants;
+    int n;
+    Match_game *games;
+    int n_games;
+    /** Two contexts per worker, one per seat, acquired once: games reuse them without allocating. */
+    Game_ctx_pool ctx_pool;
+    Game_ctx **worker_ctx;
+} Tourney;
+
+/** Final statistics for an entrant. */
+typedef struct Standing {
+    int entrant;
+    double elo, elo_lo, elo_hi;
+    double score, played;
+    double ms_per_decision;
+} Standing;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **, int *);
+static int parse_entrant(Entrant *, char const *);
+static double thread_cpu_seconds(void);
+static void play_job(void *, int, int);
+static void fit_ratings(int, double const *, double const *, double *);
+static void tally(Tourney const *, int const *, double *, double *);
+static void compute_standings(Tourney *, Standing *);
+static int compare_doubles(void const *, void const *);
+static int compare_standings(void const *, void const *);
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options] NAME=CONFIG[,key=value...] NAME=CONFIG[,key=value...]...\n", argv0);
+    fputs(
+        "  CONFIG is a file for ai_config_load or 'default'; key=value pairs override single fields.\n"
+        "  -g N      seeds per pairing, each played from both seats (default 20)\n"
+        "  -o N      random opening moves per game (default 4)\n"
+        "  -s SEED   master seed (default 1)\n"
+        "  -j N      worker threads (default: number of CPUs)\n"
+        "  -b N      bootstrap resamples for the confidence intervals (default 500)\n", stderr);
+    fputs(
+        "  -G MARGIN gating mode: two entrants, baseline first; pass if the lower bound of the candidate's\n"
+        "            Elo difference is at least -MARGIN\n"
+        "  -T RATIO  with -G: also fail if the candidate needs more than RATIO times the baseline CPU time\n", stderr);
+}
+
+/**
+ * Parse the options; `*first_entrant` is set to the index of the first non-option argument.
+ */
+int
+parse_options(Options *opt, int argc, char **argv, int *first_entrant)
+{
+    int i;
+
+    opt->games = 20;
+    opt->opening = 4;
+    opt->threads = parallel_ncpus();
+    opt->bootstrap = 500;
+    opt->seed = 1;
+    opt->gate = 0;
+    opt->gate_margin = 0;
+    opt->gate_max_slowdown = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        char const *const a = argv[i];
+        if (!a[1] || a[2] || i + 1 >= argc)
+            return -1;
+        ++i;
+        switch (a[1]) {
+        case 'g': opt->games = atoi(argv[i]); break;
+        case 'o': opt->opening = atoi(argv[i]); break;
+        case 'j': opt->threads = atoi(argv[i]); break;
+        case 'b': opt->bootstrap = atoi(argv[i]); break;
+        case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+        case 'G': opt->gate = 1; opt->gate_margin = atof(argv[i]); break;
+        case 'T': opt->gate_max_slowdown = atof(argv[i]); break;
+        default:
+            return -1;
+        }
+    }
+    *first_entrant = i;
+
+    if (opt->games < 1 || opt->threads < 1 || opt->bootstrap < 1)
+        return -1;
+    if (opt->gate ? argc - i != 2 : argc - i < 2)
+        return -1;
+    return 0;
+}
+
+/**
+ * Parse `NAME=CONFIG[,key=value...]`.
+ * @returns 0 on success, -1 (after logging the reason) on failure.
+ */
+int
+parse_entrant(Entrant *e, char const *spec)
+{
+    char buf[256];
+    char *config, *field;
+    size_t name_len = strcspn(spec, "=");
+
+    if (!spec[name_len] || name_len == 0 || name_len >= NAME_LEN || strlen(spec) >= sizeof buf) {
+        fprintf(stderr, "invalid entrant '%s'\n", spec);
+        return -1;
+    }
+    memcpy(e->name, spec, name_len);
+    e->name[name_len] = 0;
+    strcpy(buf, spec + name_len + 1);
+
+    config = strtok(buf, ",");
+    ai_config_default(&e->config);
+    if (!config || (strcmp(config, "default") != 0 && ai_config_load(&e->config, config) != 0)) {
+        fprintf(stderr, "%s: cannot load AI configuration '%s'\n", e->name, config ? config : "");
+        return -1;
+    }
+    while ((field = strtok(NULL, ","))) {
+        char *value = strchr(field, '=');
+        if (!value || (*value++ = 0, ai_config_set(&e->config, field, value) != 0)) {
+            fprintf(stderr, "%s: invalid setting '%s'\n", e->name, field);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * CPU time consumed by the calling thread, so that parallel games do not inflate each other's timings.
+ */
+double
+thread_cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void
+play_job(void *ctx, int job, int worker)
+{
+    Tourney *const t = ctx;
+    Match_game *const mg = &t->games[job];
+    Game_ctx *const seat0 = t->worker_ctx[2*worker], *const seat1 = t->worker_ctx[2*worker + 1];
+    Opponent_ai *players[2];
+    Selfplay_result result;
+
+    players[0] = ai_init(seat0->ai, &t->entrants[mg->a].config);
+    players[1] = ai_init(seat1->ai, &t->entrants[mg->b].config);
+
+    game_init(seat0->game, Game_kind_Vs_ai, mg->seed);
+    selfplay_random_opening(seat0->game, t->opt.opening);
+    selfplay_run(seat0->game, players, &thread_cpu_seconds, &result);
+
+    mg->result = result.winner == 0 ? 1.0 : result.winner == 1 ? 0.0 : 0.5;
+    mg->seconds[0] = result.decision_seconds[0];
+    mg->seconds[1] = result.decision_seconds[1];
+    mg->decisions[0] = result.moves[0];
+    mg->decisions[1] = result.moves[1];
+}
+
+/**
+ * Fit Bradley-Terry strengths by minorization-maximization, then convert them to Elo relative to entrant 0.
+ * `score[i*n + j]` is what i scored against j, `played[i*n + j]` the number of games between them.
+ * Every pair gets one extra virtual tie, so that ratings stay finite when some entrant never wins (or never loses).
+ */
+void
+fit_ratings(int n, double const *score, double const *played, double *elo)
+{
+    double *r = malloc_or_die(n * sizeof *r);
+    int i, j, it;
+
+    for (i = 0; i < n; ++i)
+        r[i] = 1.0;
+
+    for (it = 0; it < FIT_ITERATIONS; ++it) {
+        for (i = 0; i < n; ++i) {
+            double wins = 0, denom = 0;
+            for (j = 0; j < n; ++j) {
+                if (j == i) continue;
+                wins += score[i*n + j] + 0.5;
+                denom += (played[i*n + j] + 1.0) / (r[i] + r[j]);
+            }
+            r[i] = wins / denom;
+        }
+    }
+
+    for (i = 0; i < n; ++i)
+        elo[i] = 400.0 * log10(r[i] / r[0]);
+    free(r);
+}
+
+/**
+ * Build the score and games-played matrices from a selection of games (`pick[k]` is the index of the k-th game,
+ * possibly repeated, as when bootstrapping).
+ */
+void
+tally(Tourney const *t, int const *pick, double *score, double *played)
+{
+    int k, n = t->n;
+
+    memset(score, 0, n * n * sizeof *score);
+    memset(played, 0, n * n * sizeof *played);
+    for (k = 0; k < t->n_games; ++k) {
+        Match_game const *mg = &t->games[pick[k]];
+        score[mg->a*n + mg->b] += mg->result;
+        score[mg->b*n + mg->a] += 1.0 - mg->result;
+        played[mg->a*n + mg->b] += 1;
+        played[mg->b*n + mg->a] += 1;
+    }
+}
+
+int
+compare_doubles(void const *a, void const *b)
+{
+    double const x = *(double const *)a, y = *(double const *)b;
+    return x < y ? -1 : x > y;
+}
+
+int
+compare_standings(void const *a, void const *b)
+{
+    double const x = ((Standing const *)a)->elo, y = ((Standing const *)b)->elo;
+    return x > y ? -1 : x < y;
+}
+
+void
+compute_standings(Tourney *t, Standing *st)
+{
+    int const n = t->n, samples = t->opt.bootstrap;
+    double *score = malloc_or_die(n * n * sizeof *score);
+    double *played = malloc_or_die(n * n * sizeof *played);
+    double *elo = malloc_or_die(n * sizeof *elo);
+    double *boot = malloc_or_die(n * samples * sizeof *boot);
+    int *pick = malloc_or_die(t->n_games * sizeof *pick);
+    double *seconds = malloc_or_die(n * sizeof *seconds);
+    long *decisions = malloc_or_die(n * sizeof *decisions);
+    Rng rng;
+    int i, j, k;
+
+    for (k = 0; k < t->n_games; ++k)
+        pick[k] = k;
+    tally(t, pick, score, played);
+    fit_ratings(n, score, played, elo);
+
+    for (i = 0; i < n; ++i) {
+        seconds[i] = 0;
+        decisions[i] = 0;
+        st[i].entrant = i;
+        st[i].elo = elo[i];
+        st[i].score = st[i].played = 0;
+        for (j = 0; j < n; ++j) {
+            st[i].score += score[i*n + j];
+            st[i].played += played[i*n + j];
+        }
+    }
+    for (k = 0; k < t->n_games; ++k) {
+        Match_game const *mg = &t->games[k];
+        seconds[mg->a] += mg->seconds[0];
+        seconds[mg->b] += mg->seconds[1];
+        decisions[mg->a] += mg->decisions[0];
+        decisions[mg->b] += mg->decisions[1];
+    }
+    for (i = 0; i < n; ++i)
+        st[i].ms_per_decision = decisions[i] ? 1000.0 * seconds[i] / decisions[i] : 0;
+
+    /* percentile bootstrap: refit on games resampled with replacement */
+    rng_seed(&rng, t->opt.seed);
+    for (j = 0; j < samples; ++j) {
+        for (k = 0; k < t->n_games; ++k)
+            pick[k] = (int) rng_below(&rng, t->n_games);
+        tally(t, pick, score, played);
+        fit_ratings(n, score, played, elo);
+        for (i = 0; i < n; ++i)
+            boot[i*samples + j] = elo[i];
+    }
+    for (i = 0; i < n; ++i) {
+        double *const b = &boot[i*samples];
+        qsort(b, samples, sizeof *b, &compare_doubles);
+        st[i].elo_lo = b[(int) floor((1 - CONFIDENCE) / 2 * (samples - 1))];
+        st[i].elo_hi = b[(int) ceil((1 + CONFIDENCE) / 2 * (samples - 1))];
+    }
+
+    free(decisions);
+    free(seconds);
+    free(pick);
+    free(boot);
+    free(elo);
+    free(played);
+    free(score);
+}
+
+int
+main(int argc, char **argv)
+{
+    Tourney t;
+    Standing *st;
+    Rng rng;
+    int first, i, j, k, g, passed = 1;
+    size_t ai_bytes = 0;
+
+    if (parse_options(&t.opt, argc, argv, &first) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    t.n = argc - first;
+    t.entrants = malloc_or_die(t.n * sizeof *t.entrants);
+    for (i = 0; i < t.n; ++i) {
+        if (parse_entrant(&t.entrants[i], argv[first + i]) != 0)
+            return EXIT_FAILURE;
+        if (ai_size(&t.entrants[i].config) > ai_bytes)
+            ai_bytes = ai_size(&t.entrants[i].config);
+    }
+
+    /* every pairing plays the same seeds, from both seats */
+    t.n_games = t.n * (t.n - 1) * t.opt.games;
+    t.games = malloc_or_die(t.n_games * sizeof *t.games);
+    rng_seed(&rng, t.opt.seed);
+    for (g = 0, k = 0; g < t.opt.games; ++g) {
+        unsigned long const seed = rng_next(&rng);
+        for (i = 0; i < t.n; ++i) {
+            for (j = 0; j < t.n; ++j) {
+                if (i == j) continue;
+                t.games[k].a = i;
+                t.games[k].b = j;
+                t.games[k].seed = seed;
+                ++k;
+            }
+        }
+    }
+
+    ctxpool_init(&t.ctx_pool, 2 * t.opt.threads, 0, ai_bytes);
+    t.worker_ctx = malloc_or_die(2 * t.opt.threads * sizeof *t.worker_ctx);
+    for (i = 0; i < 2 * t.opt.threads; ++i)
+        t.worker_ctx[i] = ctxpool_acquire(&t.ctx_pool);
+
+    parallel_for(t.n_games, t.opt.threads, &play_job, &t);
+
+    st = malloc_or_die(t.n * sizeof *st);
+    compute_standings(&t, st);
+
+    if (t.opt.gate) {
+        Standing const *const base = &st[0], *const cand = &st[1];
+        double const slowdown = base->ms_per_decision > 0 ? cand->ms_per_decision / base->ms_per_decision : 1;
+
+        printf("%s vs %s: %+.1f Elo [%+.1f, %+.1f] over %.0f games; CPU per decision %.3f ms vs %.3f ms (x%.2f)\n",
+               t.entrants[1].name, t.entrants[0].name, cand->elo, cand->elo_lo, cand->elo_hi, cand->played,
+               cand->ms_per_decision, base->ms_per_decision, slowdown);
+        if (cand->elo_lo < -t.opt.gate_margin) {
+            printf("FAIL: candidate may be weaker than the baseline by more than %.1f Elo\n", t.opt.gate_margin);
+            passed = 0;
+        }
+        if (t.opt.gate_max_slowdown > 0 && slowdown > t.opt.gate_max_slowdown) {
+            printf("FAIL: candidate is more than x%.2f slower than the baseline\n", t.opt.gate_max_slowdown);
+            passed = 0;
+        }
+        if (passed)
+            puts("PASS");
+    } else {
+        qsort(st, t.n, sizeof *st, &compare_standings);
+        printf("%-4s %-*s %8s  %-19s %6s %7s %12s\n", "rank", NAME_LEN - 1, "name", "elo", "95% interval",
+               "games", "score", "ms/decision");
+        for (i = 0; i < t.n; ++i) {
+            printf("%-4d %-*s %+8.1f  [%+7.1f, %+7.1f] %6.0f %6.1f%% %12.3f\n", i + 1, NAME_LEN - 1,
+                   t.entrants[st[i].entrant].name, st[i].elo, st[i].elo_lo, st[i].elo_hi, st[i].played,
+                   100.0 * st[i].score / st[i].played, st[i].ms_per_decision);
+        }
+    }
+
+    free(st);
+    free(t.worker_ctx);
+    ctxpool_deinit(&t.ctx_pool);
+    free(t.games);
+    free(t.entrants);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,575 @@
+/**
+ * @file tune.c
+ * @author Maksim Kovalkov
+ *
+ * Genetic tuning of the AI heuristic weights.
+ * Every generation, each candidate weight set plays the same batch of headless games (starting from random
+ * openings, so that the deterministic AI is tested on varied positions); the fittest survive, the rest of the
+ * population is bred from them. Games run in parallel on every core.
+ *
+ * The run is checkpointed (see checkpoint.h) after each generation, and every few seconds during one: the
+ * checkpoint then also holds every game of the generation, finished, in flight (as of its last decision) or not
+ * started, and the run resumes from it if it exists, losing at most the decisions made since it was written.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "selfplay.h"
+#include "gamectx.h"
+#include "packed.h"
+#include "checkpoint.h"
+#include "util.h"
+#include "parallel.h"
+
+#define TOURNAMENT_SIZE 3
+#define ELITES 2
+#define MUTATION_SIGMA 0.2
+
+/**
+ * Smallest scale of the mutations of each weight (in the order of `ai_weight`), about the magnitude a useful weight
+ * has: mutations are proportional to the base weights, which would keep a weight of 0 (the optional features by
+ * default) at 0.
+ */
+static double const weight_scale[AI_WEIGHTS_N] = {10.0, 10.0, 10.0, 10.0, 0.1, 10.0, 10.0, 10.0, 10.0, 10.0};
+
+/** How the fitness of a candidate is measured. */
+enum Fitness_kind {
+    /** Mean single player score. */
+    Fitness_single,
+    /** Mean result against the base configuration, playing both seats. */
+    Fitness_vs
+};
+
+typedef struct Options {
+    int population, games, generations, opening, depth, threads, checkpoint_seconds;
+    enum Fitness_kind fitness;
+    unsigned long seed;
+    char const *base_path, *checkpoint_path, *best_path;
+} Options;
+
+/**
+ * The tuner's progress, as saved in checkpoints. It is followed by the population, the seeds of the generation's games
+ * and the fitness of each game (meaningful for finished games only).
+ */
+typedef struct Tune_progress {
+    int generation, population, games, seats, opening;
+    /** Whether the games of the generation have started, which the games of the checkpoint are then. */
+    int started;
+    /** Master generator, after drawing the seeds if the games have started. */
+    Rng rng;
+} Tune_progress;
+
+typedef struct Tuner {
+    Options opt;
+    Ai_config base;
+    /** Current generation number, counting from 0. */
+    int generation;
+    /** Master generator: game seeds and genetic operators. */
+    Rng rng;
+    Ai_weights *pop, *next_pop;
+    double *fitness;
+    /** Per-job results for the current generation, and the seeds of its games. */
+    double *job_fitness;
+    unsigned long *seeds;
+    /** Two contexts per worker (candidate and opponent), acquired once: games reuse them without allocating. */
+    Game_ctx_pool ctx_pool;
+    Game_ctx **worker_ctx;
+    /** Games of the generation, and whether they have started (their seeds are drawn). */
+    int n_jobs, started;
+    /** State of each game of the generation as of its last decision, `state` 0 if it has not started. */
+    Packed_game *jobs;
+    /** Copy of `jobs` being written to a checkpoint, and the progress written with it. */
+    Packed_game *saved_jobs;
+    unsigned char *progress;
+    size_t progress_size;
+    /** Guards `jobs`, `job_fitness` and the fields below while games are played. */
+    pthread_mutex_t lock;
+    time_t last_checkpoint;
+    /** Whether a worker is writing a checkpoint. */
+    int saving;
+} Tuner;
+
+static void usage(char const *);
+static int parse_options(Options *, int, char **);
+static double gaussian(Rng *);
+static void mutate(Tuner *, Ai_weights *, double);
+static void init_population(Tuner *);
+static int load_checkpoint(Tuner *);
+static void fill_progress(Tuner *, int);
+static void publish(Tuner *, int, Game const *, double const *);
+static void play_job(void *, int, int);
+static void evaluate(Tuner *);
+static int select_parent(Tuner *);
+static void breed(Tuner *, int const *);
+static int compare_fitness_desc(void const *, void const *);
+
+/* used by `compare_fitness_desc`, which cannot take a context argument */
+static double const *g_sort_fitness;
+
+void
+usage(char const *argv0)
+{
+    fprintf(stderr, "usage: %s [options]\n", argv0);
+    fputs(
+        "  -p N      population size (default 32)\n"
+        "  -g N      games per candidate per generation (default 32)\n"
+        "  -n N      generations to run (default 50)\n"
+        "  -o N      random opening moves per game (default 4)\n"
+        "  -d N      search depth (default: that of the base configuration)\n", stderr);
+    fputs(
+        "  -k KIND   fitness: 'single' (score) or 'vs' (against the base configuration)\n"
+        "  -b FILE   base configuration: center of the first population, opponent with -k vs\n"
+        "  -c FILE   checkpoint file, resumed if present (default tune.ckpt)\n"
+        "  -C N      seconds between checkpoints during a generation, 0 for none (default 60)\n", stderr);
+    fputs(
+        "  -w FILE   where to write the best configuration (default tune.best)\n"
+        "  -s SEED   master seed (default 1)\n"
+        "  -j N      worker threads (default: number of CPUs)\n", stderr);
+}
+
+int
+parse_options(Options *opt, int argc, char **argv)
+{
+    int i;
+
+    opt->population = 32;
+    opt->games = 32;
+    opt->generations = 50;
+    opt->opening = 4;
+    opt->depth = -1;
+    opt->threads = parallel_ncpus();
+    opt->fitness = Fitness_single;
+    opt->seed = 1;
+    opt->base_path = NULL;
+    opt->checkpoint_path = "tune.ckpt";
+    opt->checkpoint_seconds = 60;
+    opt->best_path = "tune.best";
+
+    for (i = 1; i < argc; ++i) {
+        char const *const a = argv[i];
+        if (a[0] != '-' || !a[1] || a[2] || i + 1 >= argc)
+            return -1;
+        ++i;
+        switch (a[1]) {
+        case 'p': opt->population = atoi(argv[i]); break;
+        case 'g': opt->games = atoi(argv[i]); break;
+        case 'n': opt->generations = atoi(argv[i]); break;
+        case 'o': opt->opening = atoi(argv[i]); break;
+        case 'd': opt->depth = atoi(argv[i]); break;
+        case 'j': opt->threads = atoi(argv[i]); break;
+        case 's': opt->seed = strtoul(argv[i], NULL, 10); break;
+        case 'b': opt->base_path = argv[i]; break;
+        case 'c': opt->checkpoint_path = argv[i]; break;
+        case 'C': opt->checkpoint_seconds = atoi(argv[i]); break;
+        case 'w': opt->best_path = argv[i]; break;
+        case 'k':
+            if (strcmp(argv[i], "single") == 0)
+                opt->fitness = Fitness_single;
+            else if (strcmp(argv[i], "vs") == 0)
+                opt->fitness = Fitness_vs;
+            else
+                return -1;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (opt->population <= ELITES || opt->games < 1 || opt->threads < 1 || opt->checkpoint_seconds < 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * @returns a normally distributed value with mean 0 and variance 1 (Box-Muller transform).
+ */
+double
+gaussian(Rng *rng)
+{
+    double const u1 = (rng_next(rng) + 0.5) / 4294967296.0;
+    double const u2 = (rng_next(rng) + 0.5) / 4294967296.0;
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+/**
+ * Apply a random perturbation, proportional to the magnitude of the base weights (at least `weight_scale`), to a
+ * weight set.
+ */
+void
+mutate(Tuner *t, Ai_weights *w, double sigma)
+{
+    int i;
+    for (i = 0; i < AI_WEIGHTS_N; ++i) {
+        double scale = fabs(*ai_weight(&t->base.weights, i));
+        if (scale < weight_scale[i])
+            scale = weight_scale[i];
+        *ai_weight(w, i) += sigma * scale * gaussian(&t->rng);
+    }
+    /* a discount factor only makes sense in [0, 1] */
+    if (w->future < 0.0) w->future = 0.0;
+    if (w->future > 1.0) w->future = 1.0;
+}
+
+/**
+ * First generation: the base weights, plus mutated copies of them.
+ */
+void
+init_population(Tuner *t)
+{
+    int i;
+    t->generation = 0;
+    t->started = 0;
+    rng_seed(&t->rng, t->opt.seed);
+    for (i = 0; i < t->opt.population; ++i) {
+        t->pop[i] = t->base.weights;
+        if (i > 0)
+            mutate(t, &t->pop[i], 2 * MUTATION_SIGMA);
+    }
+}
+
+/**
+ * Restore the base configuration, the progress and, if the generation had started, its games from the checkpoint.
+ * The games are copied as they are: each is only unpacked when a worker picks it up.
+ * @returns 1 if the checkpoint was loaded, 0 if there is none, -1 if it is invalid or from a run with other settings.
+ */
+int
+load_checkpoint(Tuner *t)
+{
+    Checkpoint_reader r;
+    Tune_progress p;
+    unsigned char const *data;
+    int const status = checkpoint_map(&r, t->opt.checkpoint_path, t->progress_size);
+
+    if (status <= 0)
+        return status;
+    memcpy(&p, r.progress, sizeof p);
+    if (p.population != t->opt.population || p.games != t->opt.games || p.opening != t->opt.opening
+        || p.seats != (t->opt.fitness == Fitness_vs ? 2 : 1) || r.n_games != (p.started ? (size_t) t->n_jobs : 0)) {
+        checkpoint_unmap(&r);
+        return -1;
+    }
+
+    t->base = *r.config;
+    t->generation = p.generation;
+    t->rng = p.rng;
+    data = (unsigned char const *) r.progress + sizeof p;
+    memcpy(t->pop, data, t->opt.population * sizeof *t->pop);
+    data += t->opt.population * sizeof *t->pop;
+    memcpy(t->seeds, data, t->opt.games * sizeof *t->seeds);
+    data += t->opt.games * sizeof *t->seeds;
+    memcpy(t->job_fitness, data, t->n_jobs * sizeof *t->job_fitness);
+    t->started = p.started;
+    if (p.started)
+        memcpy(t->jobs, r.games, t->n_jobs * sizeof *t->jobs);
+
+    checkpoint_unmap(&r);
+    return 1;
+}
+
+/**
+ * Fill in `t->progress` for a checkpoint, between generations or, if `started`, during one.
+ */
+void
+fill_progress(Tuner *t, int started)
+{
+    Tune_progress p;
+    unsigned char *data = t->progress;
+
+    memset(&p, 0, sizeof p);
+    p.generation = t->generation;
+    p.population = t->opt.population;
+    p.games = t->opt.games;
+    p.seats = t->opt.fitness == Fitness_vs ? 2 : 1;
+    p.opening = t->opt.opening;
+    p.started = started;
+    p.rng = t->rng;
+    memcpy(data, &p, sizeof p);
+    data += sizeof p;
+    memcpy(data, t->pop, t->opt.population * sizeof *t->pop);
+    data += t->opt.population * sizeof *t->pop;
+    memcpy(data, t->seeds, t->opt.games * sizeof *t->seeds);
+    data += t->opt.games * sizeof *t->seeds;
+    memcpy(data, t->job_fitness, t->n_jobs * sizeof *t->job_fitness);
+}
+
+/**
+ * Record the state of game `job` after a decision (and its fitness once it is over, in `fitness`), then write a
+ * checkpoint if one is due and no other worker is writing it. The checkpoint is written from copies, so that the
+ * other workers only wait for the copying.
+ */
+void
+publish(Tuner *t, int job, Game const *game, double const *fitness)
+{
+    int save = 0;
+
+    pthread_mutex_lock(&t->lock);
+    packed_from_game(&t->jobs[job], game);
+    if (fitness)
+        t->job_fitness[job] = *fitness;
+    if (t->opt.checkpoint_seconds && !t->saving && time(NULL) - t->last_checkpoint >= t->opt.checkpoint_seconds) {
+        memcpy(t->saved_jobs, t->jobs, t->n_jobs * sizeof *t->jobs);
+        fill_progress(t, 1);
+        save = t->saving = 1;
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    if (save) {
+        if (checkpoint_save(t->opt.checkpoint_path, &t->base, t->progress, t->progress_size, t->saved_jobs,
+                            (size_t) t->n_jobs) != 0)
+            fprintf(stderr, "cannot write checkpoint %s\n", t->opt.checkpoint_path);
+        pthread_mutex_lock(&t->lock);
+        t->saving = 0;
+        t->last_checkpoint = time(NULL);
+        pthread_mutex_unlock(&t->lock);
+    }
+}
+
+/**
+ * Play one game of the current generation, or what is left of it if it was resumed from a checkpoint.
+ * Jobs are numbered candidate-major; in versus mode every seed is played twice, once from each seat.
+ */
+void
+play_job(void *ctx, int job, int worker)
+{
+    Tuner *const t = ctx;
+    int const seats = t->opt.fitness == Fitness_vs ? 2 : 1;
+    int const candidate = job / (t->opt.games * seats);
+    int const game_i = (job / seats) % t->opt.games;
+    int const seat = job % seats;
+    Game_ctx *const mine = t->worker_ctx[2*worker], *const theirs = t->worker_ctx[2*worker + 1];
+    Game *const game = mine->game;
+    Ai_config config = t->base;
+    Opponent_ai *players[2];
+    Packed_game resumed;
+    double fitness;
+    int winner;
+
+    pthread_mutex_lock(&t->lock);
+    resumed = t->jobs[job];
+    pthread_mutex_unlock(&t->lock);
+    if (resumed.state == Game_state_Win || resumed.state == Game_state_Lose)
+        return;
+
+    config.weights = t->pop[candidate];
+
+    players[seat] = ai_init(mine->ai, &config);
+    if (seats == 2)
+        players[!seat] = ai_init(theirs->ai, &t->base);
+    else
+        players[1] = players[0];
+
+    if (resumed.state) {
+        packed_to_game(game, &resumed);
+    } else {
+        game_init(game, seats == 2 ? Game_kind_Vs_ai : Game_kind_Singleplayer, t->seeds[game_i]);
+        selfplay_random_opening(game, t->opt.opening);
+    }
+
+    /* as `selfplay_run`, publishing the game between moves */
+    while (game->state != Game_state_Win && game->state != Game_state_Lose) {
+        do_game_step(game, ai_next_action(players[game->current_player], game));
+        if (game->state == Game_state_Choose)
+            publish(t, job, game, NULL);
+    }
+
+    winner = selfplay_winner(game);
+    if (seats == 1) {
+        fitness = game->score[0];
+    } else {
+        /* a win is worth more than any score difference; the difference breaks ties between results */
+        fitness = (winner == seat ? 100.0 : winner < 0 ? 50.0 : 0.0) + 0.01 * (game->score[seat] - game->score[!seat]);
+    }
+    publish(t, job, game, &fitness);
+}
+
+/**
+ * Play every game of the current generation (those not finished yet, if it was resumed) and compute the mean fitness
+ * of each candidate.
+ */
+void
+evaluate(Tuner *t)
+{
+    int const per_candidate = t->opt.games * (t->opt.fitness == Fitness_vs ? 2 : 1);
+    int i, j;
+
+    if (!t->started) {
+        /* every candidate plays the same games, so that they are compared on equal terms */
+        for (i = 0; i < t->opt.games; ++i)
+            t->seeds[i] = rng_next(&t->rng);
+        memset(t->jobs, 0, t->n_jobs * sizeof *t->jobs);
+        t->started = 1;
+    }
+
+    parallel_for(t->n_jobs, t->opt.threads, &play_job, t);
+
+    for (i = 0; i < t->opt.population; ++i) {
+        double sum = 0;
+        for (j = 0; j < per_candidate; ++j)
+            sum += t->job_fitness[i * per_candidate + j];
+        t->fitness[i] = sum / per_candidate;
+    }
+}
+
+int
+compare_fitness_desc(void const *a, void const *b)
+{
+    double const fa = g_sort_fitness[*(int const *)a], fb = g_sort_fitness[*(int const *)b];
+    return fa < fb ? 1 : fa > fb ? -1 : *(int const *)a - *(int const *)b;
+}
+
+/**
+ * @returns the index of the fittest of a few randomly picked candidates.
+ */
+int
+select_parent(Tuner *t)
+{
+    int i, best = (int) rng_below(&t->rng, t->opt.population);
+    for (i = 1; i < TOURNAMENT_SIZE; ++i) {
+        int const c = (int) rng_below(&t->rng, t->opt.population);
+        if (t->fitness[c] > t->fitness[best])
+            best = c;
+    }
+    return best;
+}
+
+/**
+ * Build the next generation: the elites survive unchanged, every other candidate is a mutated crossover of two
+ * parents. `ranking` lists the candidates from the fittest.
+ */
+void
+breed(Tuner *t, int const *ranking)
+{
+    Ai_weights *swap;
+    int i, j;
+
+    for (i = 0; i < ELITES; ++i)
+        t->next_pop[i] = t->pop[ranking[i]];
+
+    for (; i < t->opt.population; ++i) {
+        Ai_weights a = t->pop[select_parent(t)], b = t->pop[select_parent(t)];
+        Ai_weights child = a;
+        for (j = 0; j < AI_WEIGHTS_N; ++j) {
+            double const wa = *ai_weight(&a, j), wb = *ai_weight(&b, j);
+            /* blend crossover: anywhere on (and slightly beyond) the segment between the parents */
+            double const u = -0.25 + 1.5 * (rng_next(&t->rng) / 4294967296.0);
+            *ai_weight(&child, j) = wa + u * (wb - wa);
+        }
+        mutate(t, &child, MUTATION_SIGMA);
+        t->next_pop[i] = child;
+    }
+
+    swap = t->pop;
+    t->pop = t->next_pop;
+    t->next_pop = swap;
+}
+
+int
+main(int argc, char **argv)
+{
+    Tuner t;
+    int *ranking;
+    int i, seats;
+
+    if (parse_options(&t.opt, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ai_config_default(&t.base);
+    if (t.opt.base_path && ai_config_load(&t.base, t.opt.base_path) != 0) {
+        fprintf(stderr, "cannot load AI configuration from %s\n", t.opt.base_path);
+        return EXIT_FAILURE;
+    }
+    if (t.opt.depth >= 0)
+        t.base.depth = t.opt.depth;
+
+    seats = t.opt.fitness == Fitness_vs ? 2 : 1;
+    t.pop = malloc_or_die(t.opt.population * sizeof *t.pop);
+    t.next_pop = malloc_or_die(t.opt.population * sizeof *t.next_pop);
+    t.fitness = malloc_or_die(t.opt.population * sizeof *t.fitness);
+    t.n_jobs = t.opt.population * t.opt.games * seats;
+    t.job_fitness = malloc_or_die(t.n_jobs * sizeof *t.job_fitness);
+    t.jobs = malloc_or_die(t.n_jobs * sizeof *t.jobs);
+    t.saved_jobs = malloc_or_die(t.n_jobs * sizeof *t.saved_jobs);
+    t.progress_size = sizeof (Tune_progress) + t.opt.population * sizeof *t.pop + t.opt.games * sizeof *t.seeds
+        + t.n_jobs * sizeof *t.job_fitness;
+    t.progress = malloc_or_die(t.progress_size);
+    pthread_mutex_init(&t.lock, NULL);
+    t.last_checkpoint = time(NULL);
+    t.saving = 0;
+    t.seeds = malloc_or_die(t.opt.games * sizeof *t.seeds);
+    ranking = malloc_or_die(t.opt.population * sizeof *ranking);
+
+    switch (load_checkpoint(&t)) {
+    case 1:
+        fprintf(stderr, "resuming from %s at generation %d%s\n", t.opt.checkpoint_path, t.generation,
+                t.started ? ", in the middle of it" : "");
+        break;
+    case 0:
+        init_population(&t);
+        break;
+    default:
+        fprintf(stderr, "invalid checkpoint %s (or from a run with other -p, -g, -o or -k)\n", t.opt.checkpoint_path);
+        return EXIT_FAILURE;
+    }
+
+    /* candidates only differ from the base in their weights; sized once the checkpoint may have replaced the base */
+    ctxpool_init(&t.ctx_pool, 2 * t.opt.threads, 0, ai_size(&t.base));
+    t.worker_ctx = malloc_or_die(2 * t.opt.threads * sizeof *t.worker_ctx);
+    for (i = 0; i < 2 * t.opt.threads; ++i)
+        t.worker_ctx[i] = ctxpool_acquire(&t.ctx_pool);
+
+    while (t.generation < t.opt.generations) {
+        Ai_config best = t.base;
+        double mean = 0;
+
+        evaluate(&t);
+
+        for (i = 0; i < t.opt.population; ++i) {
+            ranking[i] = i;
+            mean += t.fitness[i];
+        }
+        g_sort_fitness = t.fitness;
+        qsort(ranking, t.opt.population, sizeof *ranking, &compare_fitness_desc);
+
+        best.weights = t.pop[ranking[0]];
+        printf("generation %3d  best %9.3f  mean %9.3f ", t.generation, t.fitness[ranking[0]],
+               mean / t.opt.population);
+        for (i = 0; i < AI_WEIGHTS_N; ++i)
+            printf(" %s=%.3f", ai_weight_name(i), *ai_weight(&best.weights, i));
+        putchar('\n');
+        fflush(stdout);
+
+        if (ai_config_save(&best, t.opt.best_path) != 0)
+            fprintf(stderr, "cannot write %s\n", t.opt.best_path);
+
+        breed(&t, ranking);
+        ++t.generation;
+        t.started = 0;
+        fill_progress(&t, 0);
+        if (checkpoint_save(t.opt.checkpoint_path, &t.base, t.progress, t.progress_size, NULL, 0) != 0)
+            fprintf(stderr, "cannot write checkpoint %s\n", t.opt.checkpoint_path);
+        t.last_checkpoint = time(NULL);
+    }
+
+    pthread_mutex_destroy(&t.lock);
+    free(t.progress);
+    free(t.saved_jobs);
+    free(t.jobs);
+    free(t.worker_ctx);
+    ctxpool_deinit(&t.ctx_pool);
+    free(ranking);
+    free(t.seeds);
+    free(t.job_fitness);
+    free(t.fitness);
+    free(t.next_pop);
+    free(t.pop);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file trainlog.c
+ * @author Maksim Kovalkov
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "util.h"
+
+#include "trainlog.h"
+
+/* fail to compile if the fields and the padding do not add up */
+typedef char trainlog_record_size_check[sizeof (Trainlog_record) == TRAINLOG_RECORD_SIZE ? 1 : -1];
+typedef char trainlog_header_size_check[sizeof (Trainlog_header) == 64 ? 1 : -1];
+
+static void fill_header(Trainlog_header *);
+
+/**
+ * The header written by this build.
+ */
+void
+fill_header(Trainlog_header *h)
+{
+    memset(h, 0, sizeof *h);
+    memcpy(h->magic, TRAINLOG_MAGIC, sizeof h->magic);
+    h->byte_order = TRAINLOG_BYTE_ORDER;
+    h->record_size = sizeof (Trainlog_record);
+    h->board_rows = BOARD_ROWS;
+    h->board_cols = BOARD_COLS;
+}
+
+void
+trainlog_fill(Trainlog_record *r, Game const *game, Ai_decision const *d, int move)
+{
+    int const pl = game->current_player;
+    int y, i;
+
+    memset(r, 0, sizeof *r);
+    for (y = 0; y < BOARD_ROWS; ++y)
+        r->rows[y] = row_bits_pack(game->board[pl][y]);
+    r->score[0] = (unsigned short) game->score[pl];
+    r->score[1] = (unsigned short) game->score[!pl];
+    r->move = (unsigned short) move;
+    memcpy(r->pieces_left, game->pieces_left, sizeof r->pieces_left);
+    r->kind = (unsigned char) game->kind;
+    r->player = (unsigned char) pl;
+    r->type = d->type;
+    r->rots = d->rots;
+    r->x = (signed char) d->x;
+    r->outcome = Trainlog_outcome_Unknown;
+    r->endgame = (unsigned char) d->endgame;
+
+    r->n_candidates = (unsigned char) (d->n_candidates < TRAINLOG_CANDIDATES ? d->n_candidates : TRAINLOG_CANDIDATES);
+    for (i = 0; i < r->n_candidates; ++i) {
+        r->candidates[i].score = (float) d->candidates[i].score;
+        r->candidates[i].type = d->candidates[i].type;
+        r->candidates[i].rots = d->candidates[i].rots;
+        r->candidates[i].x = (signed char) d->candidates[i].x;
+    }
+}
+
+void
+trainlog_set_outcome(Trainlog_record *r, size_t n, int winner)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (winner < 0)
+            r[i].outcome = r[i].kind == Game_kind_Singleplayer ? Trainlog_outcome_Loss : Trainlog_outcome_Tie;
+        else
+            r[i].outcome = r[i].player == winner ? Trainlog_outcome_Win : Trainlog_outcome_Loss;
+    }
+}
+
+int
+trainlog_open(Trainlog_writer *w, char const *path)
+{
+    Trainlog_header h;
+
+    if (!(w->f = fopen(path, "wb")))
+        return -1;
+    setvbuf(w->f, w->buffer, _IOFBF, sizeof w->buffer);
+    fill_header(&h);
+    return fwrite(&h, sizeof h, 1, w->f) == 1 ? 0 : -1;
+}
+
+int
+trainlog_write(Trainlog_writer *w, Trainlog_record const *r, size_t n)
+{
+    return fwrite(r, sizeof *r, n, w->f) == n ? 0 : -1;
+}
+
+int
+trainlog_close(Trainlog_writer *w)
+{
+    int const ok = !ferror(w->f);
+    int const closed = fclose(w->f) == 0;
+
+    w->f = NULL;
+    return ok && closed ? 0 : -1;
+}
+
+int
+trainlog_map(Trainlog_reader *r, char const *path)
+{
+    Trainlog_header h;
+
+    if (map_file(&r->file, path) != 0)
+        return -1;
+    fill_header(&h);
+    if (r->file.size < sizeof h || memcmp(r->file.data, &h, sizeof h) != 0
+        || (r->file.size - sizeof h) % sizeof (Trainlog_record) != 0) {
+        unmap_file(&r->file);
+        return -1;
+    }
+    r->records = (Trainlog_record const *) ((unsigned char const *) r->file.data + sizeof h);
+    r->count = (r->file.size - sizeof h) / sizeof (Trainlog_record);
+    return 0;
+}
+
+void
+trainlog_unmap(Trainlog_reader *r)
+{
+    unmap_file(&r->file);
+    r->records = NULL;
+    r->count = 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file trainlog.h
+ * @author Maksim Kovalkov
+ */
+
+#ifndef XTETRIS_TRAINLOG_H
+#define XTETRIS_TRAINLOG_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "tetris.h"
+#include "opponentai.h"
+#include "util.h"
+
+/**
+ * Training data: one fixed-size record per AI decision, for offline analysis and for fitting evaluation functions.
+ *
+ * A file is a `Trainlog_header` followed by records, in the byte order and floating point format of the machine
+ * that wrote it (the header lets readers check that it is theirs), so that it can be mapped and used in place with
+ * no parsing. The records of a game are contiguous and in order, starting from `move` 0.
+ */
+
+/** Candidate moves kept per record (the best ones). */
+#define TRAINLOG_CANDIDATES 24
+/** Bytes used by the fields of a record before the candidates. */
+#define TRAINLOG_RECORD_USED (sizeof (Row_bits) * BOARD_ROWS + 2 * 2 + 2 + 7 + 8)
+/** Size of the fields before the candidates, padding included: whole cache lines (one on the 15x10 board). */
+#define TRAINLOG_RECORD_HEAD ((TRAINLOG_RECORD_USED / 64 + 1) * 64)
+/** Size of a record: 4 cache lines on the 15x10 board. */
+#define TRAINLOG_RECORD_SIZE (TRAINLOG_RECORD_HEAD + TRAINLOG_CANDIDATES * 8)
+
+/** The end of the game, from the point of view of the player who made the decision. */
+enum Trainlog_outcome {
+    Trainlog_outcome_Unknown = 0,
+    Trainlog_outcome_Win,
+    Trainlog_outcome_Tie,
+    Trainlog_outcome_Loss
+};
+
+typedef struct Trainlog_candidate {
+    /** Score given by the search (see `Ai_candidate`). */
+    float score;
+    unsigned char type, rots;
+    signed char x;
+    unsigned char pad;
+} Trainlog_candidate;
+
+typedef struct Trainlog_record {
+    /** Board of the deciding player before the move, one bitboard per row. */
+    Row_bits rows[BOARD_ROWS];
+    /** Scores before the move: the deciding player's, then the opponent's. */
+    unsigned short score[2];
+    /** Number of the decision in the game, counting both players. */
+    unsigned short move;
+    unsigned char pieces_left[7];
+    /** `enum Game_kind` and index of the deciding player. */
+    unsigned char kind, player;
+    /** The move played: piece type, clockwise rotations, column. */
+    unsigned char type, rots;
+    signed char x;
+    /** `enum Trainlog_outcome`. */
+    unsigned char outcome;
+    /** Whether the move was found by the endgame search. */
+    unsigned char endgame;
+    unsigned char n_candidates;
+    unsigned char pad[TRAINLOG_RECORD_HEAD - TRAINLOG_RECORD_USED];
+    Trainlog_candidate candidates[TRAINLOG_CANDIDATES];
+} Trainlog_record;
+
+#define TRAINLOG_MAGIC "XTTRAIN1"
+/** Written as a native `unsigned short`: readers on a machine with the other byte order see 0x0201. */
+#define TRAINLOG_BYTE_ORDER 0x0102
+
+typedef struct Trainlog_header {
+    char magic[8];
+    unsigned short byte_order, record_size, board_rows, board_cols;
+    unsigned char pad[48];
+} Trainlog_header;
+
+/** Size of the buffer through which records are written. */
+#define TRAINLOG_BUFFER_SIZE (1 << 16)
+
+/**
+ * Output file of records, written through an internal buffer.
+ */
+typedef struct Trainlog_writer {
+    FILE *f;
+    char buffer[TRAINLOG_BUFFER_SIZE];
+} Trainlog_writer;
+
+/**
+ * Read-only view of a file of records, mapped in memory: `records[0 .. count)` can be used directly.
+ */
+typedef struct Trainlog_reader {
+    Mapped_file file;
+    Trainlog_record const *records;
+    size_t count;
+} Trainlog_reader;
+
+/**
+ * Fill in a record for the decision `d` just made by the current player of `game`, which must still be in the state
+ * the decision was made from. The outcome is left unknown.
+ */
+void trainlog_fill(Trainlog_record *, Game const *, Ai_decision const *, int move);
+/**
+ * Set the outcome of the `n` records of a game, each from its own player's point of view.
+ * @param winner index of the player who won, -1 for a tie (and in single player, 0 if every piece was placed).
+ */
+void trainlog_set_outcome(Trainlog_record *, size_t n, int winner);
+
+/**
+ * Create (or truncate) a file of records and write its header.
+ * @returns 0 on success, -1 on failure.
+ */
+int trainlog_open(Trainlog_writer *, char const *path);
+/**
+ * Append `n` records.
+ * @returns 0 on success, -1 on failure.
+ */
+int trainlog_write(Trainlog_writer *, Trainlog_record const *, size_t n);
+/**
+ * Flush and close the file.
+ * @returns 0 on success, -1 if anything failed since opening it.
+ */
+int trainlog_close(Trainlog_writer *);
+
+/**
+ * Map a file of records and check its header.
+ * @returns 0 on success, -1 if the file cannot be read or was not written by a compatible build.
+ */
+int trainlog_map(Trainlog_reader *, char const *path);
+/**
+ * Release a mapped file of records.
+ */
+void trainlog_unmap(Trainlog_reader *);
+#endif /* ifndef XTETRIS_TRAINLOG_H */
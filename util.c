@@ -3,10 +3,19 @@
  * @author Maksim Kovalkov
  */
 
+#include "platform.h"
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 
+#ifdef XTETRIS_HAVE_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "util.h"
 
 void *
@@ -45,3 +54,150 @@ alloc_many_or_die(size_t obj_count, size_t obj_size)
     perror("malloc failed");
     exit(EXIT_FAILURE);
 }
+
+void
+arena_init(Arena *arena, size_t capacity)
+{
+    size_t misalign;
+
+    arena->block = malloc_or_die(capacity + CACHE_LINE - 1);
+    misalign = (size_t) arena->block % CACHE_LINE;
+    arena->base = (unsigned char *) arena->block + (misalign ? CACHE_LINE - misalign : 0);
+    arena->capacity = capacity;
+    arena->used = 0;
+}
+
+void
+arena_deinit(Arena *arena)
+{
+    free(arena->block);
+    arena->block = NULL;
+    arena->base = NULL;
+    arena->capacity = arena->used = 0;
+}
+
+void *
+arena_alloc(Arena *arena, size_t sz)
+{
+    void *p;
+
+    sz = CACHE_ALIGN(sz);
+    if (sz > arena->capacity - arena->used)
+        return NULL;
+    p = arena->base + arena->used;
+    arena->used += sz;
+    return p;
+}
+
+void
+arena_reset(Arena *arena)
+{
+    arena->used = 0;
+}
+
+void
+pool_init(Pool *pool, size_t slot_size, size_t capacity)
+{
+    size_t i;
+
+    /* every slot must at least be able to hold the free list link */
+    if (slot_size < sizeof (void *))
+        slot_size = sizeof (void *);
+    pool->slot_size = CACHE_ALIGN(slot_size);
+    arena_init(&pool->arena, pool->slot_size * capacity);
+
+    /* thread the free list through all slots, so that they are handed out in address order */
+    pool->free_list = NULL;
+    for (i = capacity; i-- > 0;)
+        pool_put(pool, pool->arena.base + i * pool->slot_size);
+    pool->arena.used = pool->arena.capacity;
+}
+
+void
+pool_deinit(Pool *pool)
+{
+    arena_deinit(&pool->arena);
+    pool->free_list = NULL;
+}
+
+void *
+pool_get(Pool *pool)
+{
+    void *slot = pool->free_list;
+    if (slot)
+        pool->free_list = *(void **) slot;
+    return slot;
+}
+
+void
+pool_put(Pool *pool, void *slot)
+{
+    *(void **) slot = pool->free_list;
+    pool->free_list = slot;
+}
+
+int
+map_file(Mapped_file *mf, char const *path)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *p;
+
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    mf->size = (size_t) st.st_size;
+    mf->mapped = 1;
+    if (mf->size == 0) {
+        /* mmap refuses empty mappings */
+        mf->data = NULL;
+        close(fd);
+        return 0;
+    }
+    p = mmap(NULL, mf->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+    mf->data = p;
+    return 0;
+#else
+    FILE *f = fopen(path, "rb");
+    long size;
+    void *p;
+
+    if (!f)
+        return -1;
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+    p = malloc_or_die(size ? (size_t) size : 1);
+    if (fread(p, 1, (size_t) size, f) != (size_t) size) {
+        free(p);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    mf->data = p;
+    mf->size = (size_t) size;
+    mf->mapped = 0;
+    return 0;
+#endif
+}
+
+void
+unmap_file(Mapped_file *mf)
+{
+#ifdef XTETRIS_HAVE_POSIX
+    if (mf->mapped && mf->data)
+        munmap((void *) mf->data, mf->size);
+#endif
+    if (!mf->mapped)
+        free((void *) mf->data);
+    mf->data = NULL;
+    mf->size = 0;
+}
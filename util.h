@@ -26,6 +26,97 @@ void * malloc_or_die(size_t sz);
  */
 void * alloc_many_or_die(size_t, size_t);
 
+/**
+ * Alignment of every block handed out by arenas and pools: the size of a cache line on common hardware, so that
+ * objects used by different threads never share one.
+ */
+#define CACHE_LINE 64
+
+/**
+ * Round `sz` up to a multiple of `CACHE_LINE`.
+ */
+#define CACHE_ALIGN(sz) (((sz) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+
+/**
+ * Bump allocator over a single contiguous block: allocating is just advancing an offset, and everything is freed at
+ * once by `arena_reset` or `arena_deinit`.
+ */
+typedef struct Arena {
+    /** Start of the usable, cache-aligned memory. */
+    unsigned char *base;
+    size_t capacity, used;
+    /** The block as returned by malloc. */
+    void *block;
+} Arena;
+
+/**
+ * Allocate the backing block of an arena. Logs to `stderr` and exits on failure.
+ */
+void arena_init(Arena *, size_t capacity);
+/**
+ * Free the backing block. Every pointer obtained from the arena becomes invalid.
+ */
+void arena_deinit(Arena *);
+/**
+ * Carve a cache-aligned object out of the arena.
+ * @returns a pointer to `sz` bytes, or NULL if the arena is full.
+ */
+void * arena_alloc(Arena *, size_t sz);
+/**
+ * Forget every allocation, making the whole capacity available again (without freeing anything).
+ */
+void arena_reset(Arena *);
+
+/**
+ * Fixed-size object pool: `capacity` cache-aligned slots carved from one arena, recycled through a free list.
+ * After `pool_init`, getting and putting slots never touches the heap.
+ */
+typedef struct Pool {
+    Arena arena;
+    size_t slot_size;
+    /** Singly linked list of free slots, threaded through the slots themselves. */
+    void *free_list;
+} Pool;
+
+/**
+ * Allocate room for `capacity` objects of `slot_size` bytes each. Logs to `stderr` and exits on failure.
+ */
+void pool_init(Pool *, size_t slot_size, size_t capacity);
+/**
+ * Free the pool's memory. Every slot obtained from it becomes invalid.
+ */
+void pool_deinit(Pool *);
+/**
+ * Take a free slot (with unspecified contents).
+ * @returns a cache-aligned pointer to `slot_size` bytes, or NULL if every slot is in use.
+ */
+void * pool_get(Pool *);
+/**
+ * Give back a slot obtained from `pool_get` on the same pool.
+ */
+void pool_put(Pool *, void *);
+
+/**
+ * Read-only view of a whole file: memory mapped where the platform allows it (see platform.h), otherwise read into
+ * one heap block. Either way the contents can be used in place, without further copies.
+ */
+typedef struct Mapped_file {
+    void const *data;
+    size_t size;
+    /** Whether `data` is a mapping (otherwise it is a heap block). */
+    int mapped;
+} Mapped_file;
+
+/**
+ * Map the file at `path`.
+ * @returns 0 on success, -1 if the file cannot be opened or read (`errno` is set).
+ */
+int map_file(Mapped_file *, char const *path);
+/**
+ * Release a file mapped by `map_file`; its contents become invalid.
+ */
+void unmap_file(Mapped_file *);
+
 /* typedef struct dynstr {
     char *data;
     unsigned size;
@@ -0,0 +1,62 @@
+/**
+ * @file xtetris.c
+ * @author Maksim Kovalkov
+ */
+
+#include "tetris.h"
+#include "opponentai.h"
+
+#include "xtetris.h"
+
+void
+xtetris_init(Game *game, Xtetris_config const *config)
+{
+    game_init(game, config->kind, config->seed);
+}
+
+int
+xtetris_step(Game *game, enum Game_action act)
+{
+    if (!action_is_legal(game, act))
+        return 0;
+    return do_game_step(game, act);
+}
+
+int
+xtetris_legal_actions(Game const *game, enum Game_action actions[XTETRIS_ACTIONS_MAX])
+{
+    int i, n = 0;
+
+    switch (game->state) {
+    case Game_state_Choose:
+        for (i = 0; i < 7; ++i)
+            if (game->pieces_left[i])
+                actions[n++] = (enum Game_action) (Game_action_Choose_I + i);
+        break;
+    case Game_state_Place:
+        actions[n++] = Game_action_Left;
+        actions[n++] = Game_action_Right;
+        actions[n++] = Game_action_Rotate;
+        actions[n++] = Game_action_Drop;
+        break;
+    case Game_state_Cleared:
+        actions[n++] = Game_action_Finish_clearing;
+        break;
+    case Game_state_Lose:
+    case Game_state_Win:
+        break;
+    }
+    return n;
+}
+
+int
+xtetris_over(Game const *game)
+{
+    return game->state == Game_state_Win || game->state == Game_state_Lose;
+}
+
+enum Game_action
+xtetris_ai_decide(Opponent_ai *ai, Game const *game)
+{
+    return ai_next_action(ai, game);
+}
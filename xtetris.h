@@ -0,0 +1,55 @@
+/**
+ * @file xtetris.h
+ * @author Maksim Kovalkov
+ *
+ * Entry points of libxtetris.a (`make lib`), the engine without any I/O, for programs that run games from their own
+ * event loop: set a game up, feed it actions one at a time, ask which actions it accepts, and let the AI decide.
+ * Together with tetris.h and opponentai.h, which it includes, this is all an embedding program needs.
+ *
+ * Everything is reentrant and allocation-free: the caller owns the `Game` and the memory of the AI (see `ai_size`
+ * and `ai_init`), and nothing is shared between games, so any number of them can run on any number of threads.
+ * The x-tetris game itself is the terminal front-end over this library.
+ */
+
+#ifndef XTETRIS_XTETRIS_H
+#define XTETRIS_XTETRIS_H
+
+#include "tetris.h"
+#include "opponentai.h"
+
+/** Most actions a game can accept in one state (one per piece, in `Game_state_Choose`). */
+#define XTETRIS_ACTIONS_MAX 7
+
+/**
+ * How to set up a game.
+ */
+typedef struct Xtetris_config {
+    enum Game_kind kind;
+    /** With the actions it receives, the seed determines the whole game (see `game_init`). */
+    unsigned long seed;
+} Xtetris_config;
+
+/**
+ * Set up a new game.
+ */
+void xtetris_init(Game *, Xtetris_config const *);
+/**
+ * Apply an action from any source: it is checked first, and ignored if the game does not accept it in its state.
+ * @returns as `do_game_step`, whether more actions can be applied before the game is next shown (0 if ignored).
+ */
+int xtetris_step(Game *, enum Game_action);
+/**
+ * List the actions the game accepts in its state, choices of pieces that are not left excepted.
+ * @returns the number of actions written to `actions`, 0 once the game is over.
+ */
+int xtetris_legal_actions(Game const *, enum Game_action actions[XTETRIS_ACTIONS_MAX]);
+/**
+ * @returns whether the game has ended (`Game_state_Win` or `Game_state_Lose`).
+ */
+int xtetris_over(Game const *);
+/**
+ * Let the AI play the current player's next action, to be given to `xtetris_step`. The AI searches when a piece is
+ * to be chosen (`ai_last_decision` then describes the whole placement), and the following actions replay the result.
+ */
+enum Game_action xtetris_ai_decide(Opponent_ai *, Game const *);
+#endif /* ifndef XTETRIS_XTETRIS_H */